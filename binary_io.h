@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+// Minimal helpers for the native-endian binary files written by the planner
+class BinaryWriter {
+private:
+    std::string& out;
+
+public:
+    explicit BinaryWriter(std::string& out) : out(out) {}
+
+    template <typename T>
+    void write(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "BinaryWriter: type must be trivially copyable");
+        out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void writeBytes(const void* data, size_t size) {
+        out.append(static_cast<const char*>(data), size);
+    }
+
+    void writeString(const std::string& value) {
+        write<uint32_t>(static_cast<uint32_t>(value.size()));
+        out.append(value);
+    }
+};
+
+// Bounds-checked cursor over a buffer (typically an mmap'd file); throws on truncation
+class BinaryReader {
+private:
+    const char* cursor;
+    const char* end;
+
+    void require(size_t size) const {
+        if (static_cast<size_t>(end - cursor) < size) {
+            throw std::runtime_error("BinaryReader: unexpected end of data");
+        }
+    }
+
+public:
+    BinaryReader(const char* data, size_t size) : cursor(data), end(data + size) {}
+
+    template <typename T>
+    T read() {
+        static_assert(std::is_trivially_copyable<T>::value, "BinaryReader: type must be trivially copyable");
+        require(sizeof(T));
+        T value;
+        std::memcpy(&value, cursor, sizeof(T));
+        cursor += sizeof(T);
+        return value;
+    }
+
+    void readBytes(void* data, size_t size) {
+        require(size);
+        std::memcpy(data, cursor, size);
+        cursor += size;
+    }
+
+    std::string readString() {
+        uint32_t size = read<uint32_t>();
+        require(size);
+        std::string value(cursor, size);
+        cursor += size;
+        return value;
+    }
+
+    bool atEnd() const { return cursor == end; }
+};
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "heavy_hitters.h"
+#include "join_graph.h"
+
+// Estimated cardinality of joining a subset of a query's relations. The
+// enumerators only see this interface, so estimation engines are
+// interchangeable: each implements estimateSubset(), and estimate() memoizes
+// its answers, since enumeration asks for the same subsets repeatedly.
+class CardinalityEstimator {
+private:
+    const JoinGraph& graph;
+    mutable std::unordered_map<uint64_t, double> memo;
+
+protected:
+    // Unclamped estimate for one subset; called at most once per subset
+    virtual double estimateSubset(uint64_t subset) const = 0;
+
+public:
+    explicit CardinalityEstimator(const JoinGraph& graph) : graph(graph) {}
+    virtual ~CardinalityEstimator() = default;
+
+    CardinalityEstimator(const CardinalityEstimator&) = delete;
+    CardinalityEstimator& operator=(const CardinalityEstimator&) = delete;
+
+    // Estimated cardinality of joining the relations in subset
+    double estimate(uint64_t subset) const {
+        auto it = memo.find(subset);
+        if (it != memo.end()) return it->second;
+        // Never estimate below one row, the usual optimizer convention
+        double result = std::max(1.0, estimateSubset(subset));
+        memo.emplace(subset, result);
+        return result;
+    }
+
+    const JoinGraph& joinGraph() const { return graph; }
+};
+
+// Multi-way join cardinality estimation by chaining key sketches.
+//
+// Relations joined on the same equivalence class are chained through one
+// anchor: the result of joining a and b on a key keeps a's key distribution,
+// so each further relation r multiplies it by the sketched fan-out
+// |a ⨝ r| / |a|. The anchor pair is the two most skewed relations (largest
+// self-join size per row), whose join is estimated directly from their
+// sketches. Distinct equivalence classes are combined as independent
+// selectivities, so every subset of the graph gets exactly one estimate.
+class SketchEstimator final : public CardinalityEstimator {
+public:
+    // Sketch of one join column of a relation, built over the rows passing its local filter
+    using SketchLookup =
+        std::function<const JoinKeySketch&(const JoinGraph::Relation& relation, const std::string& column)>;
+
+private:
+    struct ClassMember {
+        int relation;
+        const JoinKeySketch* sketch;
+        double count;
+        double skew;
+    };
+
+    std::vector<double> baseCardinalities;
+    // Members of each equivalence class, most skewed first
+    std::vector<std::vector<ClassMember>> classes;
+    // Pairwise sketch join sizes per class, indexed [class][i * members + j]
+    std::vector<std::vector<double>> pairJoinSizes;
+    double joinSize(size_t cls, size_t i, size_t j) const {
+        return pairJoinSizes[cls][i * classes[cls].size() + j];
+    }
+
+    // Selectivity of one equivalence class restricted to the relations in subset
+    double classSelectivity(size_t cls, uint64_t subset) const {
+        const auto& members = classes[cls];
+        int anchor = -1;
+        int partner = -1;
+        for (size_t i = 0; i < members.size(); i++) {
+            if (!(subset & JoinGraph::bit(members[i].relation))) continue;
+            if (anchor < 0) anchor = static_cast<int>(i);
+            else if (partner < 0) partner = static_cast<int>(i);
+        }
+        if (partner < 0) return 1.0;
+
+        const ClassMember& a = members[anchor];
+        const ClassMember& b = members[partner];
+        if (a.count <= 0 || b.count <= 0) return 0.0;
+
+        double result = joinSize(cls, anchor, partner);
+        double denominator = a.count * b.count;
+        for (size_t i = partner + 1; i < members.size(); i++) {
+            if (!(subset & JoinGraph::bit(members[i].relation))) continue;
+            if (members[i].count <= 0) return 0.0;
+            result *= joinSize(cls, anchor, i) / a.count;
+            denominator *= members[i].count;
+        }
+        return result / denominator;
+    }
+
+public:
+    // baseCardinalities holds the estimated row count of each relation of graph after its local filter
+    SketchEstimator(const JoinGraph& graph, std::vector<double> baseCardinalities, const SketchLookup& sketchFor)
+        : CardinalityEstimator(graph), baseCardinalities(std::move(baseCardinalities)) {
+        for (const auto& cls : graph.equivalenceClasses()) {
+            if (cls.size() < 2) continue;
+
+            std::vector<ClassMember> members;
+            for (const auto& ref : cls) {
+                const JoinKeySketch& sketch = sketchFor(graph.relation(ref.relation), ref.column);
+                double count = sketch.count();
+                double skew = count > 0 ? sketch.estimateJoinSize(sketch) / count : 0;
+                members.push_back({ref.relation, &sketch, count, skew});
+            }
+            std::stable_sort(members.begin(), members.end(),
+                [](const ClassMember& x, const ClassMember& y) { return x.skew > y.skew; });
+
+            size_t k = members.size();
+            std::vector<double> sizes(k * k, 0);
+            for (size_t i = 0; i < k; i++) {
+                for (size_t j = i + 1; j < k; j++) {
+                    sizes[i * k + j] = sizes[j * k + i] = members[i].sketch->estimateJoinSize(*members[j].sketch);
+                }
+            }
+            classes.push_back(std::move(members));
+            pairJoinSizes.push_back(std::move(sizes));
+        }
+    }
+
+protected:
+    double estimateSubset(uint64_t subset) const override {
+        double result = 1.0;
+        for (uint64_t rest = subset; rest; rest &= rest - 1) {
+            result *= std::max(1.0, baseCardinalities[__builtin_ctzll(rest)]);
+        }
+        for (size_t cls = 0; cls < classes.size(); cls++) {
+            result *= classSelectivity(cls, subset);
+        }
+        return result;
+    }
+};
@@ -0,0 +1,262 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <libpq-fe.h>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "binary_io.h"
+#include "join_graph.h"
+
+// On-disk memo of true sub-join cardinalities keyed by (query fingerprint,
+// relation subset). The file is a sorted array of 24-byte entries behind a
+// small header, loaded with mmap and rewritten atomically on save.
+class TrueCardinalityCache {
+private:
+    static constexpr uint32_t FORMAT_VERSION = 1;
+    static constexpr char MAGIC[8] = {'C', 'M', 'P', 'T', 'R', 'U', 'T', 'H'};
+
+    mutable std::mutex mutex;
+    std::map<std::pair<uint64_t, uint64_t>, double> entries;
+    bool modified = false;
+
+public:
+    // FNV-1a over a canonical description of the graph: relations in order with
+    // their filters, then the join predicates. Subset bits refer to that order,
+    // so the fingerprint changes whenever a bitmask would mean something else.
+    static uint64_t fingerprint(const JoinGraph& graph) {
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        auto add = [&](const std::string& text) {
+            for (char c : text) {
+                hash ^= static_cast<unsigned char>(c);
+                hash *= 0x100000001b3ULL;
+            }
+            hash ^= 0xff;
+            hash *= 0x100000001b3ULL;
+        };
+        for (int i = 0; i < graph.size(); i++) {
+            add(graph.relation(i).table);
+            add(graph.relation(i).alias);
+            add(graph.relation(i).filter);
+        }
+        for (const auto& p : graph.joinPredicates()) {
+            add(std::to_string(p.left) + "." + p.leftColumn + "=" + std::to_string(p.right) + "." + p.rightColumn);
+        }
+        return hash;
+    }
+
+    // Returns false when the file does not exist; throws when it is corrupt or from another version
+    bool load(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+
+        struct stat info;
+        if (::fstat(fd, &info) != 0 || info.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        size_t size = static_cast<size_t>(info.st_size);
+        void* data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            throw std::runtime_error("Failed to mmap true cardinality cache " + path);
+        }
+
+        std::map<std::pair<uint64_t, uint64_t>, double> loaded;
+        try {
+            BinaryReader reader(static_cast<const char*>(data), size);
+            char magic[sizeof(MAGIC)];
+            reader.readBytes(magic, sizeof(magic));
+            if (std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) throw std::runtime_error("bad magic");
+            if (reader.read<uint32_t>() != FORMAT_VERSION) throw std::runtime_error("unsupported format version");
+            uint64_t count = reader.read<uint64_t>();
+            for (uint64_t i = 0; i < count; i++) {
+                uint64_t query = reader.read<uint64_t>();
+                uint64_t subset = reader.read<uint64_t>();
+                // Entries are sorted, so each insert is a constant-time append at the end
+                loaded.emplace_hint(loaded.end(), std::make_pair(query, subset), reader.read<double>());
+            }
+            if (!reader.atEnd()) throw std::runtime_error("trailing data");
+        } catch (const std::exception& e) {
+            ::munmap(data, size);
+            throw std::runtime_error("Invalid true cardinality cache " + path + ": " + e.what());
+        }
+        ::munmap(data, size);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        entries = std::move(loaded);
+        modified = false;
+        return true;
+    }
+
+    void save(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::string buffer;
+        BinaryWriter writer(buffer);
+        writer.writeBytes(MAGIC, sizeof(MAGIC));
+        writer.write<uint32_t>(FORMAT_VERSION);
+        writer.write<uint64_t>(entries.size());
+        for (const auto& [key, rows] : entries) {
+            writer.write<uint64_t>(key.first);
+            writer.write<uint64_t>(key.second);
+            writer.write<double>(rows);
+        }
+
+        std::string tmpPath = path + ".tmp";
+        {
+            std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+            if (!file.write(buffer.data(), buffer.size())) {
+                throw std::runtime_error("Failed to write true cardinality cache " + tmpPath);
+            }
+        }
+        if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+            throw std::runtime_error("Failed to replace true cardinality cache " + path);
+        }
+        modified = false;
+    }
+
+    bool find(uint64_t query, uint64_t subset, double& rows) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find({query, subset});
+        if (it == entries.end()) return false;
+        rows = it->second;
+        return true;
+    }
+
+    void insert(uint64_t query, uint64_t subset, double rows) {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries[{query, subset}] = rows;
+        modified = true;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.size();
+    }
+
+    bool isModified() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return modified;
+    }
+};
+
+// Exact cardinalities of the connected sub-joins of a query, counted with
+// COUNT(*) queries spread over a pool of connections and memoized in a
+// TrueCardinalityCache
+class CardinalityOracle {
+private:
+    std::vector<PGconn*> pool;
+    TrueCardinalityCache& cache;
+
+    // SQLSTATE of a statement cancelled by statement_timeout
+    static constexpr const char* QUERY_CANCELED = "57014";
+
+    // Returns false when the count was cancelled by the statement timeout
+    static bool count(PGconn* conn, const std::string& sql, double& rows) {
+        PGresult* res = PQexec(conn, sql.c_str());
+        if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+            const char* state = PQresultErrorField(res, PG_DIAG_SQLSTATE);
+            bool timedOut = state && std::strcmp(state, QUERY_CANCELED) == 0;
+            std::string error = PQerrorMessage(conn);
+            PQclear(res);
+            if (timedOut) return false;
+            throw std::runtime_error("Failed to count '" + sql + "': " + error);
+        }
+        rows = std::stod(PQgetvalue(res, 0, 0));
+        PQclear(res);
+        return true;
+    }
+
+public:
+    // A positive statementTimeoutMs bounds each COUNT(*); counts that time out are left out
+    CardinalityOracle(const std::string& conninfo, int workers, TrueCardinalityCache& cache,
+                      int statementTimeoutMs = 0)
+        : cache(cache) {
+        for (int i = 0; i < std::max(1, workers); i++) {
+            PGconn* conn = PQconnectdb(conninfo.c_str());
+            pool.push_back(conn);
+            if (PQstatus(conn) != CONNECTION_OK) {
+                std::string error = PQerrorMessage(conn);
+                for (PGconn* c : pool) PQfinish(c);
+                throw std::runtime_error("Database connection failed: " + error);
+            }
+            if (statementTimeoutMs > 0) {
+                std::string set = "SET statement_timeout = " + std::to_string(statementTimeoutMs);
+                PQclear(PQexec(conn, set.c_str()));
+            }
+        }
+    }
+
+    ~CardinalityOracle() {
+        for (PGconn* conn : pool) PQfinish(conn);
+    }
+
+    CardinalityOracle(const CardinalityOracle&) = delete;
+    CardinalityOracle& operator=(const CardinalityOracle&) = delete;
+
+    // True cardinality of every connected subset of graph with at most maxRelations
+    // relations (0: all of them), keyed by subset bitmask
+    std::unordered_map<uint64_t, double> trueCardinalities(const JoinGraph& graph, int maxRelations = 0) {
+        uint64_t query = TrueCardinalityCache::fingerprint(graph);
+        std::unordered_map<uint64_t, double> result;
+        std::vector<uint64_t> missing;
+        for (uint64_t subset : graph.connectedSubsets(maxRelations)) {
+            double rows;
+            if (cache.find(query, subset, rows)) result[subset] = rows;
+            else missing.push_back(subset);
+        }
+        if (missing.empty()) return result;
+
+        // Largest subsets first so the slowest counts do not trail at the end
+        std::sort(missing.begin(), missing.end(), [](uint64_t a, uint64_t b) {
+            return __builtin_popcountll(a) > __builtin_popcountll(b);
+        });
+
+        std::vector<double> counts(missing.size(), -1);
+        std::atomic<size_t> next{0};
+        std::mutex errorMutex;
+        std::string error;
+        std::vector<std::thread> threads;
+        for (PGconn* conn : pool) {
+            threads.emplace_back([&, conn]() {
+                for (size_t i = next++; i < missing.size(); i = next++) {
+                    try {
+                        double rows;
+                        if (count(conn, graph.subsetQuery(missing[i], "count(*)"), rows)) counts[i] = rows;
+                    } catch (const std::exception& e) {
+                        std::lock_guard<std::mutex> lock(errorMutex);
+                        if (error.empty()) error = e.what();
+                        next = missing.size();
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        // Keep whatever was counted even when a later count failed
+        for (size_t i = 0; i < missing.size(); i++) {
+            if (counts[i] < 0) continue;
+            cache.insert(query, missing[i], counts[i]);
+            result[missing[i]] = counts[i];
+        }
+        if (!error.empty()) throw std::runtime_error(error);
+        return result;
+    }
+};
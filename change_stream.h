@@ -0,0 +1,312 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <libpq-fe.h>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// One row inserted into or deleted from a table. An UPDATE arrives as the
+// deletion of the old row followed by the insertion of the new one.
+struct RowChange {
+    enum class Kind { Insert, Delete };
+
+    struct Value {
+        std::string column;
+        std::string text;
+        bool isNull = false;
+    };
+
+    Kind kind = Kind::Insert;
+    std::string table;
+    // Only the columns the stream carried: a DELETE without REPLICA IDENTITY FULL
+    // names just the primary key, and unchanged TOAST values are left out
+    std::vector<Value> values;
+    // LSN of the commit record of the transaction the change belongs to
+    uint64_t commitLsn = 0;
+
+    const Value* find(const std::string& column) const {
+        for (const auto& value : values) {
+            if (value.column == column) return &value;
+        }
+        return nullptr;
+    }
+};
+
+// Postgres LSNs are printed as two hex halves, e.g. 16/B374D848
+inline uint64_t parseLsn(const std::string& text) {
+    unsigned int high = 0;
+    unsigned int low = 0;
+    if (std::sscanf(text.c_str(), "%X/%X", &high, &low) != 2) {
+        throw std::runtime_error("Invalid LSN '" + text + "'");
+    }
+    return (static_cast<uint64_t>(high) << 32) | low;
+}
+
+inline std::string formatLsn(uint64_t lsn) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%X/%X", static_cast<unsigned int>(lsn >> 32),
+                  static_cast<unsigned int>(lsn));
+    return buffer;
+}
+
+// Parser for the text output of the test_decoding plugin:
+//   table public.movie_keyword: INSERT: id[integer]:1 movie_id[integer]:2 keyword_id[integer]:3
+//   table public.title: UPDATE: old-key: id[integer]:1 title[text]:'A' new-tuple: id[integer]:1 title[text]:'B'
+//   table public.title: DELETE: id[integer]:1
+//   table public.title, public.movie_info: TRUNCATE: (no-flags)
+class TestDecodingParser {
+private:
+    std::string_view text;
+    size_t pos = 0;
+
+    [[noreturn]] void fail(const std::string& what) const {
+        throw std::runtime_error("test_decoding: " + what + " in '" + std::string(text) + "'");
+    }
+
+    bool startsWith(std::string_view prefix) const {
+        return text.substr(pos, prefix.size()) == prefix;
+    }
+
+    bool accept(std::string_view prefix) {
+        if (!startsWith(prefix)) return false;
+        pos += prefix.size();
+        return true;
+    }
+
+    void skipSpaces() {
+        while (pos < text.size() && text[pos] == ' ') pos++;
+    }
+
+    // Identifier, double-quoted when Postgres needed to quote it
+    std::string name(std::string_view terminators) {
+        std::string result;
+        if (pos < text.size() && text[pos] == '"') {
+            for (pos++; pos < text.size(); pos++) {
+                if (text[pos] == '"') {
+                    if (pos + 1 < text.size() && text[pos + 1] == '"') pos++;
+                    else break;
+                }
+                result += text[pos];
+            }
+            if (pos++ >= text.size()) fail("unterminated identifier");
+            return result;
+        }
+        while (pos < text.size() && terminators.find(text[pos]) == std::string_view::npos) {
+            result += text[pos++];
+        }
+        return result;
+    }
+
+    // name[type]:value pairs up to the end or the next section keyword
+    void values(std::vector<RowChange::Value>& out) {
+        while (true) {
+            skipSpaces();
+            if (pos >= text.size() || startsWith("new-tuple:") || startsWith("old-key:")) return;
+            if (accept("(no-tuple-data)")) continue;
+            RowChange::Value value;
+            value.column = name("[");
+            if (!accept("[")) fail("expected '[' after column " + value.column);
+            // Types may contain brackets themselves, e.g. integer[]
+            for (int depth = 1; depth > 0; pos++) {
+                if (pos >= text.size()) fail("unterminated type of column " + value.column);
+                if (text[pos] == '[') depth++;
+                else if (text[pos] == ']') depth--;
+            }
+            if (!accept(":")) fail("expected ':' after type of column " + value.column);
+            if (accept("unchanged-toast-datum")) continue;
+            if (pos < text.size() && text[pos] == '\'') {
+                for (pos++; pos < text.size(); pos++) {
+                    if (text[pos] == '\'') {
+                        if (pos + 1 < text.size() && text[pos + 1] == '\'') pos++;
+                        else break;
+                    }
+                    value.text += text[pos];
+                }
+                if (pos++ >= text.size()) fail("unterminated value of column " + value.column);
+            } else {
+                size_t end = text.find(' ', pos);
+                if (end == std::string_view::npos) end = text.size();
+                value.text = std::string(text.substr(pos, end - pos));
+                pos = end;
+                value.isNull = value.text == "null";
+                if (value.isNull) value.text.clear();
+            }
+            out.push_back(std::move(value));
+        }
+    }
+
+    // Schema-qualified name, of which only the table is kept
+    std::string table() {
+        std::string result = name(".:,");
+        if (accept(".")) result = name(":,");
+        return result;
+    }
+
+public:
+    // Appends the changes described by one line to out; BEGIN and COMMIT lines add
+    // nothing. Tables whose changes cannot be replayed from the stream are appended to
+    // lost: an UPDATE without its old row (no REPLICA IDENTITY FULL) only yields the
+    // insertion, and a TRUNCATE, which may list several tables, removes rows the
+    // stream never lists.
+    static void parse(std::string_view line, std::vector<RowChange>& out, std::vector<std::string>& lost) {
+        TestDecodingParser parser;
+        parser.text = line;
+        if (!parser.accept("table ")) return;
+
+        std::vector<std::string> tables{parser.table()};
+        while (parser.accept(", ")) tables.push_back(parser.table());
+        if (!parser.accept(": ")) parser.fail("expected ':' after table name");
+        if (parser.accept("TRUNCATE:")) {
+            lost.insert(lost.end(), tables.begin(), tables.end());
+            return;
+        }
+        if (tables.size() > 1) parser.fail("several tables outside TRUNCATE");
+
+        RowChange change;
+        change.table = tables[0];
+        if (parser.accept("INSERT:")) {
+            parser.values(change.values);
+        } else if (parser.accept("DELETE:")) {
+            change.kind = RowChange::Kind::Delete;
+            parser.values(change.values);
+        } else if (parser.accept("UPDATE:")) {
+            parser.skipSpaces();
+            if (!parser.accept("old-key:")) {
+                parser.values(change.values);
+                out.push_back(std::move(change));
+                lost.push_back(tables[0]);
+                return;
+            }
+            RowChange removed = change;
+            removed.kind = RowChange::Kind::Delete;
+            parser.values(removed.values);
+            parser.skipSpaces();
+            if (!parser.accept("new-tuple:")) parser.fail("expected new-tuple after old-key");
+            parser.values(change.values);
+            out.push_back(std::move(removed));
+        } else {
+            parser.fail("unknown change");
+        }
+        out.push_back(std::move(change));
+    }
+};
+
+// Consumer of a logical replication slot using the test_decoding plugin. Each
+// consume() call takes the changes committed since the last one, transaction
+// by transaction, and advances the slot past them.
+class ChangeStream {
+private:
+    PGconn* conn = nullptr;
+    std::string slot;
+    uint64_t slotLsn = 0;
+    bool created = false;
+
+    PGresult* query(const std::string& sql, const std::vector<std::string>& params) {
+        std::vector<const char*> values;
+        for (const auto& param : params) values.push_back(param.c_str());
+        PGresult* res = PQexecParams(conn, sql.c_str(), static_cast<int>(values.size()), nullptr,
+                                     values.data(), nullptr, nullptr, 0);
+        if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+            std::string error = PQerrorMessage(conn);
+            PQclear(res);
+            throw std::runtime_error("Change stream query failed: " + error);
+        }
+        return res;
+    }
+
+public:
+    // Attaches to slot, creating it when it does not exist yet
+    ChangeStream(const std::string& conninfo, std::string slotName) : slot(std::move(slotName)) {
+        conn = PQconnectdb(conninfo.c_str());
+        if (PQstatus(conn) != CONNECTION_OK) {
+            std::string error = PQerrorMessage(conn);
+            PQfinish(conn);
+            throw std::runtime_error("Database connection failed: " + error);
+        }
+        try {
+            PGresult* res = query("SELECT plugin, confirmed_flush_lsn FROM pg_replication_slots "
+                                  "WHERE slot_name = $1;", {slot});
+            if (PQntuples(res) > 0) {
+                std::string plugin = PQgetvalue(res, 0, 0);
+                std::string lsn = PQgetvalue(res, 0, 1);
+                PQclear(res);
+                if (plugin != "test_decoding") {
+                    throw std::runtime_error("Replication slot " + slot + " uses " + plugin +
+                                             ", not test_decoding");
+                }
+                slotLsn = parseLsn(lsn);
+            } else {
+                PQclear(res);
+                res = query("SELECT lsn FROM pg_create_logical_replication_slot($1, 'test_decoding');", {slot});
+                slotLsn = parseLsn(PQgetvalue(res, 0, 0));
+                PQclear(res);
+                created = true;
+            }
+        } catch (...) {
+            PQfinish(conn);
+            throw;
+        }
+    }
+
+    ~ChangeStream() {
+        PQfinish(conn);
+    }
+
+    ChangeStream(const ChangeStream&) = delete;
+    ChangeStream& operator=(const ChangeStream&) = delete;
+
+    // Position the slot had when attaching: every change committed after it is still to come
+    uint64_t startLsn() const { return slotLsn; }
+
+    PGconn* connection() const { return conn; }
+
+    // True when the slot did not exist before, so no earlier change was ever seen
+    bool newlyCreated() const { return created; }
+
+    // Hands every change of each committed transaction to apply, reading at most
+    // about batchSize changes per round trip, until the slot is drained. onLostTable
+    // is called first with each table of the transaction that parse() could not replay.
+    // Returns the commit LSN of the last transaction, or startLsn() when there was none.
+    uint64_t consume(const std::function<void(const RowChange&)>& apply,
+                     const std::function<void(const std::string&)>& onLostTable, int batchSize = 100000) {
+        std::vector<RowChange> transaction;
+        std::vector<std::string> incomplete;
+        std::string limit = std::to_string(batchSize);
+        while (true) {
+            // Consumed changes are gone from the slot, whole transactions at a time
+            PGresult* res = query("SELECT lsn, data FROM pg_logical_slot_get_changes($1, NULL, $2::int, "
+                                  "'skip-empty-xacts', '1', 'include-xids', '0');", {slot, limit});
+            int rows = PQntuples(res);
+            try {
+                for (int i = 0; i < rows; i++) {
+                    std::string_view data = PQgetvalue(res, i, 1);
+                    if (data == "BEGIN") {
+                        transaction.clear();
+                        incomplete.clear();
+                    } else if (data.substr(0, 6) == "COMMIT") {
+                        uint64_t commitLsn = parseLsn(PQgetvalue(res, i, 0));
+                        for (const auto& table : incomplete) onLostTable(table);
+                        for (auto& change : transaction) {
+                            change.commitLsn = commitLsn;
+                            apply(change);
+                        }
+                        transaction.clear();
+                        incomplete.clear();
+                        slotLsn = commitLsn;
+                    } else {
+                        TestDecodingParser::parse(data, transaction, incomplete);
+                    }
+                }
+            } catch (...) {
+                PQclear(res);
+                throw;
+            }
+            PQclear(res);
+            if (rows == 0) return slotLsn;
+        }
+    }
+};
@@ -0,0 +1,395 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "column_store.h"
+#include "sql_parser.h"
+
+// A relation's local filter (the SQL conjunction kept in JoinGraph::Relation)
+// compiled against ColumnStore columns and evaluated row by row. Covers the
+// predicate forms of JOB filters: comparisons with a literal, [NOT] BETWEEN,
+// [NOT] IN lists, [NOT] [I]LIKE, IS [NOT] NULL and AND/OR/NOT over them, with
+// SQL three-valued logic. Anything else throws. Text is compared bytewise,
+// like Postgres under the C collation.
+class ColumnFilter {
+private:
+    using Node = ParsedQuery::PredicateNode;
+    using Token = SqlLexer::Token;
+    using TokenType = SqlLexer::TokenType;
+
+    enum class Truth : uint8_t { False, True, Unknown };
+
+    struct Literal {
+        bool isNull = false;
+        bool isNumber = false;
+        int64_t number = 0;
+        std::string text;
+    };
+
+    struct Condition {
+        Node::Type type = Node::Type::Other;
+        bool negated = false;
+        std::string op;
+        const MappedColumn* column = nullptr;
+        std::vector<Literal> values;
+        std::vector<int> children;
+    };
+
+    std::string description;
+    std::vector<Condition> conditions;
+    int root = -1;
+
+    [[noreturn]] void unsupported(std::string_view text) const {
+        throw std::runtime_error("Column store cannot evaluate '" + std::string(text) + "' in filter of " +
+                                 description);
+    }
+
+    static std::string unescape(std::string_view quoted) {
+        std::string text;
+        for (size_t i = 1; i + 1 < quoted.size(); i++) {
+            text += quoted[i];
+            if (quoted[i] == '\'') i++;
+        }
+        return text;
+    }
+
+    // Reverses an operator so "literal op column" can be evaluated as "column op literal"
+    static std::string mirror(const std::string& op) {
+        if (op == "<") return ">";
+        if (op == ">") return "<";
+        if (op == "<=") return ">=";
+        if (op == ">=") return "<=";
+        return op;
+    }
+
+    // Cursor over the tokens of one leaf predicate
+    struct LeafParser {
+        const ColumnFilter& filter;
+        std::string_view text;
+        std::vector<Token> tokens;
+        size_t pos = 0;
+
+        LeafParser(const ColumnFilter& filter, std::string_view text) : filter(filter), text(text) {
+            SqlLexer lexer(text);
+            for (Token token = lexer.next(); token.type != TokenType::End; token = lexer.next()) {
+                tokens.push_back(token);
+            }
+            // A parenthesised leaf keeps its parentheses in the node text
+            while (tokens.size() >= 2 && tokens.front().isSymbol("(") && closes(tokens.size() - 1)) {
+                tokens.pop_back();
+                tokens.erase(tokens.begin());
+            }
+        }
+
+        // Whether tokens[last] is the parenthesis matching tokens[0]
+        bool closes(size_t last) const {
+            int depth = 0;
+            for (size_t i = 0; i <= last; i++) {
+                if (tokens[i].isSymbol("(")) depth++;
+                else if (tokens[i].isSymbol(")")) depth--;
+                if (depth == 0) return i == last;
+            }
+            return false;
+        }
+
+        const Token& peek() const {
+            static const Token end;
+            return pos < tokens.size() ? tokens[pos] : end;
+        }
+
+        bool accept(std::string_view keyword) {
+            if (!peek().is(keyword)) return false;
+            pos++;
+            return true;
+        }
+
+        bool acceptSymbol(std::string_view symbol) {
+            if (!peek().isSymbol(symbol)) return false;
+            pos++;
+            return true;
+        }
+
+        void expect(bool ok) const {
+            if (!ok) filter.unsupported(text);
+        }
+
+        bool atColumn() const {
+            return peek().type == TokenType::Identifier && !peek().is("NULL") &&
+                   pos + 1 < tokens.size() && tokens[pos + 1].isSymbol(".");
+        }
+
+        // alias.column; the alias is the filtered relation, so only the column name matters
+        std::string column() {
+            expect(atColumn());
+            pos += 2;
+            expect(peek().type == TokenType::Identifier || peek().type == TokenType::QuotedIdentifier);
+            std::string_view name = tokens[pos++].text;
+            if (name.front() == '"') name = name.substr(1, name.size() - 2);
+            return std::string(name);
+        }
+
+        Literal literal() {
+            Literal value;
+            if (accept("NULL")) {
+                value.isNull = true;
+                return value;
+            }
+            bool negative = acceptSymbol("-");
+            if (!negative) acceptSymbol("+");
+            const Token& token = peek();
+            if (token.type == TokenType::String && !negative) {
+                value.text = unescape(token.text);
+            } else if (token.type == TokenType::Number) {
+                value.text = (negative ? "-" : "") + std::string(token.text);
+                auto [ptr, ec] = std::from_chars(value.text.data(), value.text.data() + value.text.size(),
+                                                 value.number);
+                value.isNumber = ec == std::errc() && ptr == value.text.data() + value.text.size();
+            } else {
+                filter.unsupported(text);
+            }
+            pos++;
+            return value;
+        }
+
+        void end() const {
+            expect(pos == tokens.size());
+        }
+    };
+
+    int compile(const ParsedQuery& query, int node, const ColumnStore& store, const std::string& table) {
+        const Node& n = query.nodes[node];
+        Condition condition;
+        condition.type = n.type;
+        condition.negated = n.negated;
+
+        if (n.type == Node::Type::And || n.type == Node::Type::Or || n.type == Node::Type::Not) {
+            for (int child = n.firstChild; child >= 0; child = query.nodes[child].nextSibling) {
+                condition.children.push_back(compile(query, child, store, table));
+            }
+            conditions.push_back(std::move(condition));
+            return static_cast<int>(conditions.size()) - 1;
+        }
+
+        LeafParser leaf(*this, n.text);
+        switch (n.type) {
+        case Node::Type::Comparison: {
+            bool columnFirst = leaf.atColumn();
+            std::string column;
+            Literal value;
+            if (columnFirst) column = leaf.column();
+            else value = leaf.literal();
+            leaf.expect(leaf.peek().type == TokenType::Operator);
+            condition.op = std::string(leaf.tokens[leaf.pos++].text);
+            if (columnFirst) value = leaf.literal();
+            else column = leaf.column();
+            if (condition.op == "!=") condition.op = "<>";
+            if (!columnFirst) condition.op = mirror(condition.op);
+            if (condition.op != "=" && condition.op != "<>" && condition.op != "<" && condition.op != ">" &&
+                condition.op != "<=" && condition.op != ">=") {
+                unsupported(n.text);
+            }
+            condition.column = &store.column(table, column);
+            condition.values.push_back(std::move(value));
+            break;
+        }
+        case Node::Type::Between: {
+            condition.column = &store.column(table, leaf.column());
+            leaf.accept("NOT");
+            leaf.expect(leaf.accept("BETWEEN"));
+            condition.values.push_back(leaf.literal());
+            leaf.expect(leaf.accept("AND"));
+            condition.values.push_back(leaf.literal());
+            break;
+        }
+        case Node::Type::In: {
+            condition.column = &store.column(table, leaf.column());
+            leaf.accept("NOT");
+            leaf.expect(leaf.accept("IN") && leaf.acceptSymbol("("));
+            do {
+                condition.values.push_back(leaf.literal());
+            } while (leaf.acceptSymbol(","));
+            leaf.expect(leaf.acceptSymbol(")"));
+            break;
+        }
+        case Node::Type::Like: {
+            condition.column = &store.column(table, leaf.column());
+            leaf.accept("NOT");
+            leaf.expect(leaf.accept("LIKE") || leaf.accept("ILIKE"));
+            condition.op = leaf.tokens[leaf.pos - 1].is("ILIKE") ? "ILIKE" : "LIKE";
+            condition.values.push_back(leaf.literal());
+            break;
+        }
+        case Node::Type::IsNull: {
+            condition.column = &store.column(table, leaf.column());
+            leaf.expect(leaf.accept("IS"));
+            leaf.accept("NOT");
+            leaf.expect(leaf.accept("NULL"));
+            break;
+        }
+        default:
+            unsupported(n.text);
+        }
+        leaf.end();
+
+        // Integer columns compare numerically and only against integer literals
+        if (condition.column->columnType() == ColumnType::Integer) {
+            if (condition.type == Node::Type::Like) unsupported(n.text);
+            for (const auto& value : condition.values) {
+                if (!value.isNull && !value.isNumber) unsupported(n.text);
+            }
+        }
+        conditions.push_back(std::move(condition));
+        return static_cast<int>(conditions.size()) - 1;
+    }
+
+    static size_t utf8Length(unsigned char c) {
+        if (c < 0x80) return 1;
+        if ((c >> 5) == 0x6) return 2;
+        if ((c >> 4) == 0xe) return 3;
+        if ((c >> 3) == 0x1e) return 4;
+        return 1;
+    }
+
+    static bool sameChar(char a, char b, bool foldCase) {
+        if (!foldCase) return a == b;
+        return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+    }
+
+    // LIKE with % and _ and backslash escapes; _ matches one UTF-8 character.
+    // Backtracks to the last % on a mismatch, so it runs in linear time for the
+    // usual '%word%' patterns.
+    static bool like(std::string_view text, std::string_view pattern, bool foldCase) {
+        size_t t = 0;
+        size_t p = 0;
+        size_t starPattern = std::string_view::npos;
+        size_t starText = 0;
+        while (t < text.size()) {
+            if (p < pattern.size() && pattern[p] == '%') {
+                starPattern = ++p;
+                starText = t;
+                continue;
+            }
+            if (p < pattern.size() && pattern[p] == '_') {
+                t = std::min(text.size(), t + utf8Length(text[t]));
+                p++;
+                continue;
+            }
+            if (p < pattern.size()) {
+                size_t q = pattern[p] == '\\' && p + 1 < pattern.size() ? p + 1 : p;
+                if (sameChar(pattern[q], text[t], foldCase)) {
+                    t++;
+                    p = q + 1;
+                    continue;
+                }
+            }
+            if (starPattern == std::string_view::npos) return false;
+            starText = std::min(text.size(), starText + utf8Length(text[starText]));
+            t = starText;
+            p = starPattern;
+        }
+        while (p < pattern.size() && pattern[p] == '%') p++;
+        return p == pattern.size();
+    }
+
+    // Three-way comparison of a non-NULL row value with a non-NULL literal
+    static int compare(const MappedColumn& column, uint64_t row, const Literal& value) {
+        if (column.columnType() == ColumnType::Integer) {
+            int64_t v = column.integer(row);
+            return v < value.number ? -1 : v > value.number ? 1 : 0;
+        }
+        return column.text(row).compare(value.text);
+    }
+
+    static Truth negate(Truth truth, bool negated) {
+        if (!negated || truth == Truth::Unknown) return truth;
+        return truth == Truth::True ? Truth::False : Truth::True;
+    }
+
+    static Truth truth(bool value) {
+        return value ? Truth::True : Truth::False;
+    }
+
+    Truth evaluate(int index, uint64_t row) const {
+        const Condition& c = conditions[index];
+        switch (c.type) {
+        case Node::Type::And: {
+            Truth result = Truth::True;
+            for (int child : c.children) {
+                Truth t = evaluate(child, row);
+                if (t == Truth::False) return Truth::False;
+                if (t == Truth::Unknown) result = Truth::Unknown;
+            }
+            return result;
+        }
+        case Node::Type::Or: {
+            Truth result = Truth::False;
+            for (int child : c.children) {
+                Truth t = evaluate(child, row);
+                if (t == Truth::True) return Truth::True;
+                if (t == Truth::Unknown) result = Truth::Unknown;
+            }
+            return result;
+        }
+        case Node::Type::Not:
+            return negate(evaluate(c.children[0], row), true);
+        case Node::Type::IsNull:
+            return truth(c.column->isNull(row) != c.negated);
+        default:
+            break;
+        }
+
+        if (c.column->isNull(row)) return Truth::Unknown;
+        switch (c.type) {
+        case Node::Type::Comparison: {
+            if (c.values[0].isNull) return Truth::Unknown;
+            int cmp = compare(*c.column, row, c.values[0]);
+            if (c.op == "=") return truth(cmp == 0);
+            if (c.op == "<>") return truth(cmp != 0);
+            if (c.op == "<") return truth(cmp < 0);
+            if (c.op == ">") return truth(cmp > 0);
+            if (c.op == "<=") return truth(cmp <= 0);
+            return truth(cmp >= 0);
+        }
+        case Node::Type::Between: {
+            if (c.values[0].isNull || c.values[1].isNull) return Truth::Unknown;
+            return negate(truth(compare(*c.column, row, c.values[0]) >= 0 &&
+                                compare(*c.column, row, c.values[1]) <= 0), c.negated);
+        }
+        case Node::Type::In: {
+            Truth result = Truth::False;
+            for (const auto& value : c.values) {
+                if (value.isNull) result = Truth::Unknown;
+                else if (compare(*c.column, row, value) == 0) return negate(Truth::True, c.negated);
+            }
+            return negate(result, c.negated);
+        }
+        case Node::Type::Like:
+            return negate(truth(like(c.column->text(row), c.values[0].text, c.op == "ILIKE")), c.negated);
+        default:
+            return Truth::Unknown;
+        }
+    }
+
+public:
+    // filter is SQL over alias, as produced by JoinGraph::addFilter; an empty filter selects every row
+    ColumnFilter(const ColumnStore& store, const std::string& table, const std::string& alias,
+                 const std::string& filter)
+        : description(table + " AS " + alias) {
+        if (filter.empty()) return;
+        std::string sql = "SELECT 1 FROM " + table + " AS " + alias + " WHERE " + filter;
+        ParsedQuery query = SqlParser::parseQuery(sql);
+        if (query.whereRoot < 0 || !query.otherPredicates.empty() || !query.joins.empty()) unsupported(filter);
+        root = compile(query, query.whereRoot, store, table);
+    }
+
+    bool matches(uint64_t row) const {
+        return root < 0 || evaluate(root, row) == Truth::True;
+    }
+};
@@ -0,0 +1,331 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "sql_parser.h"
+
+// Offline column store for the IMDB tables: one directory per table and one
+// file per column, written once by imdb_loader and read through mmap.
+//
+// <column>.col starts with a 24-byte header (magic, version, type, rows).
+// Integer columns follow with rows int32 values, NULL stored as INT32_MIN.
+// Text columns follow with rows + 1 uint64 offsets into <column>.dat; the top
+// bit of offsets[i + 1] marks row i as NULL.
+enum class ColumnType : uint32_t { Integer = 0, Text = 1 };
+
+struct ColumnSchema {
+    std::string name;
+    ColumnType type;
+};
+
+struct TableSchema {
+    std::string name;
+    std::vector<ColumnSchema> columns;
+
+    // Reads the CREATE TABLE statements of a DDL script such as job/schema.sql.
+    // integer columns are stored as Integer, every other type as Text.
+    static std::vector<TableSchema> parse(std::string_view ddl) {
+        using TokenType = SqlLexer::TokenType;
+        SqlLexer lexer(ddl);
+        std::vector<TableSchema> tables;
+        SqlLexer::Token token = lexer.next();
+        while (token.type != TokenType::End) {
+            if (!token.is("CREATE") || !(token = lexer.next()).is("TABLE")) {
+                token = lexer.next();
+                continue;
+            }
+            TableSchema table;
+            table.name = std::string(lexer.next().text);
+            if (!lexer.next().isSymbol("(")) throw std::runtime_error("Schema: expected '(' after " + table.name);
+
+            // Each column definition is "name type ..." up to a comma at depth one
+            int depth = 1;
+            bool atStart = true;
+            while (depth > 0) {
+                token = lexer.next();
+                if (token.type == TokenType::End) throw std::runtime_error("Schema: unterminated table " + table.name);
+                if (token.isSymbol("(")) {
+                    depth++;
+                } else if (token.isSymbol(")")) {
+                    depth--;
+                } else if (depth == 1 && token.isSymbol(",")) {
+                    atStart = true;
+                } else if (depth == 1 && atStart) {
+                    atStart = false;
+                    // Table constraints such as PRIMARY KEY (id) are not columns
+                    if (token.is("PRIMARY") || token.is("FOREIGN") || token.is("UNIQUE") || token.is("CONSTRAINT")) {
+                        continue;
+                    }
+                    SqlLexer::Token type = lexer.next();
+                    bool integer = type.is("INTEGER") || type.is("INT") || type.is("INT4") || type.is("SMALLINT");
+                    table.columns.push_back({std::string(token.text), integer ? ColumnType::Integer : ColumnType::Text});
+                }
+            }
+            tables.push_back(std::move(table));
+            token = lexer.next();
+        }
+        return tables;
+    }
+};
+
+namespace column_format {
+    static constexpr char MAGIC[8] = {'C', 'M', 'P', 'S', 'C', 'O', 'L', '1'};
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint64_t TEXT_NULL = uint64_t(1) << 63;
+    static constexpr int32_t INTEGER_NULL = INT32_MIN;
+    static constexpr size_t HEADER_SIZE = sizeof(MAGIC) + 2 * sizeof(uint32_t) + sizeof(uint64_t);
+}
+
+// Streams the values of one column to disk; the row count in the header is
+// written by finish()
+class ColumnWriter {
+private:
+    static const size_t BUFFER_SIZE = 1 << 20;
+
+    struct BufferedFile {
+        std::ofstream file;
+        std::string buffer;
+
+        void open(const std::string& path) {
+            file.open(path, std::ios::binary | std::ios::trunc);
+            if (!file.is_open()) throw std::runtime_error("Could not create " + path);
+            buffer.reserve(BUFFER_SIZE);
+        }
+
+        void append(const void* data, size_t size) {
+            if (buffer.size() + size > BUFFER_SIZE) flush();
+            if (size > BUFFER_SIZE) {
+                file.write(static_cast<const char*>(data), size);
+                return;
+            }
+            buffer.append(static_cast<const char*>(data), size);
+        }
+
+        void flush() {
+            file.write(buffer.data(), buffer.size());
+            buffer.clear();
+        }
+    };
+
+    ColumnType type;
+    std::string path;
+    BufferedFile values;
+    BufferedFile bytes;
+    uint64_t rows = 0;
+    uint64_t byteCount = 0;
+
+    void writeHeader() {
+        values.append(column_format::MAGIC, sizeof(column_format::MAGIC));
+        uint32_t version = column_format::VERSION;
+        uint32_t typeId = static_cast<uint32_t>(type);
+        values.append(&version, sizeof(version));
+        values.append(&typeId, sizeof(typeId));
+        values.append(&rows, sizeof(rows));
+    }
+
+public:
+    // basePath is the column path without extension
+    ColumnWriter(const std::string& basePath, ColumnType type) : type(type), path(basePath + ".col") {
+        values.open(path);
+        writeHeader();
+        if (type == ColumnType::Text) {
+            bytes.open(basePath + ".dat");
+            values.append(&byteCount, sizeof(byteCount));
+        }
+    }
+
+    ColumnType columnType() const { return type; }
+
+    void appendInteger(int32_t value) {
+        values.append(&value, sizeof(value));
+        rows++;
+    }
+
+    void appendText(std::string_view value) {
+        bytes.append(value.data(), value.size());
+        byteCount += value.size();
+        values.append(&byteCount, sizeof(byteCount));
+        rows++;
+    }
+
+    void appendNull() {
+        if (type == ColumnType::Integer) {
+            appendInteger(column_format::INTEGER_NULL);
+            return;
+        }
+        uint64_t offset = byteCount | column_format::TEXT_NULL;
+        values.append(&offset, sizeof(offset));
+        rows++;
+    }
+
+    void finish() {
+        values.flush();
+        values.file.seekp(sizeof(column_format::MAGIC) + 2 * sizeof(uint32_t));
+        values.file.write(reinterpret_cast<const char*>(&rows), sizeof(rows));
+        values.file.close();
+        if (type == ColumnType::Text) {
+            bytes.flush();
+            bytes.file.close();
+        }
+        if (!values.file || (type == ColumnType::Text && !bytes.file)) {
+            throw std::runtime_error("Failed to write " + path);
+        }
+    }
+};
+
+// Read-only mapping of a whole file
+class MappedFile {
+private:
+    void* data = nullptr;
+    size_t length = 0;
+
+public:
+    explicit MappedFile(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("Could not open " + path);
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Could not stat " + path);
+        }
+        length = static_cast<size_t>(info.st_size);
+        if (length > 0) {
+            data = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            data = nullptr;
+            throw std::runtime_error("Failed to mmap " + path);
+        }
+    }
+
+    ~MappedFile() {
+        if (data) ::munmap(data, length);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* bytes() const { return static_cast<const char*>(data); }
+    size_t size() const { return length; }
+};
+
+class MappedColumn {
+private:
+    std::unique_ptr<MappedFile> values;
+    std::unique_ptr<MappedFile> bytes;
+    ColumnType type = ColumnType::Integer;
+    uint64_t rowCount = 0;
+    const int32_t* integers = nullptr;
+    const uint64_t* offsets = nullptr;
+
+public:
+    explicit MappedColumn(const std::string& basePath) {
+        std::string path = basePath + ".col";
+        values = std::make_unique<MappedFile>(path);
+        if (values->size() < column_format::HEADER_SIZE ||
+            std::memcmp(values->bytes(), column_format::MAGIC, sizeof(column_format::MAGIC)) != 0) {
+            throw std::runtime_error("Not a column file: " + path);
+        }
+        uint32_t version;
+        uint32_t typeId;
+        const char* header = values->bytes() + sizeof(column_format::MAGIC);
+        std::memcpy(&version, header, sizeof(version));
+        std::memcpy(&typeId, header + sizeof(version), sizeof(typeId));
+        std::memcpy(&rowCount, header + 2 * sizeof(uint32_t), sizeof(rowCount));
+        if (version != column_format::VERSION) throw std::runtime_error("Unsupported column file version: " + path);
+        type = static_cast<ColumnType>(typeId);
+
+        const char* body = values->bytes() + column_format::HEADER_SIZE;
+        size_t bodySize = values->size() - column_format::HEADER_SIZE;
+        if (type == ColumnType::Integer) {
+            if (bodySize != rowCount * sizeof(int32_t)) throw std::runtime_error("Truncated column file: " + path);
+            integers = reinterpret_cast<const int32_t*>(body);
+        } else {
+            if (bodySize != (rowCount + 1) * sizeof(uint64_t)) throw std::runtime_error("Truncated column file: " + path);
+            offsets = reinterpret_cast<const uint64_t*>(body);
+            bytes = std::make_unique<MappedFile>(basePath + ".dat");
+            if (bytes->size() != (offsets[rowCount] & ~column_format::TEXT_NULL)) {
+                throw std::runtime_error("Truncated column data: " + basePath + ".dat");
+            }
+        }
+    }
+
+    ColumnType columnType() const { return type; }
+    uint64_t rows() const { return rowCount; }
+
+    bool isNull(uint64_t row) const {
+        if (type == ColumnType::Integer) return integers[row] == column_format::INTEGER_NULL;
+        return (offsets[row + 1] & column_format::TEXT_NULL) != 0;
+    }
+
+    int32_t integer(uint64_t row) const { return integers[row]; }
+
+    // Contiguous values of an Integer column, for tight scans
+    const int32_t* integerData() const { return integers; }
+
+    std::string_view text(uint64_t row) const {
+        uint64_t begin = offsets[row] & ~column_format::TEXT_NULL;
+        uint64_t end = offsets[row + 1] & ~column_format::TEXT_NULL;
+        return std::string_view(bytes->bytes() + begin, end - begin);
+    }
+};
+
+// Directory of tables written by imdb_loader; columns are mapped on first use
+// and stay mapped for the lifetime of the store. Thread-safe.
+class ColumnStore {
+private:
+    std::filesystem::path directory;
+    mutable std::mutex mutex;
+    mutable std::unordered_map<std::string, std::unique_ptr<MappedColumn>> columns;
+
+public:
+    explicit ColumnStore(const std::string& directory) : directory(directory) {
+        if (!std::filesystem::is_directory(this->directory)) {
+            throw std::runtime_error("Column store " + directory + " is not a directory");
+        }
+    }
+
+    bool hasColumn(const std::string& table, const std::string& column) const {
+        return std::filesystem::exists(directory / table / (column + ".col"));
+    }
+
+    const MappedColumn& column(const std::string& table, const std::string& column) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto& slot = columns[table + "." + column];
+        if (!slot) {
+            if (!hasColumn(table, column)) {
+                throw std::runtime_error("Column store has no column " + table + "." + column);
+            }
+            slot = std::make_unique<MappedColumn>((directory / table / column).string());
+        }
+        return *slot;
+    }
+
+    // Row count of a table, read from any of its columns
+    uint64_t rows(const std::string& table) const {
+        std::filesystem::path tableDirectory = directory / table;
+        if (std::filesystem::is_directory(tableDirectory)) {
+            for (const auto& entry : std::filesystem::directory_iterator(tableDirectory)) {
+                if (entry.path().extension() == ".col") {
+                    return column(table, entry.path().stem().string()).rows();
+                }
+            }
+        }
+        throw std::runtime_error("Column store has no table " + table);
+    }
+};
@@ -1,105 +1,120 @@
+import argparse
+import json
+import os
+
 import matplotlib.pyplot as plt
 import numpy as np
 import pandas as pd
 import seaborn as sns
-from typing import List, Dict, Tuple
+from typing import Dict, List, Optional
+
+
+def join_bucket(join_predicates: int) -> int:
+    # Mismos grupos que main.cpp (qerror.h): hasta 9, de 10 a 19 y 20 o más predicados de join
+    return 0 if join_predicates < 10 else 1 if join_predicates < 20 else 2
+
 
 class ComprehensiveJOBAnalysis:
-    def __init__(self):
-        # Datos basados en el paper
-        self.total_queries = 113
-        
-        # Winning queries (Figure 7)
+    def __init__(self, results_path: str = 'compass_results.csv', qerror_path: Optional[str] = 'qerror.json',
+                 plan_quality_path: Optional[str] = 'plan_quality.json'):
+        # Resultados medidos por `./main --execute --qerror qerror job`
+        results = pd.read_csv(results_path)
+        if 'compass_ms' not in results.columns:
+            raise ValueError(f'{results_path} no tiene tiempos de ejecución; ejecute ./main --execute ...')
+        self.results = results
+
+        self.total_queries = len(results)
+
+        # Winning queries: el plan con menor tiempo de ejecución gana
+        compass_wins = results['compass_ms'] < results['postgres_ms']
+        postgres_wins = results['postgres_ms'] < results['compass_ms']
         self.winning_queries = {
-            'COMPASS': 63,
-            'PostgreSQL': 39
+            'COMPASS': int(compass_wins.sum()),
+            'PostgreSQL': int(postgres_wins.sum())
         }
-        
-        # Distribución por número de joins
-        self.join_distribution = {
-            '4-9': {
-                'COMPASS': 17,
-                'PostgreSQL': 13,
-                'total_queries': 37
-            },
-            '10-19': {
-                'COMPASS': 33,
-                'PostgreSQL': 19,
-                'total_queries': 52
-            },
-            '20-28': {
-                'COMPASS': 13,
-                'PostgreSQL': 7,
-                'total_queries': 24
+
+        # Distribución por número de joins, con los rangos observados como etiquetas
+        results = results.assign(bucket=results['join_predicates'].map(join_bucket))
+        self.join_groups: List[str] = []
+        self.join_distribution: Dict[str, Dict[str, int]] = {}
+        self.performance_metrics: Dict[str, Dict[str, Dict[str, float]]] = {}
+        for _, group in results.groupby('bucket'):
+            label = f"{group['join_predicates'].min()}-{group['join_predicates'].max()}"
+            self.join_groups.append(label)
+            self.join_distribution[label] = {
+                'COMPASS': int((group['compass_ms'] < group['postgres_ms']).sum()),
+                'PostgreSQL': int((group['postgres_ms'] < group['compass_ms']).sum()),
+                'total_queries': len(group)
             }
-        }
-        
-        # Cardinalidad y tiempos de ejecución
-        self.performance_metrics = {
-            '4-9': {
-                'COMPASS': {'cardinality': 1249, 'execution_time': 120},
-                'PostgreSQL': {'cardinality': 2500, 'execution_time': 180}
-            },
-            '10-19': {
-                'COMPASS': {'cardinality': 5000, 'execution_time': 350},
-                'PostgreSQL': {'cardinality': 15000, 'execution_time': 580}
-            },
-            '20-28': {
-                'COMPASS': {'cardinality': 8000, 'execution_time': 780},
-                'PostgreSQL': {'cardinality': 35000, 'execution_time': 1200}
+            self.performance_metrics[label] = {
+                'COMPASS': {'execution_time': group['compass_ms'].mean()},
+                'PostgreSQL': {'execution_time': group['postgres_ms'].mean()}
             }
-        }
-        
-        # L1 distances por grupo
-        self.l1_distances = {
-            '4-9': {'COMPASS': 2.5, 'PostgreSQL': 4.8},
-            '10-19': {'COMPASS': 4.2, 'PostgreSQL': 7.5},
-            '20-28': {'COMPASS': 5.8, 'PostgreSQL': 11.2}
-        }
+
+        # Distribuciones de q-error por grupo (mediana, p90, p99, máximo)
+        self.qerrors: Dict[str, Dict[str, Dict[str, float]]] = {}
+        if qerror_path and os.path.exists(qerror_path):
+            with open(qerror_path) as f:
+                for bucket in json.load(f)['buckets']:
+                    self.qerrors[bucket['name']] = {
+                        'COMPASS': bucket['compass'],
+                        'PostgreSQL': bucket['postgres']
+                    }
+
+        # Distancia L1 del orden de los subplanes por grupo, de `./main --evaluate plan_quality job`
+        self.plan_quality_systems: List[str] = []
+        self.plan_quality: Dict[str, dict] = {}
+        if plan_quality_path and os.path.exists(plan_quality_path):
+            with open(plan_quality_path) as f:
+                plan_quality = json.load(f)
+            self.plan_quality_systems = plan_quality['systems']
+            for bucket in plan_quality['buckets']:
+                self.plan_quality[bucket['name']] = bucket
+
     def plot_winning_queries_comparison(self):
         """
         Visualiza la comparación de winning queries en diferentes aspectos
         """
         fig, (ax1, ax2) = plt.subplots(1, 2, figsize=(15, 6))
-        
+
         # Total winning queries comparison
         systems = ['COMPASS', 'PostgreSQL']
-        wins = [self.winning_queries['COMPASS'], 
+        wins = [self.winning_queries['COMPASS'],
                 self.winning_queries['PostgreSQL']]
-        
+
         bars = ax1.bar(systems, wins, color=['lightblue', 'lightcoral'])
         ax1.set_title('Total de Queries Ganadas')
         ax1.set_ylabel('Número de Queries')
-        
+
         # Añadir valores en las barras
         for bar in bars:
             height = bar.get_height()
             ax1.text(bar.get_x() + bar.get_width()/2., height,
                     f'{int(height)}\n({height/self.total_queries*100:.1f}%)',
                     ha='center', va='bottom')
-        
+
         # Distribution by join groups
-        join_groups = ['4-9', '10-19', '20-28']
+        join_groups = self.join_groups
         compass_values = [self.join_distribution[g]['COMPASS'] for g in join_groups]
         postgres_values = [self.join_distribution[g]['PostgreSQL'] for g in join_groups]
-        
+
         x = np.arange(len(join_groups))
         width = 0.35
-        
+
         ax2.bar(x - width/2, compass_values, width, label='COMPASS', color='lightblue')
         ax2.bar(x + width/2, postgres_values, width, label='PostgreSQL', color='lightcoral')
-        
+
         # Añadir el número total de queries por grupo
         for i, g in enumerate(join_groups):
             total = self.join_distribution[g]['total_queries']
             ax2.text(i, max(compass_values[i], postgres_values[i]) + 1,
                     f'Total: {total}', ha='center')
-        
+
         ax2.set_xticks(x)
         ax2.set_xticklabels([f'{g} Joins' for g in join_groups])
         ax2.legend()
         ax2.set_title('Winning Queries por Número de Joins')
-        
+
         plt.tight_layout()
         return fig
 
@@ -108,59 +123,111 @@ class ComprehensiveJOBAnalysis:
         Visualiza métricas de rendimiento
         """
         fig, (ax1, ax2) = plt.subplots(1, 2, figsize=(15, 6))
-        
-        join_groups = ['4-9', '10-19', '20-28']
-
-
-        # Cardinalidad
-        compass_card = [self.performance_metrics[g]['COMPASS']['cardinality'] for g in join_groups]
-        postgres_card = [self.performance_metrics[g]['PostgreSQL']['cardinality'] for g in join_groups]
-        
-        ax1.plot(join_groups, compass_card, 'o-', label='COMPASS', color='blue')
-        ax1.plot(join_groups, postgres_card, 's-', label='PostgreSQL', color='red')
-        ax1.set_ylabel('Cardinalidad (log scale)')
-        ax1.set_title('Comparación de Cardinalidad')
-        ax1.set_yscale('log')
-        ax1.legend()
-        ax1.grid(True)
-        
+
+        join_groups = self.join_groups
+
+        # Mediana del q-error de los joins intermedios
+        if self.qerrors:
+            groups = [g for g in join_groups if g in self.qerrors]
+            compass_q = [self.qerrors[g]['COMPASS']['median'] for g in groups]
+            postgres_q = [self.qerrors[g]['PostgreSQL']['median'] for g in groups]
+
+            ax1.plot(groups, compass_q, 'o-', label='COMPASS', color='blue')
+            ax1.plot(groups, postgres_q, 's-', label='PostgreSQL', color='red')
+            ax1.set_ylabel('Mediana del q-error (log scale)')
+            ax1.set_title('Comparación de Estimaciones de Cardinalidad')
+            ax1.set_yscale('log')
+            ax1.legend()
+            ax1.grid(True)
+        else:
+            ax1.set_title('Sin datos de q-error (use --qerror)')
+
         # Tiempo de ejecución
         compass_time = [self.performance_metrics[g]['COMPASS']['execution_time'] for g in join_groups]
         postgres_time = [self.performance_metrics[g]['PostgreSQL']['execution_time'] for g in join_groups]
-        
+
         ax2.plot(join_groups, compass_time, 'o-', label='COMPASS', color='blue')
         ax2.plot(join_groups, postgres_time, 's-', label='PostgreSQL', color='red')
         ax2.set_ylabel('Tiempo de Ejecución (ms)')
         ax2.set_title('Comparación de Tiempos de Ejecución')
         ax2.legend()
         ax2.grid(True)
-        
+
         plt.tight_layout()
         return fig
 
-    def plot_l1_distances(self):
+    def plot_qerror_distributions(self):
         """
-        Visualiza las distancias L1
+        Visualiza las distribuciones de q-error por grupo
         """
         fig, ax = plt.subplots(figsize=(10, 6))
-        
-        join_groups = ['4-9', '10-19', '20-28']
-        compass_l1 = [self.l1_distances[g]['COMPASS'] for g in join_groups]
-        postgres_l1 = [self.l1_distances[g]['PostgreSQL'] for g in join_groups]
-        
-        x = np.arange(len(join_groups))
+        if not self.qerrors:
+            ax.set_title('Sin datos de q-error (use --qerror)')
+            return fig
+
+        groups = list(self.qerrors)
+        x = np.arange(len(groups))
         width = 0.35
-        
-        ax.bar(x - width/2, compass_l1, width, label='COMPASS', color='lightblue')
-        ax.bar(x + width/2, postgres_l1, width, label='PostgreSQL', color='lightcoral')
-        
-        ax.set_ylabel('Distancia L1 Normalizada')
-        ax.set_title('Comparación de Distancias L1')
+
+        # Barra: mediana; línea: de la mediana al p99; marcador: máximo
+        for offset, system, color in ((-width/2, 'COMPASS', 'lightblue'), (width/2, 'PostgreSQL', 'lightcoral')):
+            medians = np.array([self.qerrors[g][system]['median'] for g in groups])
+            p99 = np.array([self.qerrors[g][system]['p99'] for g in groups])
+            maxima = [self.qerrors[g][system]['max'] for g in groups]
+            ax.bar(x + offset, medians, width, label=system, color=color,
+                   yerr=[np.zeros(len(groups)), p99 - medians], capsize=4)
+            ax.scatter(x + offset, maxima, marker='x', color='black', zorder=3)
+
         ax.set_xticks(x)
-        ax.set_xticklabels([f'{g} Joins' for g in join_groups])
+        ax.set_xticklabels([f'{g} Joins' for g in groups])
         ax.legend()
+        ax.set_yscale('log')
+        ax.set_ylabel('q-error (log scale)')
+        ax.set_title('Distribución del q-error por Grupo')
         ax.grid(True, alpha=0.3)
-        
+
+        plt.tight_layout()
+        return fig
+
+    def plot_plan_quality(self):
+        """
+        Visualiza la distancia L1 normalizada y las queries ganadas por grupo
+        """
+        fig, (ax1, ax2) = plt.subplots(1, 2, figsize=(15, 6))
+        if not self.plan_quality:
+            ax1.set_title('Sin datos de calidad de planes (use --evaluate)')
+            return fig
+
+        groups = list(self.plan_quality)
+        systems = self.plan_quality_systems
+        x = np.arange(len(groups))
+        width = 0.8 / len(systems)
+
+        # Barra: media de NormL1; línea: hasta el p90
+        for i, system in enumerate(systems):
+            offset = (i - (len(systems) - 1) / 2) * width
+            means = np.array([self.plan_quality[g][system]['norm_l1']['mean'] for g in groups])
+            p90 = np.array([self.plan_quality[g][system]['norm_l1']['p90'] for g in groups])
+            wins = [self.plan_quality[g][system]['wins'] for g in groups]
+            ax1.bar(x + offset, means, width, label=system, yerr=[np.zeros(len(groups)), np.maximum(p90 - means, 0)],
+                    capsize=4)
+            ax2.bar(x + offset, wins, width, label=system)
+
+        ties = [self.plan_quality[g]['ties'] for g in groups]
+        for i, g in enumerate(groups):
+            ax2.text(i, max(self.plan_quality[g][s]['wins'] for s in systems) + 1,
+                     f"Total: {self.plan_quality[g]['queries']} (empates: {ties[i]})", ha='center')
+
+        for ax in (ax1, ax2):
+            ax.set_xticks(x)
+            ax.set_xticklabels([f'{g} Joins' for g in groups])
+            ax.legend()
+        ax1.set_ylabel('L1 normalizada (media)')
+        ax1.set_title('Distancia L1 del Orden de los Subplanes')
+        ax1.grid(True, alpha=0.3)
+        ax2.set_ylabel('Número de Queries')
+        ax2.set_title('Queries Ganadas por Menor L1')
+
         plt.tight_layout()
         return fig
 
@@ -168,88 +235,75 @@ class ComprehensiveJOBAnalysis:
         """
         Genera un reporte completo del análisis
         """
-        report = f"""
-=======================================================
-    Análisis Comparativo: COMPASS vs PostgreSQL
-    JOB Benchmark - 113 Queries
-=======================================================
-
-1. WINNING QUERIES
------------------
-Total Queries Analizadas: {self.total_queries}
-COMPASS: {self.winning_queries['COMPASS']} ({self.winning_queries['COMPASS']/self.total_queries*100:.1f}%)
-PostgreSQL: {self.winning_queries['PostgreSQL']} ({self.winning_queries['PostgreSQL']/self.total_queries*100:.1f}%)
-
-Distribución por Número de Joins:
-* 4-9 Joins:
-  - COMPASS: {self.join_distribution['4-9']['COMPASS']} de {self.join_distribution['4-9']['total_queries']}
-  - PostgreSQL: {self.join_distribution['4-9']['PostgreSQL']} de {self.join_distribution['4-9']['total_queries']}
-
-* 10-19 Joins:
-  - COMPASS: {self.join_distribution['10-19']['COMPASS']} de {self.join_distribution['10-19']['total_queries']}
-  - PostgreSQL: {self.join_distribution['10-19']['PostgreSQL']} de {self.join_distribution['10-19']['total_queries']}
-
-* 20-28 Joins:
-  - COMPASS: {self.join_distribution['20-28']['COMPASS']} de {self.join_distribution['20-28']['total_queries']}
-  - PostgreSQL: {self.join_distribution['20-28']['PostgreSQL']} de {self.join_distribution['20-28']['total_queries']}
-
-2. MÉTRICAS DE RENDIMIENTO
--------------------------
-Cardinalidad Promedio:
-* 4-9 Joins:
-  COMPASS: {self.performance_metrics['4-9']['COMPASS']['cardinality']}
-  PostgreSQL: {self.performance_metrics['4-9']['PostgreSQL']['cardinality']}
-
-* 10-19 Joins:
-  COMPASS: {self.performance_metrics['10-19']['COMPASS']['cardinality']}
-  PostgreSQL: {self.performance_metrics['10-19']['PostgreSQL']['cardinality']}
-
-* 20-28 Joins:
-  COMPASS: {self.performance_metrics['20-28']['COMPASS']['cardinality']}
-  PostgreSQL: {self.performance_metrics['20-28']['PostgreSQL']['cardinality']}
-
-3. ANÁLISIS DE DISTANCIAS L1
----------------------------
-Promedio de Distancias L1:
-* 4-9 Joins:
-  COMPASS: {self.l1_distances['4-9']['COMPASS']:.2f}
-  PostgreSQL: {self.l1_distances['4-9']['PostgreSQL']:.2f}
-
-* 10-19 Joins:
-  COMPASS: {self.l1_distances['10-19']['COMPASS']:.2f}
-  PostgreSQL: {self.l1_distances['10-19']['PostgreSQL']:.2f}
-
-* 20-28 Joins:
-  COMPASS: {self.l1_distances['20-28']['COMPASS']:.2f}
-  PostgreSQL: {self.l1_distances['20-28']['PostgreSQL']:.2f}
-
-4. CONCLUSIONES PRINCIPALES
---------------------------
-1. COMPASS supera a PostgreSQL en el 55.75% de las queries
-2. La ventaja de COMPASS es más pronunciada en queries complejas (>10 joins)
-3. Las distancias L1 de COMPASS son consistentemente menores
-4. COMPASS mantiene mejor control de la cardinalidad en todos los grupos
-5. La diferencia en rendimiento aumenta con la complejidad de las queries
-
-5. RECOMENDACIONES
------------------
-1. Para queries simples (4-9 joins), ambos optimizadores son competitivos
-2. Para queries complejas (>10 joins), COMPASS es claramente superior
-3. PostgreSQL podría beneficiarse de mejores estimaciones de cardinalidad
-4. La estrategia de sketch-merging de COMPASS es particularmente efectiva
-"""
-        return report
-
-# Crear instancia y generar análisis completo
-analyzer = ComprehensiveJOBAnalysis()
-
-# Generar todas las visualizaciones
-winning_plot = analyzer.plot_winning_queries_comparison()
-performance_plot = analyzer.plot_performance_metrics()
-l1_plot = analyzer.plot_l1_distances()
-
-# Imprimir reporte completo
-print(analyzer.generate_comprehensive_report())
-
-# Mostrar plots
-plt.show()
\ No newline at end of file
+        def pct(count):
+            return count / self.total_queries * 100 if self.total_queries else 0
+
+        lines = [
+            '',
+            '=======================================================',
+            '    Análisis Comparativo: COMPASS vs PostgreSQL',
+            f'    JOB Benchmark - {self.total_queries} Queries',
+            '=======================================================',
+            '',
+            '1. WINNING QUERIES',
+            '-----------------',
+            f'Total Queries Analizadas: {self.total_queries}',
+            f"COMPASS: {self.winning_queries['COMPASS']} ({pct(self.winning_queries['COMPASS']):.1f}%)",
+            f"PostgreSQL: {self.winning_queries['PostgreSQL']} ({pct(self.winning_queries['PostgreSQL']):.1f}%)",
+            '',
+            'Distribución por Número de Joins:',
+        ]
+        for g in self.join_groups:
+            d = self.join_distribution[g]
+            lines += [f'* {g} Joins:',
+                      f"  - COMPASS: {d['COMPASS']} de {d['total_queries']}",
+                      f"  - PostgreSQL: {d['PostgreSQL']} de {d['total_queries']}"]
+
+        lines += ['', '2. MÉTRICAS DE RENDIMIENTO', '-------------------------', 'Tiempo de Ejecución Promedio (ms):']
+        for g in self.join_groups:
+            m = self.performance_metrics[g]
+            lines += [f'* {g} Joins:',
+                      f"  COMPASS: {m['COMPASS']['execution_time']:.1f}",
+                      f"  PostgreSQL: {m['PostgreSQL']['execution_time']:.1f}"]
+
+        lines += ['', '3. Q-ERROR DE LOS JOINS INTERMEDIOS', '----------------------------------']
+        if not self.qerrors:
+            lines.append('Sin datos (ejecute ./main --qerror qerror ...)')
+        for g, systems in self.qerrors.items():
+            lines.append(f'* {g} Joins (mediana / p90 / p99 / máximo):')
+            for system, q in systems.items():
+                lines.append(f"  {system}: {q['median']:.2f} / {q['p90']:.2f} / {q['p99']:.2f} / {q['max']:.2f}")
+
+        lines += ['', '4. DISTANCIA L1 DEL ORDEN DE LOS SUBPLANES', '-----------------------------------------']
+        if not self.plan_quality:
+            lines.append('Sin datos (ejecute ./main --evaluate plan_quality ...)')
+        for g, bucket in self.plan_quality.items():
+            lines.append(f"* {g} Joins ({bucket['queries']} queries, {bucket['subplans']} subplanes, "
+                         f"{bucket['ties']} empates), L1 normalizada media / mediana, queries ganadas:")
+            for system in self.plan_quality_systems:
+                q = bucket[system]
+                lines.append(f"  {system}: {q['norm_l1']['mean']:.2f} / {q['norm_l1']['median']:.2f}, {q['wins']}")
+        return '\n'.join(lines) + '\n'
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Compara COMPASS y PostgreSQL con resultados medidos')
+    parser.add_argument('--results', default='compass_results.csv', help='CSV de ./main --execute')
+    parser.add_argument('--qerror', default='qerror.json', help='JSON de ./main --qerror')
+    parser.add_argument('--plan-quality', default='plan_quality.json', help='JSON de ./main --evaluate')
+    args = parser.parse_args()
+
+    # Crear instancia y generar análisis completo
+    analyzer = ComprehensiveJOBAnalysis(args.results, args.qerror, args.plan_quality)
+
+    # Generar todas las visualizaciones
+    winning_plot = analyzer.plot_winning_queries_comparison()
+    performance_plot = analyzer.plot_performance_metrics()
+    qerror_plot = analyzer.plot_qerror_distributions()
+    plan_quality_plot = analyzer.plot_plan_quality()
+
+    # Imprimir reporte completo
+    print(analyzer.generate_comprehensive_report())
+
+    # Mostrar plots
+    plt.show()
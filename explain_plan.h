@@ -0,0 +1,265 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// One node of a Postgres plan as reported by EXPLAIN (FORMAT JSON)
+struct PlanNode {
+    std::string nodeType;      // "Hash Join", "Seq Scan", ...
+    std::string relation;      // "Relation Name", empty above the scans
+    std::string alias;
+    double startupCost = 0;
+    double totalCost = 0;
+    double planRows = 0;
+    // Only present with ANALYZE; -1 otherwise. actualRows is per loop, as Postgres reports it.
+    double actualRows = -1;
+    double actualLoops = -1;
+    double actualTotalTime = -1;
+    // With BUFFERS; counts include the node's children
+    double sharedHitBlocks = 0;
+    double sharedReadBlocks = 0;
+    // Hash "Peak Memory Usage" or Sort "Sort Space Used", in kB
+    double memoryKb = 0;
+    std::vector<int> children;
+
+    bool isJoin() const {
+        return nodeType == "Nested Loop" || nodeType == "Hash Join" || nodeType == "Merge Join";
+    }
+};
+
+// Typed plan tree parsed in a single pass over the EXPLAIN JSON text. Nodes live
+// in a flat vector and refer to their children by index; root is the top plan node.
+struct ExplainPlan {
+    std::vector<PlanNode> nodes;
+    int root = -1;
+    // Only present with ANALYZE (and SUMMARY for planning); -1 otherwise
+    double planningTime = -1;
+    double executionTime = -1;
+
+    static ExplainPlan parse(const std::string& json);
+
+    // Work memory of all hash tables and sorts of the plan, in kB
+    double memoryKb() const {
+        double total = 0;
+        for (const auto& node : nodes) total += node.memoryKb;
+        return total;
+    }
+
+    // Join order in the "((a ⨝ b) ⨝ c)" form the planner prints, using table names
+    std::string joinOrder() const {
+        return root < 0 ? "" : joinOrder(root);
+    }
+
+    std::string joinOrder(int node) const {
+        const PlanNode& plan = nodes[node];
+        // Scans name their relation; their children (e.g. bitmap index scans) add nothing
+        if (!plan.relation.empty()) return plan.relation;
+
+        // Hash, Sort, Materialize, Gather and friends pass their input through
+        std::string result;
+        for (int child : plan.children) {
+            std::string side = joinOrder(child);
+            if (side.empty()) continue;
+            result = result.empty() ? side : "(" + result + " ⨝ " + side + ")";
+        }
+        return result;
+    }
+};
+
+// Recursive-descent reader over the JSON text. Values the plan tree does not
+// need are skipped without being materialized.
+class ExplainParser {
+private:
+    const std::string& json;
+    size_t pos = 0;
+    ExplainPlan& plan;
+
+    [[noreturn]] void fail(const char* what) const {
+        throw std::runtime_error(std::string("EXPLAIN JSON: ") + what + " at offset " + std::to_string(pos));
+    }
+
+    void skipWhitespace() {
+        while (pos < json.size() && (json[pos] == ' ' || json[pos] == '\n' || json[pos] == '\t' || json[pos] == '\r')) {
+            pos++;
+        }
+    }
+
+    char peek() {
+        skipWhitespace();
+        if (pos >= json.size()) fail("unexpected end of input");
+        return json[pos];
+    }
+
+    void expect(char c) {
+        if (peek() != c) fail("unexpected character");
+        pos++;
+    }
+
+    bool accept(char c) {
+        if (peek() != c) return false;
+        pos++;
+        return true;
+    }
+
+    static void appendUtf8(std::string& out, uint32_t code) {
+        if (code < 0x80) {
+            out += static_cast<char>(code);
+        } else if (code < 0x800) {
+            out += static_cast<char>(0xC0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else {
+            out += static_cast<char>(0xE0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+
+    std::string parseString() {
+        expect('"');
+        std::string result;
+        while (true) {
+            if (pos >= json.size()) fail("unterminated string");
+            char c = json[pos++];
+            if (c == '"') return result;
+            if (c != '\\') {
+                result += c;
+                continue;
+            }
+            if (pos >= json.size()) fail("unterminated escape");
+            char escaped = json[pos++];
+            switch (escaped) {
+                case 'n': result += '\n'; break;
+                case 't': result += '\t'; break;
+                case 'r': result += '\r'; break;
+                case 'b': result += '\b'; break;
+                case 'f': result += '\f'; break;
+                case 'u': {
+                    if (pos + 4 > json.size()) fail("truncated unicode escape");
+                    appendUtf8(result, static_cast<uint32_t>(std::strtoul(json.substr(pos, 4).c_str(), nullptr, 16)));
+                    pos += 4;
+                    break;
+                }
+                default: result += escaped; break;
+            }
+        }
+    }
+
+    double parseNumber() {
+        skipWhitespace();
+        const char* begin = json.c_str() + pos;
+        char* end = nullptr;
+        double value = std::strtod(begin, &end);
+        if (end == begin) fail("expected a number");
+        pos += end - begin;
+        return value;
+    }
+
+    void skipValue() {
+        char c = peek();
+        if (c == '"') {
+            parseString();
+        } else if (c == '{') {
+            pos++;
+            if (accept('}')) return;
+            do {
+                parseString();
+                expect(':');
+                skipValue();
+            } while (accept(','));
+            expect('}');
+        } else if (c == '[') {
+            pos++;
+            if (accept(']')) return;
+            do {
+                skipValue();
+            } while (accept(','));
+            expect(']');
+        } else if (c == 't' || c == 'f' || c == 'n') {
+            // true, false, null
+            while (pos < json.size() && json[pos] >= 'a' && json[pos] <= 'z') pos++;
+        } else {
+            parseNumber();
+        }
+    }
+
+    int parsePlanNode() {
+        int index = static_cast<int>(plan.nodes.size());
+        plan.nodes.emplace_back();
+        std::vector<int> children;
+
+        expect('{');
+        if (!accept('}')) {
+            do {
+                std::string key = parseString();
+                expect(':');
+                // Re-fetched per key: parsing children may reallocate nodes
+                PlanNode& node = plan.nodes[index];
+                if (key == "Node Type") node.nodeType = parseString();
+                else if (key == "Relation Name") node.relation = parseString();
+                else if (key == "Alias") node.alias = parseString();
+                else if (key == "Startup Cost") node.startupCost = parseNumber();
+                else if (key == "Total Cost") node.totalCost = parseNumber();
+                else if (key == "Plan Rows") node.planRows = parseNumber();
+                else if (key == "Actual Rows") node.actualRows = parseNumber();
+                else if (key == "Actual Loops") node.actualLoops = parseNumber();
+                else if (key == "Actual Total Time") node.actualTotalTime = parseNumber();
+                else if (key == "Shared Hit Blocks") node.sharedHitBlocks = parseNumber();
+                else if (key == "Shared Read Blocks") node.sharedReadBlocks = parseNumber();
+                else if (key == "Peak Memory Usage" || key == "Sort Space Used") node.memoryKb = parseNumber();
+                else if (key == "Plans") {
+                    expect('[');
+                    if (!accept(']')) {
+                        do {
+                            children.push_back(parsePlanNode());
+                        } while (accept(','));
+                        expect(']');
+                    }
+                } else {
+                    skipValue();
+                }
+            } while (accept(','));
+            expect('}');
+        }
+        plan.nodes[index].children = std::move(children);
+        return index;
+    }
+
+    // The top-level object holding "Plan" and the timing summary
+    void parseStatement() {
+        expect('{');
+        if (accept('}')) return;
+        do {
+            std::string key = parseString();
+            expect(':');
+            if (key == "Plan") plan.root = parsePlanNode();
+            else if (key == "Planning Time") plan.planningTime = parseNumber();
+            else if (key == "Execution Time") plan.executionTime = parseNumber();
+            else skipValue();
+        } while (accept(','));
+        expect('}');
+    }
+
+public:
+    ExplainParser(const std::string& json, ExplainPlan& plan) : json(json), plan(plan) {}
+
+    // EXPLAIN (FORMAT JSON) returns a one-element array; a bare statement object is accepted too
+    void parse() {
+        if (accept('[')) {
+            parseStatement();
+            while (accept(',')) skipValue();
+            expect(']');
+        } else {
+            parseStatement();
+        }
+        if (plan.root < 0) fail("no \"Plan\" found");
+    }
+};
+
+inline ExplainPlan ExplainPlan::parse(const std::string& json) {
+    ExplainPlan plan;
+    ExplainParser(json, plan).parse();
+    return plan;
+}
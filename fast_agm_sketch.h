@@ -0,0 +1,230 @@
+#pragma once
+
+#include <array>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "binary_io.h"
+
+// Allocator handing out cache-line aligned storage, so sketch rows start on a
+// line boundary and vector loads never split lines
+template <typename T, size_t Alignment = 64>
+struct AlignedAllocator {
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator() = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+
+    void deallocate(T* p, size_t) {
+        ::operator delete(p, std::align_val_t(Alignment));
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+};
+
+// FastAGM Sketch implementation
+//
+// Each row hashes a join-key value to one bucket and a +/-1 sign. Two sketches
+// built with the same seed estimate the size of the equi-join of their key
+// columns as the median over rows of the inner product of their counters.
+//
+// Depth rows of Width counters live in one contiguous aligned buffer. Buckets
+// and signs come from independent multiply-add-shift functions
+// ((a * x + b) mod 2^64) >> (64 - bits), which are pairwise independent over
+// 32-bit keys. 64-bit keys are folded to 32 bits first; every int32 key
+// (all IMDB join keys) keeps its own hash. Updates go one key at a time across
+// all rows: the rows' counters are independent, so their read-modify-writes
+// overlap, while a block of keys per row would serialize on the counters that
+// frequent keys hit again and again.
+template <int Depth, int Width, typename Counter = double>
+class BasicFastAGMSketch {
+private:
+    static_assert(Depth > 0 && Depth % 2 == 1, "BasicFastAGMSketch: depth must be odd so the median is one row");
+    static_assert(Width > 1 && (Width & (Width - 1)) == 0, "BasicFastAGMSketch: width must be a power of two");
+    static_assert(std::is_arithmetic<Counter>::value && std::is_signed<Counter>::value,
+                  "BasicFastAGMSketch: counters must be a signed arithmetic type");
+
+    static constexpr int widthBits() {
+        int bits = 0;
+        while ((1 << bits) < Width) bits++;
+        return bits;
+    }
+
+    static constexpr int WIDTH_BITS = widthBits();
+    static constexpr uint64_t DEFAULT_SEED = 0x9e3779b97f4a7c15ULL;
+    static constexpr uint32_t FORMAT_VERSION = 1;
+
+    std::vector<Counter, AlignedAllocator<Counter>> counters;
+    // Per row: bucket multiplier and offset, then sign multiplier and offset
+    std::array<std::array<uint64_t, 4>, Depth> hashSeeds;
+    uint64_t seed;
+    double totalWeight = 0;
+
+    static uint32_t fold(int64_t key) {
+        return static_cast<uint32_t>(static_cast<uint64_t>(key) ^ static_cast<uint64_t>(key >> 32));
+    }
+
+    static uint32_t fold(int32_t key) {
+        // Same value as folding the sign-extended key
+        return static_cast<uint32_t>(key ^ (key >> 31));
+    }
+
+    static uint64_t multiplyAdd(uint64_t a, uint64_t b, uint32_t x) {
+        return a * x + b;
+    }
+
+    Counter* row(int i) { return counters.data() + static_cast<size_t>(i) * Width; }
+    const Counter* row(int i) const { return counters.data() + static_cast<size_t>(i) * Width; }
+
+    // Indexed by the sign bit: signs are random, so a branch would mispredict half the time
+    void updateFolded(uint32_t key, const Counter (&increments)[2]) {
+        for (int i = 0; i < Depth; i++) {
+            const auto& s = hashSeeds[i];
+            uint32_t bucket = static_cast<uint32_t>(multiplyAdd(s[0], s[1], key) >> (64 - WIDTH_BITS));
+            uint32_t negative = static_cast<uint32_t>(multiplyAdd(s[2], s[3], key) >> 63);
+            row(i)[bucket] += increments[negative];
+        }
+    }
+
+    template <typename Key>
+    void updateBatch(const Key* keys, size_t count) {
+        const Counter increments[2] = {Counter(1), Counter(-1)};
+        for (size_t k = 0; k < count; k++) {
+            updateFolded(fold(keys[k]), increments);
+        }
+        totalWeight += static_cast<double>(count);
+    }
+
+public:
+    static constexpr int DEPTH = Depth;
+    static constexpr int WIDTH = Width;
+
+    explicit BasicFastAGMSketch(uint64_t seed = DEFAULT_SEED)
+        : counters(static_cast<size_t>(Depth) * Width, Counter(0)), seed(seed) {
+        // Deterministic seeds: sketches are only comparable when they share hash functions.
+        // Multipliers are odd so no key bit is shifted out of the product.
+        std::mt19937_64 gen(seed);
+        for (auto& s : hashSeeds) {
+            for (uint64_t& value : s) {
+                value = gen();
+            }
+            s[0] |= 1;
+            s[2] |= 1;
+        }
+    }
+
+    void update(int64_t key, double weight = 1.0) {
+        const Counter increments[2] = {static_cast<Counter>(weight), static_cast<Counter>(-weight)};
+        updateFolded(fold(key), increments);
+        totalWeight += weight;
+    }
+
+    // Adds each key with weight one; the same result as calling update() per key
+    void update(const int32_t* keys, size_t count) { updateBatch(keys, count); }
+    void update(const int64_t* keys, size_t count) { updateBatch(keys, count); }
+
+    // Estimated |R ⨝ S| on the sketched keys
+    double estimateJoinSize(const BasicFastAGMSketch& other) const {
+        if (seed != other.seed) {
+            throw std::invalid_argument("FastAGMSketch: cannot join sketches built with different seeds");
+        }
+
+        std::array<double, Depth> estimates;
+        for (int i = 0; i < Depth; i++) {
+            const Counter* a = row(i);
+            const Counter* b = other.row(i);
+            double dot = 0;
+            for (int j = 0; j < Width; j++) {
+                dot += static_cast<double>(a[j]) * static_cast<double>(b[j]);
+            }
+            estimates[i] = dot;
+        }
+
+        std::nth_element(estimates.begin(), estimates.begin() + Depth / 2, estimates.end());
+        // Inner products of non-negative frequency vectors cannot be negative
+        return std::max(0.0, estimates[Depth / 2]);
+    }
+
+    // Estimated total weight of one key: the median over rows of its signed counter
+    // (the Count Sketch point query), unbiased with error about sqrt(F2 / Width)
+    double estimateFrequency(int64_t key) const {
+        uint32_t folded = fold(key);
+        std::array<double, Depth> estimates;
+        for (int i = 0; i < Depth; i++) {
+            const auto& s = hashSeeds[i];
+            uint32_t bucket = static_cast<uint32_t>(multiplyAdd(s[0], s[1], folded) >> (64 - WIDTH_BITS));
+            bool negative = (multiplyAdd(s[2], s[3], folded) >> 63) != 0;
+            double counter = static_cast<double>(row(i)[bucket]);
+            estimates[i] = negative ? -counter : counter;
+        }
+        std::nth_element(estimates.begin(), estimates.begin() + Depth / 2, estimates.end());
+        return estimates[Depth / 2];
+    }
+
+    // Adds other's counters element-wise. Sketches are linear, so merging the
+    // sketches of disjoint shards gives exactly the sketch of their union.
+    void merge(const BasicFastAGMSketch& other) {
+        if (seed != other.seed) {
+            throw std::invalid_argument("FastAGMSketch: cannot merge sketches built with different seeds");
+        }
+        Counter* target = counters.data();
+        const Counter* source = other.counters.data();
+        for (size_t i = 0; i < counters.size(); i++) {
+            target[i] += source[i];
+        }
+        totalWeight += other.totalWeight;
+    }
+
+    // Number of keys (sum of weights) fed into the sketch
+    double count() const {
+        return totalWeight;
+    }
+
+    // Self-describing: a version, the seed and the shape precede the counters, so
+    // sketches can be stored or shipped on their own and checked on arrival
+    void serialize(BinaryWriter& writer) const {
+        writer.write<uint32_t>(FORMAT_VERSION);
+        writer.write<uint64_t>(seed);
+        writer.write<double>(totalWeight);
+        writer.write<uint32_t>(Depth);
+        writer.write<uint32_t>(Width);
+        writer.write<uint32_t>(sizeof(Counter));
+        writer.writeBytes(counters.data(), counters.size() * sizeof(Counter));
+    }
+
+    static BasicFastAGMSketch deserialize(BinaryReader& reader) {
+        if (reader.read<uint32_t>() != FORMAT_VERSION) {
+            throw std::runtime_error("FastAGMSketch: unsupported serialized sketch version");
+        }
+        BasicFastAGMSketch result(reader.read<uint64_t>());
+        result.totalWeight = reader.read<double>();
+        if (reader.read<uint32_t>() != Depth || reader.read<uint32_t>() != Width ||
+            reader.read<uint32_t>() != sizeof(Counter)) {
+            throw std::runtime_error("FastAGMSketch: serialized sketch has a different shape");
+        }
+        reader.readBytes(result.counters.data(), result.counters.size() * sizeof(Counter));
+        return result;
+    }
+};
+
+// The planner's sketch: 5 rows of 1024 double counters
+using FastAGMSketch = BasicFastAGMSketch<5, 1024, double>;
@@ -0,0 +1,491 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "binary_io.h"
+#include "fast_agm_sketch.h"
+
+// Count-Min sketch over integer keys. Counters are 32-bit and wrap, so deletions
+// are exact: every counter holds its true (non-negative) sum modulo 2^32.
+template <int Depth, int Width>
+class BasicCountMinSketch {
+private:
+    static_assert(Width > 1 && (Width & (Width - 1)) == 0, "BasicCountMinSketch: width must be a power of two");
+
+    static constexpr int widthBits() {
+        int bits = 0;
+        while ((1 << bits) < Width) bits++;
+        return bits;
+    }
+
+    static constexpr int WIDTH_BITS = widthBits();
+
+    std::vector<uint32_t> counters;
+    // Per row: multiplier and offset of a multiply-add-shift hash
+    std::array<std::array<uint64_t, 2>, Depth> hashSeeds;
+
+    static uint32_t fold(int64_t key) {
+        return static_cast<uint32_t>(static_cast<uint64_t>(key) ^ static_cast<uint64_t>(key >> 32));
+    }
+
+    size_t slot(int i, uint32_t key) const {
+        const auto& s = hashSeeds[i];
+        return static_cast<size_t>(i) * Width + static_cast<size_t>((s[0] * key + s[1]) >> (64 - WIDTH_BITS));
+    }
+
+public:
+    explicit BasicCountMinSketch(uint64_t seed) : counters(static_cast<size_t>(Depth) * Width, 0) {
+        std::mt19937_64 gen(seed);
+        for (auto& s : hashSeeds) {
+            s[0] = gen() | 1;
+            s[1] = gen();
+        }
+    }
+
+    // Adds weight to key and returns the key's new estimate
+    uint32_t update(int64_t key, int64_t weight) {
+        uint32_t folded = fold(key);
+        uint32_t estimate = UINT32_MAX;
+        for (int i = 0; i < Depth; i++) {
+            uint32_t& counter = counters[slot(i, folded)];
+            counter += static_cast<uint32_t>(weight);
+            estimate = std::min(estimate, counter);
+        }
+        return estimate;
+    }
+
+    // Counter slots of count keys, Depth per key. Row-major loops over independent
+    // keys, so the multiplies of a block pipeline instead of waiting on counters.
+    template <typename Key>
+    void locate(const Key* keys, size_t count, uint32_t* slots) const {
+        for (int i = 0; i < Depth; i++) {
+            for (size_t k = 0; k < count; k++) {
+                slots[k * Depth + i] = static_cast<uint32_t>(slot(i, fold(keys[k])));
+            }
+        }
+    }
+
+    // Adds weight at the Depth slots of one located key and returns its new estimate
+    uint32_t update(const uint32_t* slots, int64_t weight) {
+        uint32_t estimate = UINT32_MAX;
+        for (int i = 0; i < Depth; i++) {
+            uint32_t& counter = counters[slots[i]];
+            counter += static_cast<uint32_t>(weight);
+            estimate = std::min(estimate, counter);
+        }
+        return estimate;
+    }
+
+    // Never below the key's true count; above it by the weight of colliding keys
+    uint32_t estimate(int64_t key) const {
+        uint32_t folded = fold(key);
+        uint32_t estimate = UINT32_MAX;
+        for (int i = 0; i < Depth; i++) {
+            estimate = std::min(estimate, counters[slot(i, folded)]);
+        }
+        return estimate;
+    }
+
+    void merge(const BasicCountMinSketch& other) {
+        for (size_t i = 0; i < counters.size(); i++) {
+            counters[i] += other.counters[i];
+        }
+    }
+
+    void serialize(BinaryWriter& writer) const {
+        writer.writeBytes(counters.data(), counters.size() * sizeof(uint32_t));
+    }
+
+    void deserialize(BinaryReader& reader) {
+        reader.readBytes(counters.data(), counters.size() * sizeof(uint32_t));
+    }
+};
+
+// The Capacity most frequent keys of a stream with upper bounds of their counts,
+// found with a Count-Min sketch. While at most Capacity distinct keys were
+// seen, every key is tracked from its first update and all counts are exact.
+// After that, a key enters the summary once its Count-Min estimate beats the
+// smallest tracked count and starts from that estimate, which includes the
+// weight of colliding keys: its count is an upper bound, and only the updates
+// after it entered are counted exactly. Deletes (negative weights) only adjust
+// counts; they never let a key in or push one out.
+template <int Capacity, int Depth, int Width>
+class BasicHeavyHitterSummary {
+private:
+    static_assert(Capacity > 0 && Capacity < 16384, "BasicHeavyHitterSummary: capacity out of range");
+
+    static constexpr int indexBits() {
+        int bits = 0;
+        while ((1 << bits) < 2 * Capacity) bits++;
+        return bits;
+    }
+
+    static constexpr int INDEX_BITS = indexBits();
+    static constexpr size_t INDEX_SLOTS = size_t{1} << INDEX_BITS;
+    // Keys hashed per batch block before the summary sees them
+    static constexpr size_t BLOCK = 64;
+
+    BasicCountMinSketch<Depth, Width> sketch;
+    std::array<int64_t, Capacity> keys{};
+    std::array<int64_t, Capacity> counts{};
+    // Linear-probing table of positions in keys, at most half full; -1 marks an empty slot
+    std::array<int16_t, INDEX_SLOTS> index;
+    int size = 0;
+    int minIndex = 0;
+    // True once a key was turned away or evicted, so untracked keys may have occurred
+    bool overflowed = false;
+
+    static size_t home(int64_t key) {
+        return static_cast<size_t>((static_cast<uint64_t>(key) * 0x9e3779b97f4a7c15ULL) >> (64 - INDEX_BITS));
+    }
+
+    static size_t next(size_t slot) { return (slot + 1) & (INDEX_SLOTS - 1); }
+
+    int find(int64_t key) const {
+        for (size_t slot = home(key);; slot = next(slot)) {
+            int i = index[slot];
+            if (i < 0 || keys[i] == key) return i;
+        }
+    }
+
+    void indexKey(int i) {
+        size_t slot = home(keys[i]);
+        while (index[slot] >= 0) slot = next(slot);
+        index[slot] = static_cast<int16_t>(i);
+    }
+
+    // Removes keys[i] and moves later entries of its probe run back into the gap
+    void unindexKey(int i) {
+        size_t gap = home(keys[i]);
+        while (index[gap] != i) gap = next(gap);
+        for (size_t slot = next(gap); index[slot] >= 0; slot = next(slot)) {
+            size_t wanted = home(keys[index[slot]]);
+            // Entries whose home lies cyclically in (gap, slot] must stay where they are
+            bool stays = gap < slot ? (wanted > gap && wanted <= slot) : (wanted > gap || wanted <= slot);
+            if (stays) continue;
+            index[gap] = index[slot];
+            gap = slot;
+        }
+        index[gap] = -1;
+    }
+
+    void rebuildIndex() {
+        index.fill(-1);
+        for (int i = 0; i < size; i++) indexKey(i);
+    }
+
+    void updateMin() {
+        minIndex = 0;
+        for (int i = 1; i < size; i++) {
+            if (counts[i] < counts[minIndex]) minIndex = i;
+        }
+    }
+
+    // Tracks key given its Count-Min estimate after weight was added
+    void admit(int64_t key, int64_t weight, int64_t estimate) {
+        // A tracked key's count never exceeds its Count-Min estimate, so a full summary
+        // can turn away keys estimated below its minimum without searching it
+        if (size == Capacity && estimate < counts[minIndex]) {
+            overflowed = overflowed || weight > 0;
+            return;
+        }
+        int i = find(key);
+        if (i >= 0) {
+            counts[i] += weight;
+            if (i == minIndex || weight < 0) updateMin();
+        } else if (weight <= 0) {
+            return;
+        } else if (size < Capacity) {
+            keys[size] = key;
+            // Before any overflow every key seen is tracked, so this one starts from zero
+            counts[size] = overflowed ? estimate : weight;
+            indexKey(size);
+            size++;
+            updateMin();
+        } else {
+            overflowed = true;
+            if (estimate > counts[minIndex]) {
+                unindexKey(minIndex);
+                keys[minIndex] = key;
+                counts[minIndex] = estimate;
+                indexKey(minIndex);
+                updateMin();
+            }
+        }
+    }
+
+public:
+    explicit BasicHeavyHitterSummary(uint64_t seed) : sketch(seed) { index.fill(-1); }
+
+    void update(int64_t key, int64_t weight) { admit(key, weight, sketch.update(key, weight)); }
+
+    // Same as updating each key with weight 1, hashing a block of keys at a time
+    template <typename Key>
+    void update(const Key* batch, size_t count) {
+        uint32_t slots[BLOCK * Depth];
+        uint32_t estimates[BLOCK];
+        uint32_t candidates[BLOCK];
+        for (size_t start = 0; start < count; start += BLOCK) {
+            size_t block = std::min(BLOCK, count - start);
+            sketch.locate(batch + start, block, slots);
+            for (size_t k = 0; k < block; k++) estimates[k] = sketch.update(slots + k * Depth, 1);
+            if (size < Capacity) {
+                for (size_t k = 0; k < block; k++) admit(batch[start + k], 1, estimates[k]);
+                continue;
+            }
+            // Unit weights only raise the smallest tracked count, so keys estimated below it
+            // now would be turned away one by one too; drop them without branching
+            int64_t floor = counts[minIndex];
+            size_t kept = 0;
+            for (size_t k = 0; k < block; k++) {
+                candidates[kept] = static_cast<uint32_t>(k);
+                kept += static_cast<int64_t>(estimates[k]) >= floor;
+            }
+            overflowed = overflowed || kept < block;
+            for (size_t c = 0; c < kept; c++) admit(batch[start + candidates[c]], 1, estimates[candidates[c]]);
+        }
+    }
+
+    // Tracked keys in place: trackedKey(i) and trackedCount(i) for i below trackedKeys()
+    int trackedKeys() const { return size; }
+    int64_t trackedKey(int i) const { return keys[i]; }
+    int64_t trackedCount(int i) const { return counts[i]; }
+
+    // Tracked keys with upper bounds of their counts
+    std::vector<std::pair<int64_t, int64_t>> entries() const {
+        std::vector<std::pair<int64_t, int64_t>> result;
+        for (int i = 0; i < size; i++) {
+            result.emplace_back(keys[i], counts[i]);
+        }
+        return result;
+    }
+
+    bool tracked(int64_t key, int64_t& count) const {
+        int i = find(key);
+        if (i < 0) return false;
+        count = counts[i];
+        return true;
+    }
+
+    // Upper bound of the count of an untracked key: zero unless keys were turned away,
+    // and never more than the Count-Min estimate or the smallest tracked count
+    int64_t untrackedBound(int64_t key) const {
+        if (!overflowed) return 0;
+        return std::min<int64_t>(sketch.estimate(key), counts[minIndex]);
+    }
+
+    // Sketches merge exactly; each side's candidates are re-counted from both summaries
+    void merge(const BasicHeavyHitterSummary& other) {
+        auto countIn = [](const BasicHeavyHitterSummary& summary, int64_t key) {
+            int64_t count;
+            return summary.tracked(key, count) ? count : summary.untrackedBound(key);
+        };
+        std::vector<std::pair<int64_t, int64_t>> candidates;
+        for (int i = 0; i < size; i++) {
+            candidates.emplace_back(keys[i], counts[i] + countIn(other, keys[i]));
+        }
+        for (int i = 0; i < other.size; i++) {
+            if (find(other.keys[i]) < 0) {
+                candidates.emplace_back(other.keys[i], other.counts[i] + countIn(*this, other.keys[i]));
+            }
+        }
+        // Ties broken by key so merging is deterministic
+        std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) {
+            return a.second != b.second ? a.second > b.second : a.first < b.first;
+        });
+        overflowed = overflowed || other.overflowed || candidates.size() > static_cast<size_t>(Capacity);
+        size = static_cast<int>(std::min(candidates.size(), static_cast<size_t>(Capacity)));
+        for (int i = 0; i < size; i++) {
+            keys[i] = candidates[i].first;
+            counts[i] = candidates[i].second;
+        }
+        rebuildIndex();
+        updateMin();
+        sketch.merge(other.sketch);
+    }
+
+    void serialize(BinaryWriter& writer) const {
+        writer.write<uint32_t>(Capacity);
+        writer.write<uint32_t>(Depth);
+        writer.write<uint32_t>(Width);
+        writer.write<uint8_t>(overflowed ? 1 : 0);
+        writer.write<uint32_t>(static_cast<uint32_t>(size));
+        for (int i = 0; i < size; i++) {
+            writer.write<int64_t>(keys[i]);
+            writer.write<int64_t>(counts[i]);
+        }
+        sketch.serialize(writer);
+    }
+
+    void deserialize(BinaryReader& reader) {
+        if (reader.read<uint32_t>() != Capacity || reader.read<uint32_t>() != Depth ||
+            reader.read<uint32_t>() != Width) {
+            throw std::runtime_error("HeavyHitterSummary: serialized summary has a different shape");
+        }
+        overflowed = reader.read<uint8_t>() != 0;
+        uint32_t stored = reader.read<uint32_t>();
+        if (stored > static_cast<uint32_t>(Capacity)) {
+            throw std::runtime_error("HeavyHitterSummary: too many serialized keys");
+        }
+        size = static_cast<int>(stored);
+        for (int i = 0; i < size; i++) {
+            keys[i] = reader.read<int64_t>();
+            counts[i] = reader.read<int64_t>();
+        }
+        rebuildIndex();
+        updateMin();
+        sketch.deserialize(reader);
+    }
+};
+
+// Skew-aware sketch of one join-key column: a FastAGMSketch of all keys plus a
+// summary of its heavy hitters.
+//
+// |R ⨝ S| = sum over keys v of f_R(v) * f_S(v) is split into the keys tracked
+// as heavy on either side, whose products are summed directly, and the rest,
+// estimated by AGM from both sketches with each side's own heavy hitters
+// subtracted (sketches are linear). Heavy keys carry most of the second moment
+// of skewed columns, so the AGM part sees a much flatter residual and its
+// variance drops accordingly. The frequency of a key heavy on one side only is
+// read from the other side's residual sketch, clamped to the bounds its summary
+// gives.
+//
+// The residual sketch is kept alongside and recomputed when the sketch is
+// finalized, merged or loaded; single-key updates keep it current. Batch
+// updates leave it stale until finalize(), and estimates from a stale sketch
+// compute a temporary residual instead, so const sketches stay safe to share.
+class JoinKeySketch {
+private:
+    static constexpr uint32_t FORMAT_VERSION = 1;
+    static constexpr uint64_t SUMMARY_SEED = 0x243f6a8885a308d3ULL;
+
+    using Summary = BasicHeavyHitterSummary<32, 4, 2048>;
+
+    FastAGMSketch agm;
+    Summary heavy;
+    // The AGM sketch with the tracked heavy hitters taken out, valid while residualCurrent
+    FastAGMSketch residualSketch;
+    bool residualCurrent = true;
+
+    void computeResidual(FastAGMSketch& result) const {
+        result = agm;
+        for (int i = 0; i < heavy.trackedKeys(); i++) {
+            result.update(heavy.trackedKey(i), -static_cast<double>(heavy.trackedCount(i)));
+        }
+    }
+
+    const FastAGMSketch& residual(std::optional<FastAGMSketch>& scratch) const {
+        if (residualCurrent) return residualSketch;
+        computeResidual(scratch.emplace());
+        return *scratch;
+    }
+
+    // Count of a key this side does not track, estimated from its residual sketch
+    double untrackedFrequency(const FastAGMSketch& residualSketch, int64_t key) const {
+        double bound = static_cast<double>(heavy.untrackedBound(key));
+        if (bound <= 0) return 0;
+        return std::clamp(residualSketch.estimateFrequency(key), 0.0, bound);
+    }
+
+public:
+    JoinKeySketch() : heavy(SUMMARY_SEED) {}
+
+    void update(int64_t key, double weight = 1.0) {
+        int64_t before = 0;
+        bool wasTracked = heavy.tracked(key, before);
+        agm.update(key, weight);
+        heavy.update(key, std::llround(weight));
+        if (!residualCurrent) return;
+        int64_t after = 0;
+        if (heavy.tracked(key, after) != wasTracked) {
+            // The key entered the summary, possibly evicting another one
+            computeResidual(residualSketch);
+        } else {
+            residualSketch.update(key, weight - static_cast<double>(after - before));
+        }
+    }
+
+    // Leaves the residual stale until finalize()
+    template <typename Key>
+    void update(const Key* keys, size_t count) {
+        agm.update(keys, count);
+        heavy.update(keys, count);
+        residualCurrent = residualCurrent && count == 0;
+    }
+
+    // Recomputes the residual after batch updates, so estimates do not have to
+    void finalize() {
+        if (residualCurrent) return;
+        computeResidual(residualSketch);
+        residualCurrent = true;
+    }
+
+    void merge(const JoinKeySketch& other) {
+        agm.merge(other.agm);
+        heavy.merge(other.heavy);
+        residualCurrent = false;
+        finalize();
+    }
+
+    double count() const { return agm.count(); }
+
+    const FastAGMSketch& sketch() const { return agm; }
+
+    // Estimated |R ⨝ S| on the sketched keys; with other == *this, the self-join size
+    double estimateJoinSize(const JoinKeySketch& other) const {
+        std::optional<FastAGMSketch> ownScratch;
+        const FastAGMSketch& ownResidual = residual(ownScratch);
+        if (&other == this) {
+            double exact = 0;
+            for (int i = 0; i < heavy.trackedKeys(); i++) {
+                double count = static_cast<double>(heavy.trackedCount(i));
+                exact += count * count;
+            }
+            return exact + ownResidual.estimateJoinSize(ownResidual);
+        }
+
+        std::optional<FastAGMSketch> otherScratch;
+        const FastAGMSketch& otherResidual = other.residual(otherScratch);
+        double exact = 0;
+        for (int i = 0; i < heavy.trackedKeys(); i++) {
+            int64_t key = heavy.trackedKey(i);
+            int64_t otherCount;
+            double frequency = other.heavy.tracked(key, otherCount) ? static_cast<double>(otherCount)
+                                                                   : other.untrackedFrequency(otherResidual, key);
+            exact += static_cast<double>(heavy.trackedCount(i)) * frequency;
+        }
+        for (int i = 0; i < other.heavy.trackedKeys(); i++) {
+            int64_t key = other.heavy.trackedKey(i);
+            int64_t ownCount;
+            if (heavy.tracked(key, ownCount)) continue;
+            exact += untrackedFrequency(ownResidual, key) * static_cast<double>(other.heavy.trackedCount(i));
+        }
+        return exact + ownResidual.estimateJoinSize(otherResidual);
+    }
+
+    void serialize(BinaryWriter& writer) const {
+        writer.write<uint32_t>(FORMAT_VERSION);
+        agm.serialize(writer);
+        heavy.serialize(writer);
+    }
+
+    static JoinKeySketch deserialize(BinaryReader& reader) {
+        if (reader.read<uint32_t>() != FORMAT_VERSION) {
+            throw std::runtime_error("JoinKeySketch: unsupported serialized sketch version");
+        }
+        JoinKeySketch result;
+        result.agm = FastAGMSketch::deserialize(reader);
+        result.heavy.deserialize(reader);
+        result.residualCurrent = false;
+        result.finalize();
+        return result;
+    }
+};
@@ -0,0 +1,323 @@
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "column_store.h"
+
+// Streams a CSV file as written by Postgres' \copy ... csv: fields are
+// separated by commas, quoted with double quotes, and an unquoted empty field
+// is NULL. The escape character inside quotes is a doubled quote by default;
+// the CWI dump of IMDB needs a backslash instead. Chunks are read ahead by a
+// background thread so parsing overlaps with disk reads.
+class CsvReader {
+private:
+    static const size_t CHUNK_SIZE = 4 << 20;
+
+    std::ifstream file;
+    std::string path;
+    char escape;
+
+    // Double buffer filled by the reader thread
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::string pending;
+    bool pendingReady = false;
+    bool exhausted = false;
+    bool stopping = false;
+    std::thread prefetcher;
+
+    std::string chunk;
+    size_t pos = 0;
+    bool endOfData = false;
+    uint64_t line = 1;
+
+    void prefetch() {
+        std::string buffer;
+        while (true) {
+            buffer.resize(CHUNK_SIZE);
+            file.read(&buffer[0], buffer.size());
+            buffer.resize(static_cast<size_t>(file.gcount()));
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&]() { return !pendingReady || stopping; });
+            if (stopping) return;
+            if (buffer.empty()) {
+                exhausted = true;
+                changed.notify_all();
+                return;
+            }
+            pending.swap(buffer);
+            pendingReady = true;
+            changed.notify_all();
+        }
+    }
+
+    // Makes the next byte available in chunk; false at end of file
+    bool fill() {
+        if (pos < chunk.size()) return true;
+        if (endOfData) return false;
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&]() { return pendingReady || exhausted; });
+        if (!pendingReady) {
+            endOfData = true;
+            return false;
+        }
+        chunk.swap(pending);
+        pendingReady = false;
+        pos = 0;
+        changed.notify_all();
+        return true;
+    }
+
+public:
+    struct Field {
+        std::string value;
+        bool isNull = false;
+    };
+
+    CsvReader(const std::string& path, char escape) : file(path, std::ios::binary), path(path), escape(escape) {
+        if (!file.is_open()) throw std::runtime_error("Could not open " + path);
+        prefetcher = std::thread(&CsvReader::prefetch, this);
+    }
+
+    ~CsvReader() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        changed.notify_all();
+        prefetcher.join();
+    }
+
+    CsvReader(const CsvReader&) = delete;
+    CsvReader& operator=(const CsvReader&) = delete;
+
+    uint64_t lineNumber() const { return line; }
+
+    // Reads one record into fields (reusing their storage); false at end of file
+    bool next(std::vector<Field>& fields, size_t& count) {
+        count = 0;
+        if (!fill()) return false;
+        while (true) {
+            if (fields.size() == count) fields.emplace_back();
+            Field& field = fields[count++];
+            field.value.clear();
+            field.isNull = true;
+
+            bool quoted = false;
+            while (fill()) {
+                char c = chunk[pos];
+                if (quoted) {
+                    pos++;
+                    if (c == escape && escape != '"') {
+                        if (!fill()) throw std::runtime_error(path + ":" + std::to_string(line) + ": dangling escape");
+                        c = chunk[pos++];
+                    } else if (c == '"') {
+                        // A doubled quote is a literal quote, a single one ends the quoted section
+                        if (fill() && chunk[pos] == '"') {
+                            pos++;
+                        } else {
+                            quoted = false;
+                            continue;
+                        }
+                    }
+                    if (c == '\n') line++;
+                    field.value += c;
+                    continue;
+                }
+                if (c == ',' || c == '\n') break;
+                pos++;
+                if (c == '"') {
+                    quoted = true;
+                    field.isNull = false;
+                    continue;
+                }
+                if (c == '\r') continue;
+                field.value += c;
+                field.isNull = false;
+            }
+            if (quoted) throw std::runtime_error(path + ":" + std::to_string(line) + ": unterminated quoted field");
+
+            if (!fill()) return true;
+            char separator = chunk[pos++];
+            if (separator == '\n') {
+                line++;
+                return true;
+            }
+        }
+    }
+};
+
+struct LoaderOptions {
+    std::string schemaPath = "job/schema.sql";
+    std::string csvDirectory;
+    std::string outputDirectory;
+    std::vector<std::string> tables;
+    int jobs = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    char escape = '"';
+};
+
+// Converts <table>.csv into one column file per schema column under
+// <output>/<table>. The table is written to a temporary directory and renamed
+// into place, so a store never holds half-loaded tables.
+static uint64_t loadTable(const TableSchema& table, const LoaderOptions& options) {
+    namespace fs = std::filesystem;
+    fs::path finalDirectory = fs::path(options.outputDirectory) / table.name;
+    fs::path tmpDirectory = fs::path(options.outputDirectory) / (table.name + ".tmp");
+    fs::remove_all(tmpDirectory);
+    fs::create_directories(tmpDirectory);
+
+    std::vector<std::unique_ptr<ColumnWriter>> writers;
+    for (const auto& column : table.columns) {
+        writers.push_back(std::make_unique<ColumnWriter>((tmpDirectory / column.name).string(), column.type));
+    }
+
+    std::string csvPath = (fs::path(options.csvDirectory) / (table.name + ".csv")).string();
+    CsvReader reader(csvPath, options.escape);
+    std::vector<CsvReader::Field> fields;
+    size_t count = 0;
+    uint64_t rows = 0;
+    while (true) {
+        uint64_t line = reader.lineNumber();
+        if (!reader.next(fields, count)) break;
+        if (count != writers.size()) {
+            throw std::runtime_error(csvPath + ":" + std::to_string(line) + ": expected " +
+                                     std::to_string(writers.size()) + " fields, found " + std::to_string(count));
+        }
+        for (size_t i = 0; i < count; i++) {
+            const CsvReader::Field& field = fields[i];
+            ColumnWriter& writer = *writers[i];
+            if (field.isNull) {
+                writer.appendNull();
+            } else if (writer.columnType() == ColumnType::Text) {
+                writer.appendText(field.value);
+            } else {
+                int32_t value = 0;
+                const char* end = field.value.data() + field.value.size();
+                auto [ptr, ec] = std::from_chars(field.value.data(), end, value);
+                if (ec != std::errc() || ptr != end || value == column_format::INTEGER_NULL) {
+                    throw std::runtime_error(csvPath + ":" + std::to_string(line) + ": invalid integer '" +
+                                             field.value + "' in " + table.name + "." + table.columns[i].name);
+                }
+                writer.appendInteger(value);
+            }
+        }
+        rows++;
+    }
+    for (auto& writer : writers) {
+        writer->finish();
+    }
+
+    fs::remove_all(finalDirectory);
+    fs::rename(tmpDirectory, finalDirectory);
+    return rows;
+}
+
+static void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [--schema FILE] [--jobs N] [--table NAME]... [--backslash-escape]\n"
+              << "       <csv-dir> <output-dir>\n"
+              << "  Converts the IMDB CSV files (one <table>.csv per table in the schema, default\n"
+              << "  job/schema.sql) into the column store read by main --column-store.\n"
+              << "  --table limits loading to the named tables; --backslash-escape reads the CWI\n"
+              << "  imdb.tgz dump, whose quoted fields escape with a backslash.\n";
+}
+
+int main(int argc, char* argv[]) {
+    LoaderOptions options;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--schema" && hasValue) {
+            options.schemaPath = argv[++i];
+        } else if (arg == "--jobs" && hasValue) {
+            options.jobs = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--table" && hasValue) {
+            options.tables.push_back(argv[++i]);
+        } else if (arg == "--backslash-escape") {
+            options.escape = '\\';
+        } else if (arg == "--help" || arg.rfind("--", 0) == 0) {
+            printUsage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.size() != 2) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    options.csvDirectory = paths[0];
+    options.outputDirectory = paths[1];
+
+    try {
+        std::ifstream schemaFile(options.schemaPath);
+        if (!schemaFile.is_open()) throw std::runtime_error("Could not open schema " + options.schemaPath);
+        std::stringstream ddl;
+        ddl << schemaFile.rdbuf();
+        std::vector<TableSchema> tables = TableSchema::parse(ddl.str());
+        if (!options.tables.empty()) {
+            tables.erase(std::remove_if(tables.begin(), tables.end(), [&](const TableSchema& table) {
+                return std::find(options.tables.begin(), options.tables.end(), table.name) == options.tables.end();
+            }), tables.end());
+        }
+        std::filesystem::create_directories(options.outputDirectory);
+
+        // Largest files first so cast_info does not start last and trail the others
+        auto csvSize = [&](const TableSchema& table) -> uintmax_t {
+            std::error_code ec;
+            uintmax_t size = std::filesystem::file_size(
+                std::filesystem::path(options.csvDirectory) / (table.name + ".csv"), ec);
+            return ec ? 0 : size;
+        };
+        std::stable_sort(tables.begin(), tables.end(), [&](const TableSchema& a, const TableSchema& b) {
+            return csvSize(a) > csvSize(b);
+        });
+
+        auto start = std::chrono::steady_clock::now();
+        std::atomic<size_t> next{0};
+        std::mutex outputMutex;
+        std::atomic<int> failures{0};
+        std::vector<std::thread> threads;
+        int workers = std::min<int>(options.jobs, std::max<size_t>(1, tables.size()));
+        for (int i = 0; i < workers; i++) {
+            threads.emplace_back([&]() {
+                for (size_t t = next++; t < tables.size(); t = next++) {
+                    try {
+                        uint64_t rows = loadTable(tables[t], options);
+                        std::lock_guard<std::mutex> lock(outputMutex);
+                        std::cout << tables[t].name << ": " << rows << " rows" << std::endl;
+                    } catch (const std::exception& e) {
+                        failures++;
+                        std::lock_guard<std::mutex> lock(outputMutex);
+                        std::cerr << tables[t].name << ": " << e.what() << std::endl;
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        double elapsedMs = std::chrono::duration<double, std::milli>(
+            std::chrono::steady_clock::now() - start).count();
+        std::cout << "Loaded " << tables.size() - failures << "/" << tables.size() << " tables with " << workers
+                  << " workers in " << elapsedMs << " ms -> " << options.outputDirectory << std::endl;
+        return failures == 0 ? 0 : 1;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,426 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "cardinality_estimator.h"
+#include "join_graph.h"
+
+// Binary join tree over the relations of a JoinGraph, stored as a flat node array
+struct JoinTree {
+    struct Node {
+        int relation = -1;  // leaf relation id, -1 for joins
+        int left = -1;
+        int right = -1;
+        uint64_t relations = 0;
+        double cardinality = 0;
+    };
+
+    std::vector<Node> nodes;
+    int root = -1;
+
+    int addLeaf(int relation, double cardinality) {
+        Node node;
+        node.relation = relation;
+        node.relations = JoinGraph::bit(relation);
+        node.cardinality = cardinality;
+        nodes.push_back(node);
+        return root = static_cast<int>(nodes.size()) - 1;
+    }
+
+    int addJoin(int left, int right, double cardinality) {
+        Node node;
+        node.left = left;
+        node.right = right;
+        node.relations = nodes[left].relations | nodes[right].relations;
+        node.cardinality = cardinality;
+        nodes.push_back(node);
+        return root = static_cast<int>(nodes.size()) - 1;
+    }
+
+    bool empty() const { return root < 0; }
+
+    // C_out: sum of the cardinalities of all join results
+    double cost() const {
+        double total = 0;
+        for (const auto& node : nodes) {
+            if (node.relation < 0) total += node.cardinality;
+        }
+        return total;
+    }
+
+    // Formats the tree as "(a ⨝ (b ⨝ c))" using table names
+    std::string toString(const JoinGraph& graph) const {
+        return empty() ? "" : format(graph, root);
+    }
+
+private:
+    std::string format(const JoinGraph& graph, int node) const {
+        const Node& n = nodes[node];
+        if (n.relation >= 0) return graph.relation(n.relation).table;
+        return "(" + format(graph, n.left) + " ⨝ " + format(graph, n.right) + ")";
+    }
+};
+
+// Exact bushy join enumeration with DPccp (Moerkotte & Neumann, VLDB 2006)
+// under the C_out cost model. Only connected subgraphs and their connected
+// complements are visited, and the best plan per subset lives in a flat memo
+// table indexed by the subset bitmask.
+class DPccpEnumerator {
+public:
+    // The memo holds 2^n entries, which bounds the query size handled exactly
+    static const int MAX_RELATIONS = 20;
+
+private:
+    struct MemoEntry {
+        double cost = std::numeric_limits<double>::infinity();
+        double cardinality = -1;
+        uint64_t left = 0;
+    };
+
+    const CardinalityEstimator& estimator;
+    const JoinGraph& graph;
+    std::vector<MemoEntry> memo;
+    std::chrono::steady_clock::time_point deadline;
+    uint64_t emitted = 0;
+    bool timedOut = false;
+
+    double cardinality(uint64_t subset) {
+        MemoEntry& entry = memo[subset];
+        if (entry.cardinality < 0) entry.cardinality = estimator.estimate(subset);
+        return entry.cardinality;
+    }
+
+    // Bits 0..i, the relations that precede or equal i in enumeration order
+    static uint64_t prefix(int i) {
+        return i >= 63 ? ~uint64_t(0) : (uint64_t(1) << (i + 1)) - 1;
+    }
+
+    static int lowest(uint64_t subset) {
+        return __builtin_ctzll(subset);
+    }
+
+    void emitCsgCmp(uint64_t s1, uint64_t s2) {
+        // Reading the clock on every pair would dominate small queries
+        if ((++emitted & 0xfff) == 0 && std::chrono::steady_clock::now() > deadline) {
+            timedOut = true;
+        }
+        uint64_t s = s1 | s2;
+        double cost = cardinality(s) + memo[s1].cost + memo[s2].cost;
+        MemoEntry& entry = memo[s];
+        if (cost < entry.cost) {
+            entry.cost = cost;
+            entry.left = s1;
+        }
+    }
+
+    void enumerateCmpRec(uint64_t s1, uint64_t s2, uint64_t excluded) {
+        uint64_t n = graph.neighbors(s2, excluded);
+        if (!n || timedOut) return;
+        for (uint64_t sub = n & -n; sub; sub = (sub - n) & n) {
+            emitCsgCmp(s1, s2 | sub);
+        }
+        for (uint64_t sub = n & -n; sub; sub = (sub - n) & n) {
+            enumerateCmpRec(s1, s2 | sub, excluded | n);
+        }
+    }
+
+    void emitCsg(uint64_t s1) {
+        uint64_t excluded = s1 | prefix(lowest(s1));
+        uint64_t n = graph.neighbors(s1, excluded);
+        for (int i = graph.size() - 1; i >= 0; i--) {
+            uint64_t s2 = JoinGraph::bit(i);
+            if (!(n & s2)) continue;
+            emitCsgCmp(s1, s2);
+            enumerateCmpRec(s1, s2, excluded | (prefix(i) & n));
+        }
+    }
+
+    void enumerateCsgRec(uint64_t s, uint64_t excluded) {
+        uint64_t n = graph.neighbors(s, excluded);
+        if (!n || timedOut) return;
+        for (uint64_t sub = n & -n; sub; sub = (sub - n) & n) {
+            emitCsg(s | sub);
+        }
+        for (uint64_t sub = n & -n; sub; sub = (sub - n) & n) {
+            enumerateCsgRec(s | sub, excluded | n);
+        }
+    }
+
+    int buildTree(JoinTree& tree, uint64_t subset) const {
+        if ((subset & (subset - 1)) == 0) {
+            return tree.addLeaf(lowest(subset), memo[subset].cardinality);
+        }
+        uint64_t left = memo[subset].left;
+        uint64_t right = subset ^ left;
+        // Keep the side with fewer relations first, like the left-deep "(t ⨝ plan)" form
+        if (__builtin_popcountll(right) < __builtin_popcountll(left)) std::swap(left, right);
+        int l = buildTree(tree, left);
+        int r = buildTree(tree, right);
+        return tree.addJoin(l, r, memo[subset].cardinality);
+    }
+
+    // Joins the connected components of a disconnected graph by cross products, smallest first
+    void combineComponents() {
+        std::vector<uint64_t> components;
+        uint64_t remaining = graph.allRelations();
+        while (remaining) {
+            uint64_t component = remaining & -remaining;
+            uint64_t frontier = component;
+            while (frontier) {
+                frontier = graph.neighbors(component, 0);
+                component |= frontier;
+            }
+            components.push_back(component);
+            remaining &= ~component;
+        }
+        std::sort(components.begin(), components.end(),
+            [this](uint64_t a, uint64_t b) { return memo[a].cardinality < memo[b].cardinality; });
+
+        uint64_t current = components[0];
+        for (size_t i = 1; i < components.size(); i++) {
+            emitCsgCmp(components[i], current);
+            current |= components[i];
+        }
+    }
+
+public:
+    // Enumeration stops at deadline, in which case run() returns an empty tree
+    explicit DPccpEnumerator(const CardinalityEstimator& estimator,
+                             std::chrono::steady_clock::time_point deadline =
+                                 std::chrono::steady_clock::time_point::max())
+        : estimator(estimator), graph(estimator.joinGraph()), deadline(deadline) {}
+
+    JoinTree run() {
+        int n = graph.size();
+        if (n == 0) return JoinTree();
+        if (n > MAX_RELATIONS) {
+            throw std::runtime_error("DPccp: " + std::to_string(n) + " relations exceed the limit of " +
+                                     std::to_string(MAX_RELATIONS));
+        }
+
+        memo.assign(size_t(1) << n, MemoEntry());
+        for (int i = 0; i < n; i++) {
+            MemoEntry& leaf = memo[JoinGraph::bit(i)];
+            leaf.cost = 0;
+            leaf.cardinality = estimator.estimate(JoinGraph::bit(i));
+        }
+
+        for (int i = n - 1; i >= 0 && !timedOut; i--) {
+            uint64_t start = JoinGraph::bit(i);
+            emitCsg(start);
+            enumerateCsgRec(start, prefix(i));
+        }
+        if (timedOut) return JoinTree();
+
+        if (memo[graph.allRelations()].left == 0 && n > 1) {
+            combineComponents();
+        }
+
+        JoinTree tree;
+        buildTree(tree, graph.allRelations());
+        return tree;
+    }
+};
+
+// Anytime join ordering for queries too large (or too dense) for exact DP.
+// Starting from a given plan it tries GOO, linearized DP over the best plan's
+// relation order and randomized iterative improvement, always keeping the
+// cheapest plan seen, and returns it once the time budget is spent.
+class AnytimeEnumerator {
+private:
+    const CardinalityEstimator& estimator;
+    const JoinGraph& graph;
+    std::chrono::steady_clock::time_point deadline;
+    JoinTree best;
+    double bestCost;
+
+    bool expired() const {
+        return std::chrono::steady_clock::now() > deadline;
+    }
+
+    bool connected(uint64_t a, uint64_t b) const {
+        return (graph.neighbors(a, 0) & b) != 0;
+    }
+
+    void offer(const JoinTree& candidate) {
+        if (candidate.empty()) return;
+        double cost = candidate.cost();
+        if (cost < bestCost) {
+            best = candidate;
+            bestCost = cost;
+        }
+    }
+
+    // Greedy Operator Ordering: repeatedly join the two subtrees with the smallest result
+    JoinTree greedyOperatorOrdering() const {
+        JoinTree tree;
+        std::vector<int> roots;
+        for (int i = 0; i < graph.size(); i++) {
+            roots.push_back(tree.addLeaf(i, estimator.estimate(JoinGraph::bit(i))));
+        }
+
+        while (roots.size() > 1) {
+            if (expired()) return JoinTree();
+            size_t bestI = 0, bestJ = 1;
+            double bestSize = std::numeric_limits<double>::infinity();
+            bool bestConnected = false;
+            for (size_t i = 0; i < roots.size(); i++) {
+                for (size_t j = i + 1; j < roots.size(); j++) {
+                    uint64_t a = tree.nodes[roots[i]].relations;
+                    uint64_t b = tree.nodes[roots[j]].relations;
+                    bool isConnected = connected(a, b);
+                    if (bestConnected && !isConnected) continue;
+                    double size = estimator.estimate(a | b);
+                    if ((isConnected && !bestConnected) || size < bestSize) {
+                        bestI = i;
+                        bestJ = j;
+                        bestSize = size;
+                        bestConnected = isConnected;
+                    }
+                }
+            }
+            int joined = tree.addJoin(roots[bestI], roots[bestJ], bestSize);
+            roots[bestI] = joined;
+            roots.erase(roots.begin() + bestJ);
+        }
+        tree.root = roots[0];
+        return tree;
+    }
+
+    static void leafOrder(const JoinTree& tree, int node, std::vector<int>& order) {
+        const JoinTree::Node& n = tree.nodes[node];
+        if (n.relation >= 0) {
+            order.push_back(n.relation);
+            return;
+        }
+        leafOrder(tree, n.left, order);
+        leafOrder(tree, n.right, order);
+    }
+
+    // Linearized DP (Neumann & Radke, SIGMOD 2018): optimal bushy plan whose
+    // subtrees cover contiguous ranges of a fixed relation order, O(n^3)
+    JoinTree linearizedDP(const std::vector<int>& order) const {
+        size_t n = order.size();
+        std::vector<uint64_t> sets(n * n, 0);
+        std::vector<double> costs(n * n, 0);
+        std::vector<size_t> splits(n * n, 0);
+        for (size_t i = 0; i < n; i++) {
+            sets[i * n + i] = JoinGraph::bit(order[i]);
+        }
+
+        for (size_t length = 2; length <= n; length++) {
+            if (expired()) return JoinTree();
+            for (size_t i = 0; i + length <= n; i++) {
+                size_t j = i + length - 1;
+                uint64_t set = sets[i * n + j - 1] | JoinGraph::bit(order[j]);
+                double card = estimator.estimate(set);
+                double bestCostHere = std::numeric_limits<double>::infinity();
+                for (size_t k = i; k < j; k++) {
+                    double cost = costs[i * n + k] + costs[(k + 1) * n + j];
+                    // Cross products are only acceptable when no split avoids them
+                    if (!connected(sets[i * n + k], sets[(k + 1) * n + j])) cost += card * 1e3;
+                    if (cost < bestCostHere) {
+                        bestCostHere = cost;
+                        splits[i * n + j] = k;
+                    }
+                }
+                sets[i * n + j] = set;
+                costs[i * n + j] = bestCostHere + card;
+            }
+        }
+
+        JoinTree tree;
+        buildRange(tree, order, splits, sets, 0, n - 1);
+        return tree;
+    }
+
+    int buildRange(JoinTree& tree, const std::vector<int>& order, const std::vector<size_t>& splits,
+                   const std::vector<uint64_t>& sets, size_t i, size_t j) const {
+        size_t n = order.size();
+        if (i == j) return tree.addLeaf(order[i], estimator.estimate(JoinGraph::bit(order[i])));
+        size_t k = splits[i * n + j];
+        int left = buildRange(tree, order, splits, sets, i, k);
+        int right = buildRange(tree, order, splits, sets, k + 1, j);
+        return tree.addJoin(left, right, estimator.estimate(sets[i * n + j]));
+    }
+
+    // Hill climbing with rotations and exchanges of a join and its join child.
+    // Either move rebuilds only the child, so the cost delta is one estimate.
+    void iterativeImprovement() {
+        JoinTree tree = best;
+        double cost = bestCost;
+        std::vector<int> joins;
+        for (size_t i = 0; i < tree.nodes.size(); i++) {
+            if (tree.nodes[i].relation < 0) joins.push_back(static_cast<int>(i));
+        }
+        if (joins.size() < 2) return;
+
+        std::mt19937 gen(static_cast<unsigned>(graph.size()) * 7919u + static_cast<unsigned>(joins.size()));
+        // Give up once a local optimum has resisted many random moves
+        const uint64_t patience = 1024 * joins.size();
+        uint64_t lastImprovement = 0;
+        for (uint64_t iteration = 0; iteration - lastImprovement < patience; iteration++) {
+            if ((iteration & 0xff) == 0 && expired()) break;
+
+            JoinTree::Node& parent = tree.nodes[joins[gen() % joins.size()]];
+            bool childOnLeft = gen() & 1;
+            int childIndex = childOnLeft ? parent.left : parent.right;
+            JoinTree::Node& child = tree.nodes[childIndex];
+            if (child.relation >= 0) continue;
+
+            // parent = child ⨝ x, child = a ⨝ b; move a out and pair b with x
+            int x = childOnLeft ? parent.right : parent.left;
+            bool moveLeft = gen() & 1;
+            int a = moveLeft ? child.left : child.right;
+            int b = moveLeft ? child.right : child.left;
+            uint64_t newChildSet = tree.nodes[b].relations | tree.nodes[x].relations;
+            if (!connected(tree.nodes[b].relations, tree.nodes[x].relations)) continue;
+
+            double newCard = estimator.estimate(newChildSet);
+            double newCost = cost - child.cardinality + newCard;
+            if (newCost > cost) continue;
+            if (newCost < cost) lastImprovement = iteration;
+
+            child.left = b;
+            child.right = x;
+            child.relations = newChildSet;
+            child.cardinality = newCard;
+            parent.left = a;
+            parent.right = childIndex;
+            cost = newCost;
+            if (cost < bestCost) {
+                best = tree;
+                bestCost = cost;
+            }
+        }
+    }
+
+public:
+    AnytimeEnumerator(const CardinalityEstimator& estimator, std::chrono::steady_clock::time_point deadline)
+        : estimator(estimator), graph(estimator.joinGraph()), deadline(deadline),
+          bestCost(std::numeric_limits<double>::infinity()) {}
+
+    // initial must be a complete plan; it is returned unchanged if nothing better is found in time
+    JoinTree run(const JoinTree& initial) {
+        offer(initial);
+        if (graph.size() < 3) return best;
+
+        offer(greedyOperatorOrdering());
+        if (!expired()) {
+            std::vector<int> order;
+            leafOrder(best, best.root, order);
+            offer(linearizedDP(order));
+        }
+        if (!expired()) {
+            iterativeImprovement();
+        }
+        return best;
+    }
+};
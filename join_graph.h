@@ -0,0 +1,208 @@
+#pragma once
+
+#include <cstdint>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Join graph of a query: relations are integer ids (one per FROM alias) and
+// relation subsets are 64-bit masks with bit i standing for relation i.
+class JoinGraph {
+public:
+    static const int MAX_RELATIONS = 64;
+
+    struct Relation {
+        std::string alias;
+        std::string table;
+        // Conjunction of the relation's local predicates in SQL over alias; empty when unfiltered
+        std::string filter;
+    };
+
+    struct Predicate {
+        int left;
+        std::string leftColumn;
+        int right;
+        std::string rightColumn;
+    };
+
+    // Columns that equi-join predicates (transitively) force to be equal
+    struct ColumnRef {
+        int relation;
+        std::string column;
+    };
+    using EquivalenceClass = std::vector<ColumnRef>;
+
+private:
+    std::vector<Relation> relations;
+    std::unordered_map<std::string, int> aliasIndex;
+    std::vector<Predicate> predicates;
+    std::vector<uint64_t> neighborMasks;
+
+    // EnumerateCsgRec of DPccp, pruned to subsets of at most maxRelations relations
+    void connectedSubsets(uint64_t subset, uint64_t excluded, int maxRelations, std::vector<uint64_t>& out) const {
+        uint64_t n = neighbors(subset, excluded);
+        if (!n || __builtin_popcountll(subset) >= maxRelations) return;
+        for (uint64_t sub = n & -n; sub; sub = (sub - n) & n) {
+            if (__builtin_popcountll(subset | sub) <= maxRelations) out.push_back(subset | sub);
+        }
+        for (uint64_t sub = n & -n; sub; sub = (sub - n) & n) {
+            connectedSubsets(subset | sub, excluded | n, maxRelations, out);
+        }
+    }
+
+    int findRoot(std::vector<int>& parent, int i) const {
+        while (parent[i] != i) {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    }
+
+public:
+    static uint64_t bit(int relation) {
+        return uint64_t(1) << relation;
+    }
+
+    int addRelation(const std::string& alias, const std::string& table) {
+        auto it = aliasIndex.find(alias);
+        if (it != aliasIndex.end()) return it->second;
+        if (relations.size() >= MAX_RELATIONS) {
+            throw std::runtime_error("JoinGraph: more than 64 relations are not supported");
+        }
+        aliasIndex[alias] = static_cast<int>(relations.size());
+        relations.push_back({alias, table, ""});
+        neighborMasks.push_back(0);
+        return static_cast<int>(relations.size()) - 1;
+    }
+
+    void addFilter(int relation, const std::string& predicate) {
+        std::string& filter = relations[relation].filter;
+        if (!filter.empty()) filter += " AND ";
+        filter += "(" + predicate + ")";
+    }
+
+    void addPredicate(int left, const std::string& leftColumn, int right, const std::string& rightColumn) {
+        predicates.push_back({left, leftColumn, right, rightColumn});
+        if (left != right) {
+            neighborMasks[left] |= bit(right);
+            neighborMasks[right] |= bit(left);
+        }
+    }
+
+    // -1 when the alias is not part of the query
+    int relationIndex(const std::string& alias) const {
+        auto it = aliasIndex.find(alias);
+        return it == aliasIndex.end() ? -1 : it->second;
+    }
+
+    int size() const { return static_cast<int>(relations.size()); }
+    const Relation& relation(int i) const { return relations[i]; }
+    const std::vector<Predicate>& joinPredicates() const { return predicates; }
+    uint64_t neighbors(int relation) const { return neighborMasks[relation]; }
+
+    uint64_t allRelations() const {
+        return relations.size() == MAX_RELATIONS ? ~uint64_t(0) : bit(size()) - 1;
+    }
+
+    // Relations outside subset that share a predicate with it
+    uint64_t neighbors(uint64_t subset, uint64_t exclude) const {
+        uint64_t result = 0;
+        for (uint64_t rest = subset; rest; rest &= rest - 1) {
+            result |= neighborMasks[__builtin_ctzll(rest)];
+        }
+        return result & ~subset & ~exclude;
+    }
+
+    // Every connected subset of at most maxRelations relations (0: no limit), each exactly once
+    std::vector<uint64_t> connectedSubsets(int maxRelations = 0) const {
+        if (maxRelations <= 0) maxRelations = size();
+        std::vector<uint64_t> result;
+        for (int i = size() - 1; i >= 0; i--) {
+            result.push_back(bit(i));
+            uint64_t preceding = i >= 63 ? ~uint64_t(0) : (uint64_t(1) << (i + 1)) - 1;
+            connectedSubsets(bit(i), preceding, maxRelations, result);
+        }
+        return result;
+    }
+
+    // SELECT select over the relations in subset, with their filters and the join predicates among them.
+    // crossJoins lists the relations with CROSS JOIN instead of commas, which fixes their join
+    // order in Postgres when join_collapse_limit is 1.
+    std::string subsetQuery(uint64_t subset, const std::string& select, bool crossJoins = false) const {
+        std::string from;
+        std::string where;
+        auto addCondition = [&](const std::string& condition) {
+            where += where.empty() ? " WHERE " : " AND ";
+            where += condition;
+        };
+        for (uint64_t rest = subset; rest; rest &= rest - 1) {
+            const Relation& relation = relations[__builtin_ctzll(rest)];
+            from += (from.empty() ? "" : crossJoins ? " CROSS JOIN " : ", ") + relation.table + " AS " + relation.alias;
+            if (!relation.filter.empty()) addCondition(relation.filter);
+        }
+        for (const auto& p : predicates) {
+            if ((subset & bit(p.left)) && (subset & bit(p.right))) {
+                addCondition(relations[p.left].alias + "." + p.leftColumn + " = " +
+                             relations[p.right].alias + "." + p.rightColumn);
+            }
+        }
+        return "SELECT " + select + " FROM " + from + where + ";";
+    }
+
+    bool isConnected(uint64_t subset) const {
+        if (!subset) return false;
+        uint64_t reached = subset & -subset;
+        uint64_t frontier = reached;
+        while (frontier) {
+            frontier = neighbors(frontier, ~subset) & ~reached;
+            reached |= frontier;
+        }
+        return reached == subset;
+    }
+
+    // Groups join columns into classes of transitively equal columns, e.g.
+    // {t.id, mk.movie_id, ci.movie_id}; each class lists a relation at most once
+    std::vector<EquivalenceClass> equivalenceClasses() const {
+        std::vector<ColumnRef> columns;
+        std::unordered_map<std::string, int> columnIndex;
+        auto columnId = [&](int relation, const std::string& column) {
+            std::string key = std::to_string(relation) + "." + column;
+            auto it = columnIndex.find(key);
+            if (it != columnIndex.end()) return it->second;
+            columnIndex[key] = static_cast<int>(columns.size());
+            columns.push_back({relation, column});
+            return static_cast<int>(columns.size()) - 1;
+        };
+
+        std::vector<std::pair<int, int>> unions;
+        for (const auto& p : predicates) {
+            unions.push_back({columnId(p.left, p.leftColumn), columnId(p.right, p.rightColumn)});
+        }
+
+        std::vector<int> parent(columns.size());
+        std::iota(parent.begin(), parent.end(), 0);
+        for (auto [a, b] : unions) {
+            parent[findRoot(parent, a)] = findRoot(parent, b);
+        }
+
+        std::vector<EquivalenceClass> classes;
+        std::unordered_map<int, int> classIndex;
+        for (size_t i = 0; i < columns.size(); i++) {
+            int root = findRoot(parent, static_cast<int>(i));
+            auto it = classIndex.find(root);
+            if (it == classIndex.end()) {
+                it = classIndex.emplace(root, static_cast<int>(classes.size())).first;
+                classes.emplace_back();
+            }
+            EquivalenceClass& cls = classes[it->second];
+            bool seen = false;
+            for (const auto& ref : cls) {
+                seen = seen || ref.relation == columns[i].relation;
+            }
+            if (!seen) cls.push_back(columns[i]);
+        }
+        return classes;
+    }
+};
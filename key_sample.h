@@ -0,0 +1,242 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "cardinality_estimator.h"
+#include "heavy_hitters.h"
+#include "join_graph.h"
+
+// Correlated sample of a join-key column: every row whose key hashes at or
+// below a threshold, with exact per-key counts. The threshold starts at the
+// top of the hash space and is lowered as keys arrive, so at most KEYS
+// distinct keys are kept; columns with fewer keys are kept whole. Every column
+// hashes keys the same way, so below a common threshold two samples hold
+// exactly the same key values of both columns (Vengerov et al., correlated
+// sampling). The most frequent keys are tracked alongside, since a sample of
+// keys either misses or wildly overweights them.
+class KeySample {
+public:
+    static constexpr size_t KEYS = 4096;
+
+    // Ordered by hash, then key, so the part below any threshold is a prefix
+    using Entries = std::map<std::pair<uint64_t, int64_t>, int64_t>;
+
+private:
+    static constexpr uint64_t SUMMARY_SEED = 0x13198a2e03707344ULL;
+
+    Entries entries;
+    uint64_t limit = UINT64_MAX;
+    double totalRows = 0;
+    BasicHeavyHitterSummary<32, 4, 2048> heavy;
+
+    // Lowers the threshold below the largest sampled hash until at most KEYS keys remain
+    void trim() {
+        while (entries.size() > KEYS) {
+            limit = std::prev(entries.end())->first.first - 1;
+            while (!entries.empty() && std::prev(entries.end())->first.first > limit) {
+                entries.erase(std::prev(entries.end()));
+            }
+        }
+    }
+
+public:
+    KeySample() : heavy(SUMMARY_SEED) {}
+
+    // splitmix64: sampling by hash is only unbiased when hashes are uniform. The increment keeps
+    // key 0, often the most frequent, from hashing to 0 and being sampled in every column.
+    static uint64_t hash(int64_t key) {
+        uint64_t x = static_cast<uint64_t>(key) + 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    // Share of the hash space at or below threshold
+    static double coverage(uint64_t threshold) {
+        return threshold == UINT64_MAX ? 1.0 : std::ldexp(static_cast<double>(threshold) + 1.0, -64);
+    }
+
+    void update(int64_t key) {
+        totalRows += 1;
+        heavy.update(key, 1);
+        uint64_t h = hash(key);
+        if (h > limit) return;
+        if (++entries[{h, key}] == 1 && entries.size() > KEYS) trim();
+    }
+
+    template <typename Key>
+    void update(const Key* keys, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            update(static_cast<int64_t>(keys[i]));
+        }
+    }
+
+    // Both samples hold every key below the lower threshold, so the union below it is exact
+    void merge(const KeySample& other) {
+        limit = std::min(limit, other.limit);
+        while (!entries.empty() && std::prev(entries.end())->first.first > limit) {
+            entries.erase(std::prev(entries.end()));
+        }
+        for (const auto& [key, count] : other.entries) {
+            if (key.first > limit) break;
+            entries[key] += count;
+        }
+        totalRows += other.totalRows;
+        heavy.merge(other.heavy);
+        trim();
+    }
+
+    // Rows seen, sampled or not
+    double count() const { return totalRows; }
+
+    uint64_t threshold() const { return limit; }
+
+    const Entries& sampled() const { return entries; }
+
+    // Most frequent keys with upper bounds of their counts, exact while at most 32 distinct keys were seen
+    std::vector<std::pair<int64_t, int64_t>> heavyHitters() const { return heavy.entries(); }
+
+    // Rows of key, when known: exactly below threshold(), as an upper bound for a heavy hitter
+    bool frequency(uint64_t keyHash, int64_t key, int64_t& rows) const {
+        if (keyHash <= limit) {
+            auto it = entries.find({keyHash, key});
+            rows = it == entries.end() ? 0 : it->second;
+            return true;
+        }
+        return heavy.tracked(key, rows);
+    }
+};
+
+// Cardinality estimation by joining correlated key samples. Within an
+// equivalence class, the relations of a subset are joined on the key directly
+// (instead of chaining pairwise estimates) in two parts:
+//   - keys heavy in any of them, each contributing the product of its counts;
+//     a relation that neither tracks nor samples the key is assumed to hold it
+//     as often as its average sampled key, the only independence assumption;
+//   - all other keys, joined over the samples below the smallest threshold and
+//     scaled up by the inverse of that threshold's share of the hash space.
+// Distinct classes are combined as independent selectivities, as in
+// SketchEstimator. Joins of small columns are exact.
+class SamplingEstimator final : public CardinalityEstimator {
+public:
+    // Sample of one join column of a relation, taken over the rows passing its local filter
+    using SampleLookup =
+        std::function<const KeySample&(const JoinGraph::Relation& relation, const std::string& column)>;
+
+private:
+    struct ClassMember {
+        int relation;
+        const KeySample* sample;
+    };
+
+    std::vector<double> baseCardinalities;
+    std::vector<std::vector<ClassMember>> classes;
+    // Selectivity per class, keyed by the mask of its members in the subset; many subsets
+    // restrict a class to the same members
+    mutable std::vector<std::unordered_map<uint64_t, double>> selectivities;
+
+    static double joinSelectivity(const std::vector<const KeySample*>& samples) {
+        uint64_t threshold = UINT64_MAX;
+        double denominator = 1.0;
+        std::vector<int64_t> heavyKeys;
+        for (const KeySample* sample : samples) {
+            if (sample->count() <= 0) return 0.0;
+            threshold = std::min(threshold, sample->threshold());
+            denominator *= sample->count();
+            for (const auto& [key, rows] : sample->heavyHitters()) heavyKeys.push_back(key);
+        }
+        std::sort(heavyKeys.begin(), heavyKeys.end());
+        heavyKeys.erase(std::unique(heavyKeys.begin(), heavyKeys.end()), heavyKeys.end());
+        auto isHeavy = [&](int64_t key) { return std::binary_search(heavyKeys.begin(), heavyKeys.end(), key); };
+
+        // Every other key sampled by any relation, below the common threshold
+        std::vector<std::pair<uint64_t, int64_t>> lightKeys;
+        for (const KeySample* sample : samples) {
+            for (const auto& [key, rows] : sample->sampled()) {
+                if (key.first > threshold) break;
+                if (!isHeavy(key.second)) lightKeys.push_back(key);
+            }
+        }
+        std::sort(lightKeys.begin(), lightKeys.end());
+        lightKeys.erase(std::unique(lightKeys.begin(), lightKeys.end()), lightKeys.end());
+
+        double light = 0;
+        std::vector<double> sampledRows(samples.size(), 0);
+        for (const auto& [keyHash, key] : lightKeys) {
+            double product = 1;
+            for (size_t i = 0; i < samples.size(); i++) {
+                int64_t rows = 0;
+                samples[i]->frequency(keyHash, key, rows);
+                sampledRows[i] += static_cast<double>(rows);
+                product *= static_cast<double>(rows);
+            }
+            light += product;
+        }
+
+        double heavy = 0;
+        for (int64_t key : heavyKeys) {
+            uint64_t keyHash = KeySample::hash(key);
+            double product = 1;
+            for (size_t i = 0; i < samples.size() && product > 0; i++) {
+                int64_t rows = 0;
+                if (samples[i]->frequency(keyHash, key, rows)) product *= static_cast<double>(rows);
+                else product *= lightKeys.empty() ? 0.0 : sampledRows[i] / lightKeys.size();
+            }
+            heavy += product;
+        }
+        return (heavy + light / KeySample::coverage(threshold)) / denominator;
+    }
+
+    double classSelectivity(size_t cls, uint64_t subset) const {
+        const auto& members = classes[cls];
+        uint64_t mask = 0;
+        std::vector<const KeySample*> samples;
+        for (size_t i = 0; i < members.size(); i++) {
+            if (!(subset & JoinGraph::bit(members[i].relation))) continue;
+            mask |= JoinGraph::bit(static_cast<int>(i));
+            samples.push_back(members[i].sample);
+        }
+        if (samples.size() < 2) return 1.0;
+
+        auto it = selectivities[cls].find(mask);
+        if (it != selectivities[cls].end()) return it->second;
+        double selectivity = joinSelectivity(samples);
+        selectivities[cls].emplace(mask, selectivity);
+        return selectivity;
+    }
+
+public:
+    // baseCardinalities holds the estimated row count of each relation of graph after its local filter
+    SamplingEstimator(const JoinGraph& graph, std::vector<double> baseCardinalities, const SampleLookup& sampleFor)
+        : CardinalityEstimator(graph), baseCardinalities(std::move(baseCardinalities)) {
+        for (const auto& cls : graph.equivalenceClasses()) {
+            if (cls.size() < 2) continue;
+            std::vector<ClassMember> members;
+            for (const auto& ref : cls) {
+                members.push_back({ref.relation, &sampleFor(graph.relation(ref.relation), ref.column)});
+            }
+            classes.push_back(std::move(members));
+        }
+        selectivities.resize(classes.size());
+    }
+
+protected:
+    double estimateSubset(uint64_t subset) const override {
+        double result = 1.0;
+        for (uint64_t rest = subset; rest; rest &= rest - 1) {
+            result *= std::max(1.0, baseCardinalities[__builtin_ctzll(rest)]);
+        }
+        for (size_t cls = 0; cls < classes.size(); cls++) {
+            result *= classSelectivity(cls, subset);
+        }
+        return result;
+    }
+};
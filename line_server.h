@@ -0,0 +1,193 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <poll.h>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_set>
+#include <vector>
+
+#include "sql_parser.h"
+
+// Serves SQL requests over a Unix domain socket or a pair of file descriptors.
+// A request is the text up to the line that ends its statement with ';' (so
+// `nc -U socket < job/1a.sql` works); the handler's reply is written back as
+// one line. Connections are served by a fixed pool of workers, each of which
+// handles one client at a time, in order. SIGINT and SIGTERM stop the server.
+class LineServer {
+public:
+    // Called with the worker index and the request text; returns the reply without newline
+    using Handler = std::function<std::string(int worker, const std::string& request)>;
+
+private:
+    int workers;
+    Handler handler;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::queue<int> pending;
+    std::unordered_set<int> active;
+    bool closing = false;
+
+    static std::atomic<bool>& stopRequested() {
+        static std::atomic<bool> flag{false};
+        return flag;
+    }
+
+    static void onSignal(int) {
+        stopRequested() = true;
+    }
+
+    // True once sql holds a whole statement: its last token is a ';' outside quotes
+    static bool completeStatement(std::string_view sql) {
+        try {
+            SqlLexer lexer(sql);
+            SqlLexer::Token last;
+            for (SqlLexer::Token token = lexer.next(); token.type != SqlLexer::TokenType::End; token = lexer.next()) {
+                last = token;
+            }
+            return last.isSymbol(";");
+        } catch (const std::exception&) {
+            // An open quote: the statement continues on the next line
+            return false;
+        }
+    }
+
+    static bool writeAll(int fd, const std::string& data) {
+        for (size_t written = 0; written < data.size();) {
+            ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            written += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+public:
+    LineServer(int workers, Handler handler) : workers(std::max(1, workers)), handler(std::move(handler)) {}
+
+    // Answers every request read from in on out until in reaches end of file
+    void serve(int worker, int in, int out) {
+        std::string buffer;
+        std::string request;
+        char chunk[65536];
+        while (true) {
+            size_t newline;
+            while ((newline = buffer.find('\n')) != std::string::npos) {
+                request.append(buffer, 0, newline + 1);
+                buffer.erase(0, newline + 1);
+                bool blank = request.find_first_not_of(" \t\r\n") == std::string::npos;
+                if (blank) {
+                    request.clear();
+                } else if (completeStatement(request)) {
+                    std::string reply = handler(worker, request) + "\n";
+                    request.clear();
+                    if (!writeAll(out, reply)) return;
+                }
+            }
+            ssize_t n = ::read(in, chunk, sizeof(chunk));
+            if (n < 0 && errno == EINTR) {
+                if (stopRequested()) return;
+                continue;
+            }
+            if (n <= 0) break;
+            buffer.append(chunk, static_cast<size_t>(n));
+        }
+        // A final statement without newline or ';' is still answered
+        request += buffer;
+        if (request.find_first_not_of(" \t\r\n") != std::string::npos) {
+            writeAll(out, handler(worker, request) + "\n");
+        }
+    }
+
+    // Accepts clients on socketPath until a stop signal arrives; the socket file is replaced
+    void listen(const std::string& socketPath) {
+        sockaddr_un address{};
+        if (socketPath.size() >= sizeof(address.sun_path)) {
+            throw std::runtime_error("Socket path too long: " + socketPath);
+        }
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+        int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener < 0) throw std::runtime_error("Could not create socket: " + std::string(std::strerror(errno)));
+        ::unlink(socketPath.c_str());
+        if (::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            ::listen(listener, 64) != 0) {
+            std::string error = std::strerror(errno);
+            ::close(listener);
+            throw std::runtime_error("Could not listen on " + socketPath + ": " + error);
+        }
+
+        // Clients that hang up mid-reply must not kill the server
+        std::signal(SIGPIPE, SIG_IGN);
+        std::signal(SIGINT, onSignal);
+        std::signal(SIGTERM, onSignal);
+
+        std::vector<std::thread> threads;
+        for (int i = 0; i < workers; i++) {
+            threads.emplace_back([this, i]() {
+                while (true) {
+                    int client;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        changed.wait(lock, [&]() { return closing || !pending.empty(); });
+                        if (closing) return;
+                        client = pending.front();
+                        pending.pop();
+                        active.insert(client);
+                    }
+                    serve(i, client, client);
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        active.erase(client);
+                    }
+                    ::close(client);
+                }
+            });
+        }
+
+        // Polls with a timeout so a stop signal is noticed even without new clients
+        while (!stopRequested()) {
+            pollfd entry{listener, POLLIN, 0};
+            if (::poll(&entry, 1, 200) <= 0) continue;
+            int client = ::accept(listener, nullptr, nullptr);
+            if (client < 0) continue;
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.push(client);
+            changed.notify_one();
+        }
+
+        ::close(listener);
+        ::unlink(socketPath.c_str());
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closing = true;
+            while (!pending.empty()) {
+                ::close(pending.front());
+                pending.pop();
+            }
+            // Wakes workers blocked reading from their clients
+            for (int client : active) {
+                ::shutdown(client, SHUT_RDWR);
+            }
+        }
+        changed.notify_all();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+};
@@ -11,286 +11,970 @@
 #include <sstream>
 #include <random>
 #include <cmath>
+#include <climits>
+#include <cctype>
+#include <fstream>
+#include <filesystem>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <charconv>
+#include <string_view>
+#include <limits>
+#include <array>
 
-// FastAGM Sketch implementation
-class FastAGMSketch {
+#include "heavy_hitters.h"
+#include "stats_snapshot.h"
+#include "join_graph.h"
+#include "cardinality_estimator.h"
+#include "join_enumerator.h"
+#include "sql_parser.h"
+#include "plan_executor.h"
+#include "qerror.h"
+#include "query_workload.h"
+#include "cardinality_oracle.h"
+#include "column_store.h"
+#include "column_filter.h"
+#include "change_stream.h"
+#include "line_server.h"
+#include "plan_cache.h"
+#include "key_sample.h"
+#include "postgres_estimator.h"
+#include "planner_metrics.h"
+#include "plan_quality.h"
+
+// Shared, thread-safe planner statistics: catalog stats per table, join-key
+// sketches per (table, column, local filter) and row counts of filtered
+// relations, fetched or built on first use. The contents can be seeded from
+// and dumped to a StatsSnapshot so warm runs skip the database. With a
+// ColumnStore everything is computed from its files and no connection is used.
+class StatisticsCatalog {
 private:
-    static const int HASH_FUNCTIONS = 5;
-    static const int SKETCH_SIZE = 1000;
-    std::vector<std::vector<double>> sketch;
-    std::vector<std::vector<int>> hashSeeds;
+    struct TableEntry {
+        std::once_flag fetched;
+        std::atomic<bool> ready{false};
+        TableStats stats;
+    };
+    
+    struct SketchEntry {
+        std::once_flag built;
+        std::atomic<bool> ready{false};
+        std::string table;
+        JoinKeySketch sketch;
+        // LSN the rows were read at when changes are tracked, 0 otherwise
+        uint64_t lsn = 0;
+    };
+    
+    // Key samples are rebuilt per process rather than kept in the snapshot
+    struct SampleEntry {
+        std::once_flag built;
+        std::string table;
+        KeySample sample;
+    };
+    
+    struct CountEntry {
+        std::once_flag counted;
+        std::atomic<bool> ready{false};
+        std::string table;
+        double rows = 0;
+    };
+    
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, std::shared_ptr<TableEntry>> tables;
+    std::unordered_map<std::string, std::shared_ptr<SketchEntry>> sketches;
+    std::unordered_map<std::string, std::shared_ptr<SampleEntry>> samples;
+    std::unordered_map<std::string, std::shared_ptr<CountEntry>> filteredCounts;
+    std::atomic<bool> modified{false};
+    std::shared_ptr<const ColumnStore> store;
+    bool tracking = false;
+    ChangeWatermark changeWatermark;
+    // Changes whenever cached statistics are dropped or updated (building missing ones
+    // does not count); plans made under another epoch may be stale
+    mutable std::atomic<uint64_t> statisticsEpoch{newEpoch()};
+    // Set by applyChange(), which runs per row, so the epoch is renewed once per batch
+    mutable std::atomic<bool> epochOutdated{false};
     
-    int hash(int value, int seed) const {
-        std::hash<int> hasher;
-        return (hasher(value ^ seed) % SKETCH_SIZE + SKETCH_SIZE) % SKETCH_SIZE;
+    int buildThreads;
+    
+    // Keys buffered per sketch batch update
+    static const size_t SKETCH_BATCH = 4096;
+    // Rows per shard of a parallel column store sketch build
+    static const uint64_t SKETCH_SHARD_ROWS = 1 << 20;
+    
+    // Keys are hashed as integers when possible and as raw bytes otherwise
+    static int64_t parseKey(const char* begin, const char* end) {
+        int64_t key = 0;
+        auto [ptr, ec] = std::from_chars(begin, end, key);
+        if (ec == std::errc() && ptr == end) return key;
+        return static_cast<int64_t>(std::hash<std::string_view>{}(std::string_view(begin, end - begin)));
     }
-
-public:
-    FastAGMSketch() : sketch(HASH_FUNCTIONS, std::vector<double>(SKETCH_SIZE, 0)) {
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_int_distribution<> dis(1, INT_MAX);
-        
-        hashSeeds.resize(HASH_FUNCTIONS);
-        for (int i = 0; i < HASH_FUNCTIONS; i++) {
-            hashSeeds[i].resize(2);
-            hashSeeds[i][0] = dis(gen);
-            hashSeeds[i][1] = dis(gen);
+    
+    // Random, so epochs of separate runs never collide in a persisted plan cache
+    static uint64_t newEpoch() {
+        std::random_device device;
+        return (static_cast<uint64_t>(device()) << 32) | device();
+    }
+    
+    static std::string quoteIdentifier(PGconn* conn, const std::string& name) {
+        char* escaped = PQescapeIdentifier(conn, name.c_str(), name.size());
+        if (!escaped) {
+            throw std::runtime_error("Failed to quote identifier: " + std::string(PQerrorMessage(conn)));
         }
+        std::string quoted(escaped);
+        PQfreemem(escaped);
+        return quoted;
     }
-
-    void update(int vertex1, int vertex2, double weight = 1.0) {
-        for (int i = 0; i < HASH_FUNCTIONS; i++) {
-            int h1 = hash(vertex1, hashSeeds[i][0]);
-            int h2 = hash(vertex2, hashSeeds[i][1]);
-            sketch[i][h1 ^ h2] += weight;
+    
+    static PGresult* execParams(PGconn* conn, const char* query, const std::string& param, const char* what) {
+        const char* paramValues[1] = {param.c_str()};
+        PGresult* res = PQexecParams(conn, query, 1, nullptr, paramValues, nullptr, nullptr, 0);
+        if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+            std::string error = PQerrorMessage(conn);
+            PQclear(res);
+            throw std::runtime_error(std::string("Failed to get ") + what + ": " + error);
         }
+        return res;
     }
-
-    double estimate(int vertex1, int vertex2) const {
-        std::vector<double> estimates;
-        for (int i = 0; i < HASH_FUNCTIONS; i++) {
-            int h1 = hash(vertex1, hashSeeds[i][0]);
-            int h2 = hash(vertex2, hashSeeds[i][1]);
-            estimates.push_back(sketch[i][h1 ^ h2]);
+    
+    static double numericValue(PGresult* res, int row, int column) {
+        return PQgetisnull(res, row, column) ? 0 : std::stod(PQgetvalue(res, row, column));
+    }
+    
+    static constexpr const char* TABLE_QUERY =
+        "SELECT c.reltuples::bigint, COALESCE(s.n_tup_ins + s.n_tup_upd + s.n_tup_del, 0) "
+        "FROM pg_class c LEFT JOIN pg_stat_user_tables s ON s.relid = c.oid "
+        "WHERE c.relname = $1;";
+    static constexpr const char* COLUMNS_QUERY =
+        "SELECT attname, n_distinct, correlation, most_common_vals::text, most_common_freqs::text "
+        "FROM pg_stats WHERE tablename = $1;";
+    
+    static void readTableRow(PGresult* res, TableStats& stats) {
+        if (PQntuples(res) > 0) {
+            stats.reltuples = numericValue(res, 0, 0);
+            stats.changeCounter = static_cast<int64_t>(numericValue(res, 0, 1));
         }
-        
-        std::sort(estimates.begin(), estimates.end());
-        return estimates[HASH_FUNCTIONS / 2];
     }
-};
-
-class JoinPlanGenerator {
-private:
-    std::unordered_map<std::string, std::string> aliasToTable;
-    PGconn* dbConn;
-    FastAGMSketch agmSketch;
     
-    struct JoinInfo {
-        std::vector<std::string> tables;
-        std::vector<std::string> joinConditions;
-        std::unordered_map<std::string, std::vector<std::string>> tableJoins;
-        std::unordered_map<std::string, double> tableCardinalities;
-    };
-
-    std::string trim(const std::string& str) {
-        size_t first = str.find_first_not_of(" \t\n\r");
-        if (first == std::string::npos) return "";
-        size_t last = str.find_last_not_of(" \t\n\r");
-        return str.substr(first, last - first + 1);
+    static void readColumnRows(PGresult* res, TableStats& stats) {
+        for (int i = 0; i < PQntuples(res); i++) {
+            ColumnStats column;
+            column.name = PQgetvalue(res, i, 0);
+            column.nDistinct = numericValue(res, i, 1);
+            column.correlation = numericValue(res, i, 2);
+            column.mostCommonValues = PQgetvalue(res, i, 3);
+            column.mostCommonFreqs = PQgetvalue(res, i, 4);
+            stats.columns.push_back(std::move(column));
+        }
     }
-
-    void parseAliases(const std::string& query) {
-        size_t fromPos = query.find("FROM");
-        size_t wherePos = query.find("WHERE");
-        if (fromPos == std::string::npos) return;
+    
+    static void fetchTableStats(PGconn* conn, const std::string& table, TableStats& stats) {
+        PGresult* res = execParams(conn, TABLE_QUERY, table, "table cardinality");
+        readTableRow(res, stats);
+        PQclear(res);
         
-        std::string fromClause = query.substr(fromPos + 4, 
-            wherePos != std::string::npos ? wherePos - (fromPos + 4) : std::string::npos);
+        res = execParams(conn, COLUMNS_QUERY, table, "column statistics");
+        readColumnRows(res, stats);
+        PQclear(res);
+    }
+    
+#ifdef LIBPQ_HAS_PIPELINING
+    // Sends the pg_class and pg_stats queries of every table in one pipeline, so
+    // the whole batch costs a single network round trip
+    static void fetchTableStatsPipelined(PGconn* conn, const std::vector<std::string>& names,
+                                         std::vector<TableStats>& stats) {
+        if (!PQenterPipelineMode(conn)) {
+            throw std::runtime_error("Failed to enter pipeline mode: " + std::string(PQerrorMessage(conn)));
+        }
         
-        std::istringstream iss(fromClause);
-        std::string token;
-        std::string table;
-        bool expectingAlias = false;
+        std::string error;
+        int sent = 0;
+        for (const auto& name : names) {
+            const char* paramValues[1] = {name.c_str()};
+            if (!PQsendQueryParams(conn, TABLE_QUERY, 1, nullptr, paramValues, nullptr, nullptr, 0) ||
+                !PQsendQueryParams(conn, COLUMNS_QUERY, 1, nullptr, paramValues, nullptr, nullptr, 0)) {
+                error = PQerrorMessage(conn);
+                break;
+            }
+            sent += 2;
+        }
+        if (!PQpipelineSync(conn) && error.empty()) {
+            error = PQerrorMessage(conn);
+        }
         
-        while (iss >> token) {
-            if (!token.empty() && token.back() == ',') {
-                token.pop_back();
+        // Results arrive in send order, each followed by a null terminator, then the sync marker.
+        // After a failure the rest of the pipeline reports PGRES_PIPELINE_ABORTED.
+        for (int i = 0; i < sent; i++) {
+            PGresult* res = PQgetResult(conn);
+            if (PQresultStatus(res) == PGRES_TUPLES_OK) {
+                if (i % 2 == 0) {
+                    readTableRow(res, stats[i / 2]);
+                } else {
+                    readColumnRows(res, stats[i / 2]);
+                }
+            } else if (error.empty()) {
+                error = PQresultErrorMessage(res);
             }
-            
-            if (token == "AS") {
-                expectingAlias = true;
-                continue;
+            PQclear(res);
+            while ((res = PQgetResult(conn)) != nullptr) {
+                PQclear(res);
             }
-            
-            if (expectingAlias) {
-                aliasToTable[token] = table;
-                expectingAlias = false;
-                table.clear();
-            } else {
-                table = token;
+        }
+        PGresult* sync = PQgetResult(conn);
+        if (PQresultStatus(sync) != PGRES_PIPELINE_SYNC && error.empty()) {
+            error = PQresultErrorMessage(sync);
+        }
+        PQclear(sync);
+        PQexitPipelineMode(conn);
+        
+        if (!error.empty()) {
+            throw std::runtime_error("Failed to get table statistics: " + error);
+        }
+    }
+#endif
+    
+    std::shared_ptr<TableEntry> tableEntry(const std::string& table) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto& slot = tables[table];
+        if (!slot) slot = std::make_shared<TableEntry>();
+        return slot;
+    }
+    
+    // Cache key suffix of a filtered relation; the filter is SQL over alias, so both are part of it
+    static std::string filterKey(const std::string& alias, const std::string& filter) {
+        return filter.empty() ? "" : " AS " + alias + " WHERE " + filter;
+    }
+    
+    // The alias is spliced in unquoted so it matches how the filter refers to it
+    static std::string relationSql(PGconn* conn, const std::string& table, const std::string& alias,
+                                   const std::string& filter) {
+        std::string from = quoteIdentifier(conn, table);
+        return filter.empty() ? from : from + " AS " + alias;
+    }
+    
+    static void exec(PGconn* conn, const char* sql) {
+        PGresult* res = PQexec(conn, sql);
+        if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+            std::string error = PQerrorMessage(conn);
+            PQclear(res);
+            throw std::runtime_error(std::string("Failed to run ") + sql + ": " + error);
+        }
+        PQclear(res);
+    }
+    
+    // Like buildSketch, but inside a repeatable-read transaction whose snapshot is taken
+    // together with the current WAL position, returned as the LSN the rows were read at.
+    // Commits landing between the snapshot and the position read are the only ones misattributed.
+    static uint64_t buildTrackedSketch(PGconn* conn, const std::string& table, const std::string& column,
+                                       const std::string& alias, const std::string& filter,
+                                       JoinKeySketch& sketch) {
+        exec(conn, "BEGIN ISOLATION LEVEL REPEATABLE READ");
+        try {
+            PGresult* res = PQexec(conn, "SELECT pg_current_wal_lsn();");
+            if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+                std::string error = PQerrorMessage(conn);
+                PQclear(res);
+                throw std::runtime_error("Failed to read the WAL position: " + error);
             }
+            uint64_t lsn = parseLsn(PQgetvalue(res, 0, 0));
+            PQclear(res);
+            buildSketch(conn, table, column, alias, filter, sketch);
+            exec(conn, "COMMIT");
+            return lsn;
+        } catch (...) {
+            PQclear(PQexec(conn, "ROLLBACK"));
+            throw;
         }
     }
-
-    std::pair<std::string, std::string> extractTablesFromJoin(const std::string& condition) {
-        size_t eqPos = condition.find('=');
-        if (eqPos == std::string::npos) return {"", ""};
+    
+    // Streams one key column with COPY ... TO STDOUT and feeds every value to the sketch (or sample).
+    // With a filter only the rows passing the relation's local predicates are streamed.
+    template <typename Summary>
+    static void buildSketch(PGconn* conn, const std::string& table, const std::string& column,
+                            const std::string& alias, const std::string& filter, Summary& sketch) {
+        std::string col = quoteIdentifier(conn, column);
+        if (!filter.empty()) col = alias + "." + col;
+        std::string copy = "COPY (SELECT " + col + " FROM " + relationSql(conn, table, alias, filter) +
+                           " WHERE " + col + " IS NOT NULL" + (filter.empty() ? "" : " AND " + filter) +
+                           ") TO STDOUT";
         
-        std::string left = trim(condition.substr(0, eqPos));
-        std::string right = trim(condition.substr(eqPos + 1));
+        PGresult* res = PQexec(conn, copy.c_str());
+        if (PQresultStatus(res) != PGRES_COPY_OUT) {
+            std::string error = PQerrorMessage(conn);
+            PQclear(res);
+            throw std::runtime_error("Failed to stream " + table + "." + column + ": " + error);
+        }
+        PQclear(res);
         
-        size_t dotPosLeft = left.find('.');
-        size_t dotPosRight = right.find('.');
+        // Keys are sketched in batches so the hashing can be vectorized
+        std::array<int64_t, SKETCH_BATCH> keys;
+        size_t pending = 0;
+        char* line = nullptr;
+        int len;
+        while ((len = PQgetCopyData(conn, &line, 0)) > 0) {
+            // Each row is the text value followed by a newline
+            int end = (line[len - 1] == '\n') ? len - 1 : len;
+            keys[pending++] = parseKey(line, line + end);
+            if (pending == keys.size()) {
+                sketch.update(keys.data(), pending);
+                pending = 0;
+            }
+            PQfreemem(line);
+        }
+        sketch.update(keys.data(), pending);
         
-        if (dotPosLeft == std::string::npos || dotPosRight == std::string::npos) 
-            return {"", ""};
-            
-        return {
-            trim(left.substr(0, dotPosLeft)),
-            trim(right.substr(0, dotPosRight))
-        };
+        res = PQgetResult(conn);
+        bool ok = len == -1 && PQresultStatus(res) == PGRES_COMMAND_OK;
+        std::string error = ok ? "" : PQerrorMessage(conn);
+        PQclear(res);
+        while ((res = PQgetResult(conn)) != nullptr) {
+            PQclear(res);
+        }
+        if (!ok) {
+            throw std::runtime_error("COPY of " + table + "." + column + " failed: " + error);
+        }
     }
-
-    JoinInfo parseJoinConditions(const std::string& query) {
-        JoinInfo info;
-        size_t wherePos = query.find("WHERE");
-        if (wherePos == std::string::npos) return info;
-        
-        std::string whereClause = query.substr(wherePos + 5);
-        std::vector<std::string> conditions;
-        
-        size_t start = 0;
-        while (start < whereClause.length()) {
-            size_t andPos = whereClause.find("AND", start);
-            if (andPos == std::string::npos) {
-                conditions.push_back(trim(whereClause.substr(start)));
-                break;
+    
+    static double countRows(PGconn* conn, const std::string& table, const std::string& alias,
+                            const std::string& filter) {
+        std::string query = "SELECT count(*) FROM " + relationSql(conn, table, alias, filter) +
+                            " WHERE " + filter + ";";
+        PGresult* res = PQexec(conn, query.c_str());
+        if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+            std::string error = PQerrorMessage(conn);
+            PQclear(res);
+            throw std::runtime_error("Failed to count filtered rows of " + table + ": " + error);
+        }
+        double rows = numericValue(res, 0, 0);
+        PQclear(res);
+        return rows;
+    }
+    
+    // Sketches rows [begin, end) of a column store column
+    template <typename Summary>
+    static void sketchShard(const MappedColumn& values, const ColumnFilter& selection, uint64_t begin,
+                            uint64_t end, Summary& sketch) {
+        if (values.columnType() == ColumnType::Integer) {
+            std::array<int32_t, SKETCH_BATCH> keys;
+            size_t pending = 0;
+            const int32_t* data = values.integerData();
+            for (uint64_t row = begin; row < end; row++) {
+                if (data[row] == column_format::INTEGER_NULL || !selection.matches(row)) continue;
+                keys[pending++] = data[row];
+                if (pending == keys.size()) {
+                    sketch.update(keys.data(), pending);
+                    pending = 0;
+                }
             }
-            
-            std::string condition = trim(whereClause.substr(start, andPos - start));
-            if (!condition.empty()) {
-                conditions.push_back(condition);
+            sketch.update(keys.data(), pending);
+            return;
+        }
+        std::array<int64_t, SKETCH_BATCH> keys;
+        size_t pending = 0;
+        for (uint64_t row = begin; row < end; row++) {
+            if (values.isNull(row) || !selection.matches(row)) continue;
+            std::string_view key = values.text(row);
+            keys[pending++] = parseKey(key.data(), key.data() + key.size());
+            if (pending == keys.size()) {
+                sketch.update(keys.data(), pending);
+                pending = 0;
             }
-            start = andPos + 3;
+        }
+        sketch.update(keys.data(), pending);
+    }
+    
+    // Column store counterparts of buildSketch and countRows: sequential passes over the mapped columns.
+    // Shards of SKETCH_SHARD_ROWS rows are sketched on up to buildThreads threads and merged in shard
+    // order, so the heavy hitters kept, and with them the sketch, do not depend on the thread count.
+    template <typename Summary>
+    void buildSketch(const ColumnStore& store, const std::string& table, const std::string& column,
+                     const std::string& alias, const std::string& filter, Summary& sketch) const {
+        const MappedColumn& values = store.column(table, column);
+        ColumnFilter selection(store, table, alias, filter);
+        uint64_t shards = (values.rows() + SKETCH_SHARD_ROWS - 1) / SKETCH_SHARD_ROWS;
+        if (shards <= 1) {
+            sketchShard(values, selection, 0, values.rows(), sketch);
+            return;
         }
         
-        for (const auto& condition : conditions) {
-            if (condition.find('=') != std::string::npos && condition.find('.') != std::string::npos) {
-                auto tables = extractTablesFromJoin(condition);
-                if (!tables.first.empty() && !tables.second.empty()) {
-                    std::string table1 = aliasToTable[tables.first];
-                    std::string table2 = aliasToTable[tables.second];
-                    
-                    info.joinConditions.push_back(condition);
-                    info.tableJoins[table1].push_back(table2);
-                    info.tableJoins[table2].push_back(table1);
-                    
-                    if (std::find(info.tables.begin(), info.tables.end(), table1) == info.tables.end()) {
-                        info.tables.push_back(table1);
-                    }
-                    if (std::find(info.tables.begin(), info.tables.end(), table2) == info.tables.end()) {
-                        info.tables.push_back(table2);
-                    }
+        std::vector<Summary> partial(shards);
+        std::atomic<uint64_t> next{0};
+        std::vector<std::thread> threads;
+        int threadCount = static_cast<int>(std::min<uint64_t>(buildThreads, shards));
+        for (int t = 0; t < threadCount; t++) {
+            threads.emplace_back([&]() {
+                for (uint64_t shard = next++; shard < shards; shard = next++) {
+                    uint64_t begin = shard * SKETCH_SHARD_ROWS;
+                    sketchShard(values, selection, begin, std::min(values.rows(), begin + SKETCH_SHARD_ROWS),
+                                partial[shard]);
                 }
-            }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
         }
-        return info;
+        for (const auto& shard : partial) {
+            sketch.merge(shard);
+        }
+    }
+    
+    static double countRows(const ColumnStore& store, const std::string& table, const std::string& alias,
+                            const std::string& filter) {
+        ColumnFilter selection(store, table, alias, filter);
+        uint64_t rows = store.rows(table);
+        uint64_t count = 0;
+        for (uint64_t row = 0; row < rows; row++) {
+            if (selection.matches(row)) count++;
+        }
+        return static_cast<double>(count);
+    }
+    
+public:
+    // buildThreads bounds the threads sketching one column store column
+    explicit StatisticsCatalog(std::shared_ptr<const ColumnStore> store = nullptr, int buildThreads = 1)
+        : store(std::move(store)), buildThreads(std::max(1, buildThreads)) {}
+    
+    // True when statistics come from a column store and need no database connection
+    bool offline() const { return store != nullptr; }
+    
+    const TableStats& tableStats(PGconn* conn, const std::string& table) {
+        std::shared_ptr<TableEntry> entry = tableEntry(table);
+        std::call_once(entry->fetched, [&]() {
+            if (store) entry->stats.reltuples = static_cast<double>(store->rows(table));
+            else fetchTableStats(conn, table, entry->stats);
+            entry->ready = true;
+            modified = true;
+        });
+        return entry->stats;
     }
     
-    double getTableCardinality(const std::string& tableName) {
-        std::string query = "SELECT reltuples::bigint FROM pg_class WHERE relname = $1;";
-        const char* paramValues[1] = {tableName.c_str()};
+    // Fetches the stats of all listed tables that are not cached yet in one batch
+    void prefetchTableStats(PGconn* conn, const std::vector<std::string>& names) {
+        std::vector<std::string> missing;
+        for (const auto& name : names) {
+            if (!tableEntry(name)->ready && std::find(missing.begin(), missing.end(), name) == missing.end()) {
+                missing.push_back(name);
+            }
+        }
+        if (missing.empty()) return;
+        if (store) {
+            for (const auto& name : missing) tableStats(conn, name);
+            return;
+        }
         
-        PGresult* res = PQexecParams(dbConn, query.c_str(), 1, nullptr, paramValues, 
-                                   nullptr, nullptr, 0);
+        std::vector<TableStats> fetched(missing.size());
+#ifdef LIBPQ_HAS_PIPELINING
+        fetchTableStatsPipelined(conn, missing, fetched);
+#else
+        for (size_t i = 0; i < missing.size(); i++) {
+            fetchTableStats(conn, missing[i], fetched[i]);
+        }
+#endif
+        // A concurrent tableStats() call may have won the race; its result is just as good
+        for (size_t i = 0; i < missing.size(); i++) {
+            std::shared_ptr<TableEntry> entry = tableEntry(missing[i]);
+            std::call_once(entry->fetched, [&]() {
+                entry->stats = std::move(fetched[i]);
+                entry->ready = true;
+                modified = true;
+            });
+        }
+    }
+    
+    // Sketch of table.column over the rows where filter (SQL over alias) holds; an empty
+    // filter sketches the whole column and is shared by every alias of the table
+    const JoinKeySketch& sketch(PGconn* conn, const std::string& table, const std::string& column,
+                                const std::string& alias = "", const std::string& filter = "") {
+        std::shared_ptr<SketchEntry> entry;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto& slot = sketches[table + "." + column + filterKey(alias, filter)];
+            if (!slot) {
+                slot = std::make_shared<SketchEntry>();
+                slot->table = table;
+            }
+            entry = slot;
+        }
+        // Concurrent callers for the same column wait for a single build
+        std::call_once(entry->built, [&]() {
+            JoinKeySketch built;
+            if (store) buildSketch(*store, table, column, alias, filter, built);
+            else if (tracking) entry->lsn = buildTrackedSketch(conn, table, column, alias, filter, built);
+            else buildSketch(conn, table, column, alias, filter, built);
+            built.finalize();
+            entry->sketch = std::move(built);
+            entry->ready = true;
+            modified = true;
+        });
+        return entry->sketch;
+    }
+    
+    // Correlated key sample of table.column over the rows where filter holds, keyed like sketch()
+    const KeySample& keySample(PGconn* conn, const std::string& table, const std::string& column,
+                               const std::string& alias = "", const std::string& filter = "") {
+        std::shared_ptr<SampleEntry> entry;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto& slot = samples[table + "." + column + filterKey(alias, filter)];
+            if (!slot) {
+                slot = std::make_shared<SampleEntry>();
+                slot->table = table;
+            }
+            entry = slot;
+        }
+        std::call_once(entry->built, [&]() {
+            KeySample built;
+            if (store) buildSketch(*store, table, column, alias, filter, built);
+            else buildSketch(conn, table, column, alias, filter, built);
+            entry->sample = std::move(built);
+        });
+        return entry->sample;
+    }
+    
+    // Rows of table passing filter; reltuples when there is no filter
+    double filteredCardinality(PGconn* conn, const std::string& table, const std::string& alias,
+                               const std::string& filter) {
+        if (filter.empty()) return tableStats(conn, table).reltuples;
         
+        std::shared_ptr<CountEntry> entry;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto& slot = filteredCounts[table + filterKey(alias, filter)];
+            if (!slot) {
+                slot = std::make_shared<CountEntry>();
+                slot->table = table;
+            }
+            entry = slot;
+        }
+        std::call_once(entry->counted, [&]() {
+            entry->rows = store ? countRows(*store, table, alias, filter) : countRows(conn, table, alias, filter);
+            entry->ready = true;
+            modified = true;
+        });
+        return entry->rows;
+    }
+    
+    // Must run before planning starts: entries are replaced, not merged
+    void load(StatsSnapshot snapshot) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& [name, stats] : snapshot.tables) {
+            auto entry = std::make_shared<TableEntry>();
+            std::call_once(entry->fetched, [&]() { entry->stats = std::move(stats); });
+            entry->ready = true;
+            tables[name] = entry;
+        }
+        for (auto& [key, sketch] : snapshot.sketches) {
+            auto entry = std::make_shared<SketchEntry>();
+            entry->table = key.substr(0, key.find('.'));
+            std::call_once(entry->built, [&]() { entry->sketch = std::move(sketch); });
+            entry->ready = true;
+            auto lsn = snapshot.sketchLsns.find(key);
+            if (lsn != snapshot.sketchLsns.end()) entry->lsn = lsn->second;
+            sketches[key] = entry;
+        }
+        for (const auto& [key, rows] : snapshot.filteredCardinalities) {
+            auto entry = std::make_shared<CountEntry>();
+            entry->table = key.substr(0, key.find(' '));
+            std::call_once(entry->counted, [&]() { entry->rows = rows; });
+            entry->ready = true;
+            filteredCounts[key] = entry;
+        }
+        changeWatermark = snapshot.watermark;
+        if (snapshot.epoch != 0) statisticsEpoch = snapshot.epoch;
+    }
+    
+    StatsSnapshot snapshot() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        StatsSnapshot result;
+        for (const auto& [name, entry] : tables) {
+            if (entry->ready) result.tables[name] = entry->stats;
+        }
+        for (const auto& [key, entry] : sketches) {
+            if (!entry->ready) continue;
+            result.sketches.emplace(key, entry->sketch);
+            if (entry->lsn > 0) result.sketchLsns[key] = entry->lsn;
+        }
+        for (const auto& [key, entry] : filteredCounts) {
+            if (entry->ready) result.filteredCardinalities[key] = entry->rows;
+        }
+        result.watermark = changeWatermark;
+        result.epoch = epoch();
+        return result;
+    }
+    
+    // Drops everything cached for tables whose pg_stat_user_tables write counters moved.
+    // Must run before planning starts; returns the number of stale tables. A column
+    // store never changes under the planner, so there is nothing to check.
+    int refresh(PGconn* conn) {
+        if (store) return 0;
+        PGresult* res = PQexec(conn,
+            "SELECT relname, n_tup_ins + n_tup_upd + n_tup_del FROM pg_stat_user_tables;");
         if (PQresultStatus(res) != PGRES_TUPLES_OK) {
-            std::string error = PQerrorMessage(dbConn);
+            std::string error = PQerrorMessage(conn);
             PQclear(res);
-            throw std::runtime_error("Failed to get table cardinality: " + error);
+            throw std::runtime_error("Failed to read pg_stat_user_tables: " + error);
+        }
+        std::unordered_map<std::string, int64_t> counters;
+        for (int i = 0; i < PQntuples(res); i++) {
+            counters[PQgetvalue(res, i, 0)] = static_cast<int64_t>(numericValue(res, i, 1));
         }
-        
-        double cardinality = std::stod(PQgetvalue(res, 0, 0));
         PQclear(res);
-        return cardinality;
-    }
-    
-    void updateSketchWithJoinStatistics(JoinInfo& info) {
-        for (const auto& [table1, joins] : info.tableJoins) {
-            for (const auto& table2 : joins) {
-                std::string query = "SELECT tablename, attname, n_distinct, correlation "
-                                  "FROM pg_stats WHERE tablename IN ($1, $2);";
-                                  
-                const char* paramValues[2] = {table1.c_str(), table2.c_str()};
-                PGresult* res = PQexecParams(dbConn, query.c_str(), 2, nullptr, 
-                                           paramValues, nullptr, nullptr, 0);
-                
-                if (PQresultStatus(res) != PGRES_TUPLES_OK) {
-                    PQclear(res);
-                    continue;
+        
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unordered_set<std::string> stale;
+        for (const auto& [name, entry] : tables) {
+            auto it = counters.find(name);
+            if (entry->ready && (it == counters.end() || it->second != entry->stats.changeCounter)) {
+                stale.insert(name);
+            }
+        }
+        for (const auto& name : stale) {
+            tables.erase(name);
+        }
+        // Entries without table stats cannot be checked, so they are rebuilt too
+        auto dropStale = [&](auto& entries) {
+            for (auto it = entries.begin(); it != entries.end();) {
+                if (stale.count(it->second->table) > 0 || tables.count(it->second->table) == 0) {
+                    it = entries.erase(it);
+                } else {
+                    ++it;
                 }
-                
-                double selectivity = calculateJoinSelectivity(res);
-                int t1Hash = std::hash<std::string>{}(table1);
-                int t2Hash = std::hash<std::string>{}(table2);
-                agmSketch.update(t1Hash, t2Hash, selectivity);
-                
-                PQclear(res);
             }
+        };
+        dropStale(sketches);
+        dropStale(samples);
+        dropStale(filteredCounts);
+        if (!stale.empty()) {
+            statisticsEpoch = newEpoch();
+            modified = true;
         }
+        return static_cast<int>(stale.size());
     }
     
-    double calculateJoinSelectivity(PGresult* stats) {
-        double selectivity = 1.0;
-        for (int i = 0; i < PQntuples(stats); i++) {
-            double n_distinct = std::stod(PQgetvalue(stats, i, 2));
-            if (n_distinct > 0) {
-                selectivity *= (1.0 / n_distinct);
+    // Starts maintaining the statistics from a change stream whose remaining changes
+    // were all committed after streamLsn. Unless the watermark already reaches
+    // streamLsn, changes in between were lost (first attach, or a crash between
+    // consuming and saving), so everything read before streamLsn is dropped.
+    // Must run before planning starts; returns the number of dropped sketches.
+    int trackChanges(uint64_t streamLsn) {
+        std::lock_guard<std::mutex> lock(mutex);
+        tracking = true;
+        if (changeWatermark.lsn >= streamLsn) return 0;
+        
+        int dropped = 0;
+        for (auto it = sketches.begin(); it != sketches.end();) {
+            if (it->second->lsn < streamLsn) {
+                it = sketches.erase(it);
+                dropped++;
+            } else {
+                ++it;
             }
         }
-        return selectivity;
+        tables.clear();
+        samples.clear();
+        filteredCounts.clear();
+        changeWatermark.lsn = streamLsn;
+        statisticsEpoch = newEpoch();
+        modified = true;
+        return dropped;
     }
     
-    std::string generatePostgresStylePlan(JoinInfo& info) {
-        if (info.tables.empty()) return "";
-        
-        std::unordered_map<std::string, double> tableScores;
-        for (const auto& table : info.tables) {
-            double score = 0;
-            int t1Hash = std::hash<std::string>{}(table);
-            
-            for (const auto& joinTable : info.tableJoins.at(table)) {
-                int t2Hash = std::hash<std::string>{}(joinTable);
-                double joinScore = agmSketch.estimate(t1Hash, t2Hash);
-                score += joinScore;
+    // Applies one inserted or deleted row as a +1/-1 update to the whole-column sketches
+    // of its table that were read before the change committed. Filtered sketches and row
+    // counts of the table are dropped, since their filters are only evaluated by Postgres,
+    // and so are its key samples, which are not kept with LSNs.
+    void applyChange(const RowChange& change) {
+        std::lock_guard<std::mutex> lock(mutex);
+        double weight = change.kind == RowChange::Kind::Insert ? 1.0 : -1.0;
+        std::string prefix = change.table + ".";
+        for (auto it = sketches.begin(); it != sketches.end();) {
+            SketchEntry& entry = *it->second;
+            const std::string& key = it->first;
+            if (entry.table != change.table || !entry.ready || change.commitLsn <= entry.lsn) {
+                ++it;
+                continue;
             }
-            
-            if (info.tableCardinalities.count(table) > 0) {
-                score *= (1.0 / std::log1p(info.tableCardinalities.at(table)));
+            // Whole-column sketches are keyed "table.column", filtered ones carry " AS alias WHERE ..."
+            const RowChange::Value* value = nullptr;
+            bool filtered = key.find(' ') != std::string::npos;
+            if (!filtered) value = change.find(key.substr(prefix.size()));
+            if (filtered || !value) {
+                // A delete without REPLICA IDENTITY FULL does not carry the key column
+                it = sketches.erase(it);
+                continue;
             }
-            tableScores[table] = score;
+            if (!value->isNull) {
+                entry.sketch.update(parseKey(value->text.data(), value->text.data() + value->text.size()), weight);
+            }
+            ++it;
+        }
+        for (auto it = samples.begin(); it != samples.end();) {
+            if (it->second->table == change.table) it = samples.erase(it);
+            else ++it;
+        }
+        for (auto it = filteredCounts.begin(); it != filteredCounts.end();) {
+            if (it->second->table == change.table) it = filteredCounts.erase(it);
+            else ++it;
+        }
+        auto table = tables.find(change.table);
+        if (table != tables.end() && table->second->ready) {
+            table->second->stats.reltuples = std::max(0.0, table->second->stats.reltuples + weight);
+        }
+        epochOutdated = true;
+        modified = true;
+    }
+    
+    // Drops all sketches, samples and row counts of a table whose changes could not be applied
+    void invalidateTable(const std::string& table) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto it = sketches.begin(); it != sketches.end();) {
+            if (it->second->table == table) it = sketches.erase(it);
+            else ++it;
+        }
+        for (auto it = samples.begin(); it != samples.end();) {
+            if (it->second->table == table) it = samples.erase(it);
+            else ++it;
+        }
+        for (auto it = filteredCounts.begin(); it != filteredCounts.end();) {
+            if (it->second->table == table) it = filteredCounts.erase(it);
+            else ++it;
+        }
+        statisticsEpoch = newEpoch();
+        modified = true;
+    }
+    
+    // Records that the stream was drained up to lsn, and re-stamps the cached tables with the
+    // current pg_stat_user_tables write counters so refresh() keeps the maintained entries.
+    // A counter that moves between the drain and this read only causes an extra rebuild.
+    void markSynchronized(PGconn* conn, uint64_t lsn) {
+        PGresult* res = PQexec(conn,
+            "SELECT relname, n_tup_ins + n_tup_upd + n_tup_del FROM pg_stat_user_tables;");
+        if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+            std::string error = PQerrorMessage(conn);
+            PQclear(res);
+            throw std::runtime_error("Failed to read pg_stat_user_tables: " + error);
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int i = 0; i < PQntuples(res); i++) {
+            auto table = tables.find(PQgetvalue(res, i, 0));
+            if (table != tables.end() && table->second->ready) {
+                table->second->stats.changeCounter = static_cast<int64_t>(numericValue(res, i, 1));
+            }
+        }
+        PQclear(res);
+        changeWatermark.lsn = lsn;
+        changeWatermark.syncedAtMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        modified = true;
+    }
+    
+    ChangeWatermark watermark() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return changeWatermark;
+    }
+    
+    // Current statistics epoch, recorded with cached plans
+    uint64_t epoch() const {
+        if (epochOutdated.exchange(false)) statisticsEpoch = newEpoch();
+        return statisticsEpoch;
+    }
+    
+    // True when something was fetched, built or invalidated since load()
+    bool isModified() const { return modified; }
+};
+
+enum class PlannerAlgorithm {
+    Greedy,   // left-deep, smallest intermediate result first
+    DP,       // exact DPccp, falling back to anytime search when it cannot finish
+    Anytime   // greedy plan improved by AnytimeEnumerator until the budget runs out
+};
+
+// Where subset cardinalities come from
+enum class EstimatorKind {
+    Sketch,    // SketchEstimator over the catalog's join-key sketches
+    Postgres,  // PostgresEstimator: EXPLAIN of every subset
+    Sampling   // SamplingEstimator over the catalog's correlated key samples
+};
+
+struct PlannerOptions {
+    PlannerAlgorithm algorithm = PlannerAlgorithm::DP;
+    EstimatorKind estimator = EstimatorKind::Sketch;
+    // Join ordering time limit; 0 lets DP run to completion
+    double budgetMs = 0;
+    // Join trees shared across queries with the same fingerprint; null plans every query
+    std::shared_ptr<PlanCache> planCache;
+    // Per-phase planning latencies are recorded here when set
+    std::shared_ptr<PlannerMetrics> metrics;
+};
+
+// Executes our plan and Postgres's own plan of every query after planning
+struct ExecutionOptions {
+    bool enabled = false;
+    int warmupRuns = 1;
+    int measuredRuns = 3;
+    // When set, q-error distributions of our executed plans are written to <prefix>_*.csv and <prefix>.json
+    std::string qerrorPrefix;
+};
+
+// Anytime search budget when none is given
+static const double DEFAULT_ANYTIME_BUDGET_MS = 5;
+
+static PlannerAlgorithm parsePlannerAlgorithm(const std::string& name) {
+    if (name == "dp") return PlannerAlgorithm::DP;
+    if (name == "greedy") return PlannerAlgorithm::Greedy;
+    if (name == "anytime") return PlannerAlgorithm::Anytime;
+    throw std::invalid_argument("Unknown planner '" + name + "' (expected dp, greedy or anytime)");
+}
+
+static EstimatorKind parseEstimatorKind(const std::string& name) {
+    if (name == "sketch") return EstimatorKind::Sketch;
+    if (name == "postgres") return EstimatorKind::Postgres;
+    if (name == "sampling") return EstimatorKind::Sampling;
+    throw std::invalid_argument("Unknown estimator '" + name + "' (expected sketch, postgres or sampling)");
+}
+
+// Result of planning a single query
+struct PlanResult {
+    std::string plan;
+    // The query in explicit JOIN syntax that makes Postgres follow plan
+    std::string sql;
+    int joinCount = 0;
+    int joinPredicates = 0;
+    double planningMs = 0;
+    // True when the join tree came from the plan cache
+    bool cached = false;
+    // Kept to match the executed plan's joins with their estimates
+    JoinGraph graph;
+    JoinTree tree;
+};
+
+class JoinPlanGenerator {
+private:
+    PGconn* dbConn = nullptr;
+    std::shared_ptr<StatisticsCatalog> statistics;
+    PlannerOptions options;
+    
+    // All per-query state lives here so planning is reentrant
+    struct JoinInfo {
+        ParsedQuery query;
+        JoinGraph graph;
+    };
+
+    std::vector<double> getBaseCardinalities(const JoinGraph& graph) {
+        std::vector<std::string> names;
+        for (int i = 0; i < graph.size(); i++) {
+            names.push_back(graph.relation(i).table);
         }
+        statistics->prefetchTableStats(dbConn, names);
         
-        std::unordered_set<std::string> used;
-        std::string plan;
+        // Filtered relations use their qualifying row count, the rest reltuples
+        std::vector<double> cardinalities;
+        for (int i = 0; i < graph.size(); i++) {
+            const JoinGraph::Relation& relation = graph.relation(i);
+            cardinalities.push_back(
+                statistics->filteredCardinality(dbConn, relation.table, relation.alias, relation.filter));
+        }
+        return cardinalities;
+    }
+    
+    // Greedy left-deep plan that always adds the relation giving the smallest estimated intermediate result
+    static JoinTree generatePostgresStylePlan(const CardinalityEstimator& estimator) {
+        const JoinGraph& graph = estimator.joinGraph();
+        JoinTree tree;
+        if (graph.size() == 0) return tree;
         
-        auto bestStart = std::max_element(tableScores.begin(), tableScores.end(),
-            [](const auto& p1, const auto& p2) { return p1.second < p2.second; });
-            
-        plan = bestStart->first;
-        used.insert(bestStart->first);
+        // Start from the relation whose cheapest join produces the smallest result
+        int bestStart = 0;
+        double bestStartSize = std::numeric_limits<double>::max();
+        for (int i = 0; i < graph.size(); i++) {
+            double size = estimator.estimate(JoinGraph::bit(i));
+            for (uint64_t rest = graph.neighbors(i); rest; rest &= rest - 1) {
+                size = std::min(size, estimator.estimate(JoinGraph::bit(i) | (rest & -rest)));
+            }
+            if (graph.neighbors(i) && size < bestStartSize) {
+                bestStartSize = size;
+                bestStart = i;
+            }
+        }
         
-        while (used.size() < info.tables.size()) {
-            std::string nextTable;
-            double bestScore = -1;
+        int plan = tree.addLeaf(bestStart, estimator.estimate(JoinGraph::bit(bestStart)));
+        uint64_t used = JoinGraph::bit(bestStart);
+        
+        while (used != graph.allRelations()) {
+            int next = -1;
+            double bestSize = std::numeric_limits<double>::max();
+            bool bestConnected = false;
             
-            for (const auto& table : info.tables) {
-                if (used.find(table) != used.end()) continue;
+            for (int i = 0; i < graph.size(); i++) {
+                if (used & JoinGraph::bit(i)) continue;
                 
-                double score = tableScores[table];
-                for (const auto& usedTable : used) {
-                    int t1Hash = std::hash<std::string>{}(table);
-                    int t2Hash = std::hash<std::string>{}(usedTable);
-                    score *= (1 + agmSketch.estimate(t1Hash, t2Hash));
-                }
+                bool connected = (graph.neighbors(i) & used) != 0;
+                double size = estimator.estimate(used | JoinGraph::bit(i));
                 
-                if (score > bestScore) {
-                    bestScore = score;
-                    nextTable = table;
+                // Never pick a cross product while a connected relation is available
+                if ((connected && !bestConnected) || (connected == bestConnected && size < bestSize)) {
+                    bestSize = size;
+                    bestConnected = connected;
+                    next = i;
                 }
             }
             
-            if (nextTable.empty()) break;
-            plan = "(" + nextTable + " ⨝ " + plan + ")";
-            used.insert(nextTable);
+            int leaf = tree.addLeaf(next, estimator.estimate(JoinGraph::bit(next)));
+            plan = tree.addJoin(leaf, plan, bestSize);
+            used |= JoinGraph::bit(next);
+        }
+        
+        return tree;
+    }
+    
+    // Plan cache key: the query fingerprint under the settings that shape the plan
+    std::string cacheKey(const ParsedQuery& query) const {
+        std::ostringstream key;
+        key << static_cast<int>(options.algorithm) << "/" << static_cast<int>(options.estimator) << "/"
+            << options.budgetMs << " "
+            << QueryFingerprint::normalize(query);
+        return key.str();
+    }
+    
+    // A cached tree must join exactly the relations of graph, by the same indices
+    static bool fits(const JoinTree& tree, const JoinGraph& graph) {
+        if (tree.empty() || tree.nodes[tree.root].relations != graph.allRelations()) return false;
+        for (const auto& node : tree.nodes) {
+            if (node.relation >= graph.size()) return false;
+        }
+        return true;
+    }
+    
+    JoinTree enumeratePlan(const CardinalityEstimator& estimator) const {
+        using Clock = std::chrono::steady_clock;
+        auto start = Clock::now();
+        auto budget = [&](double ms) {
+            return start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(ms));
+        };
+        
+        JoinTree tree;
+        if (options.algorithm == PlannerAlgorithm::DP &&
+            estimator.joinGraph().size() <= DPccpEnumerator::MAX_RELATIONS) {
+            // Under a budget, DP gets half of it and anytime search the rest if DP does not finish
+            tree = DPccpEnumerator(estimator, options.budgetMs > 0 ? budget(options.budgetMs / 2)
+                                                                  : Clock::time_point::max()).run();
+            if (!tree.empty()) return tree;
         }
         
-        return plan;
+        tree = generatePostgresStylePlan(estimator);
+        if (options.algorithm == PlannerAlgorithm::Greedy) return tree;
+        
+        double budgetMs = options.budgetMs > 0 ? options.budgetMs : DEFAULT_ANYTIME_BUDGET_MS;
+        return AnytimeEnumerator(estimator, budget(budgetMs)).run(tree);
     }
     
 public:
-    JoinPlanGenerator(const char* conninfo) {
+    JoinPlanGenerator(const char* conninfo, std::shared_ptr<StatisticsCatalog> statistics = nullptr,
+                      PlannerOptions options = PlannerOptions())
+        : statistics(statistics ? std::move(statistics) : std::make_shared<StatisticsCatalog>()),
+          options(options) {
+        // Statistics from a column store need no connection, unless Postgres estimates cardinalities
+        if (this->statistics->offline() && options.estimator != EstimatorKind::Postgres) return;
         dbConn = PQconnectdb(conninfo);
         if (PQstatus(dbConn) != CONNECTION_OK) {
             std::string error = PQerrorMessage(dbConn);
@@ -304,26 +988,707 @@ public:
         }
     }
     
+    JoinPlanGenerator(const JoinPlanGenerator&) = delete;
+    JoinPlanGenerator& operator=(const JoinPlanGenerator&) = delete;
+    
+    // Estimator planning uses for graph, which must outlive it.
+    // Sketch and sample lookups happen inside the estimator's constructor, so their time is split out of it.
+    // Postgres estimates each subset when the enumerator first asks for it, which counts as enumeration.
+    std::unique_ptr<CardinalityEstimator> makeEstimator(const JoinGraph& graph) {
+        using Clock = std::chrono::steady_clock;
+        using Phase = PlannerMetrics::Phase;
+        PlannerMetrics* metrics = options.metrics.get();
+        if (options.estimator == EstimatorKind::Postgres) return std::make_unique<PostgresEstimator>(graph, dbConn);
+        
+        std::vector<double> baseCardinalities;
+        {
+            PlannerMetrics::Timer timer(metrics, Phase::Catalog);
+            baseCardinalities = getBaseCardinalities(graph);
+        }
+        Clock::duration lookupTime{0};
+        auto timed = [&](auto lookup) -> decltype(auto) {
+            auto lookupStart = Clock::now();
+            decltype(auto) summary = lookup();
+            lookupTime += Clock::now() - lookupStart;
+            return summary;
+        };
+        auto estimationStart = Clock::now();
+        std::unique_ptr<CardinalityEstimator> estimator;
+        if (options.estimator == EstimatorKind::Sampling) {
+            estimator = std::make_unique<SamplingEstimator>(graph, std::move(baseCardinalities),
+                [&](const JoinGraph::Relation& relation, const std::string& column) -> const KeySample& {
+                    return timed([&]() -> const KeySample& {
+                        return statistics->keySample(dbConn, relation.table, column, relation.alias, relation.filter);
+                    });
+                });
+        } else {
+            estimator = std::make_unique<SketchEstimator>(graph, std::move(baseCardinalities),
+                [&](const JoinGraph::Relation& relation, const std::string& column) -> const JoinKeySketch& {
+                    return timed([&]() -> const JoinKeySketch& {
+                        return statistics->sketch(dbConn, relation.table, column, relation.alias, relation.filter);
+                    });
+                });
+        }
+        if (metrics) {
+            metrics->record(Phase::Sketch, lookupTime);
+            metrics->record(Phase::Estimation, Clock::now() - estimationStart - lookupTime);
+        }
+        return estimator;
+    }
+    
+    // Invalidates cached statistics of tables changed since they were taken
+    int refreshStatistics() {
+        return statistics->refresh(dbConn);
+    }
+    
+    PlanResult planQuery(const std::string& query) {
+        using Clock = std::chrono::steady_clock;
+        using Phase = PlannerMetrics::Phase;
+        auto start = Clock::now();
+        PlannerMetrics* metrics = options.metrics.get();
+        PlannerMetrics::Timer total(metrics, Phase::Total);
+        
+        JoinInfo joinInfo;
+        {
+            PlannerMetrics::Timer timer(metrics, Phase::Parse);
+            joinInfo.query = SqlParser::parseQuery(query);
+            joinInfo.graph = joinInfo.query.joinGraph();
+        }
+        
+        const JoinGraph& graph = joinInfo.graph;
+        PlanResult result;
+        JoinTree tree;
+        std::string key;
+        // Read before planning, so a plan made while statistics change is filed under the old epoch
+        uint64_t epoch = statistics->epoch();
+        if (options.planCache) {
+            key = cacheKey(joinInfo.query);
+            result.cached = options.planCache->find(key, epoch, tree) && fits(tree, graph);
+        }
+        
+        std::unique_ptr<CardinalityEstimator> estimator = makeEstimator(graph);
+        if (result.cached) {
+            // The cached cardinalities belong to whichever query filled the entry: same
+            // shape, possibly other constants. Only the join order is reused.
+            for (auto& node : tree.nodes) node.cardinality = estimator->estimate(node.relations);
+        } else {
+            {
+                PlannerMetrics::Timer timer(metrics, Phase::Enumeration);
+                tree = enumeratePlan(*estimator);
+            }
+            if (options.planCache && !tree.empty()) options.planCache->insert(key, epoch, tree);
+        }
+        
+        {
+            PlannerMetrics::Timer timer(metrics, Phase::Rewrite);
+            result.plan = tree.toString(graph);
+            if (!tree.empty()) result.sql = JoinOrderRewriter(joinInfo.query, graph, tree).rewrite();
+        }
+        result.joinCount = std::max(0, graph.size() - 1);
+        result.joinPredicates = static_cast<int>(graph.joinPredicates().size());
+        result.planningMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        result.graph = graph;
+        result.tree = std::move(tree);
+        return result;
+    }
+    
     std::string getOptimalJoinPlan(const std::string& query) {
-        aliasToTable.clear();
-        parseAliases(query);
-        JoinInfo joinInfo = parseJoinConditions(query);
+        return planQuery(query).plan;
+    }
+};
+
+// Plans a whole workload of .sql files over a pool of connections, one per worker thread
+class BatchPlanner {
+private:
+    struct QueryOutcome {
+        PlanResult result;
+        ExecutionStats compass;
+        ExecutionStats postgres;
+        std::string error;
+    };
+    
+    std::string conninfo;
+    int workers;
+    PlannerOptions options;
+    ExecutionOptions execution;
+    std::shared_ptr<StatisticsCatalog> statistics;
+    QueryWorkload queries;
+    
+    static std::string csvEscape(const std::string& field) {
+        if (field.find_first_of(",\"\n") == std::string::npos) return field;
+        std::string escaped = "\"";
+        for (char c : field) {
+            if (c == '"') escaped += '"';
+            escaped += c;
+        }
+        return escaped + "\"";
+    }
+    
+public:
+    BatchPlanner(std::string conninfo, int workers, PlannerOptions options,
+                 std::shared_ptr<StatisticsCatalog> statistics, ExecutionOptions execution = ExecutionOptions())
+        : conninfo(std::move(conninfo)), workers(std::max(1, workers)), options(options), execution(execution),
+          statistics(std::move(statistics)) {}
+    
+    // Accepts .sql files and directories containing them
+    void addPath(const std::string& pathName) {
+        queries.addPath(pathName);
+    }
+    
+    size_t size() const { return queries.size(); }
+    
+    // Plans every query and writes query_id,join_plan,join_count,join_predicates,planning_ms rows, plus the
+    // runtimes of both plans when executing; returns the failure count
+    int run(std::ostream& csv) {
+        int poolSize = std::min<int>(workers, std::max<size_t>(1, queries.size()));
+        
+        // Connect up front so a bad conninfo fails before any work is scheduled.
+        // Workers share one statistics catalog so each key column is streamed only once.
+        std::vector<std::unique_ptr<JoinPlanGenerator>> pool;
+        for (int i = 0; i < poolSize; i++) {
+            pool.push_back(std::make_unique<JoinPlanGenerator>(conninfo.c_str(), statistics, options));
+        }
+        pool[0]->refreshStatistics();
+        std::unique_ptr<PlanExecutor> executor;
+        if (execution.enabled) {
+            executor = std::make_unique<PlanExecutor>(conninfo, execution.warmupRuns, execution.measuredRuns);
+        }
+        
+        std::vector<QueryOutcome> outcomes(queries.size());
+        std::atomic<size_t> next{0};
+        std::vector<std::thread> threads;
+        for (int i = 0; i < poolSize; i++) {
+            threads.emplace_back([&, i]() {
+                JoinPlanGenerator& generator = *pool[i];
+                for (size_t q = next++; q < queries.size(); q = next++) {
+                    try {
+                        outcomes[q].result = generator.planQuery(queries[q].sql);
+                    } catch (const std::exception& e) {
+                        outcomes[q].error = e.what();
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
         
-        for (const auto& table : joinInfo.tables) {
-            joinInfo.tableCardinalities[table] = getTableCardinality(table);
+        // One query at a time, so runs do not compete for the server
+        if (executor) {
+            for (size_t q = 0; q < queries.size(); q++) {
+                QueryOutcome& outcome = outcomes[q];
+                if (!outcome.error.empty()) continue;
+                try {
+                    outcome.compass = executor->runForced(outcome.result.sql);
+                    outcome.postgres = executor->runNative(queries[q].sql);
+                } catch (const std::exception& e) {
+                    outcome.error = e.what();
+                }
+            }
         }
         
-        updateSketchWithJoinStatistics(joinInfo);
+        if (executor && !execution.qerrorPrefix.empty()) {
+            QErrorReport report;
+            for (size_t q = 0; q < queries.size(); q++) {
+                const QueryOutcome& outcome = outcomes[q];
+                if (!outcome.error.empty()) continue;
+                report.addQuery(queries[q].queryId, outcome.result.joinPredicates,
+                                QErrorSample::collect(outcome.compass.plan, outcome.result.tree, outcome.result.graph));
+            }
+            report.write(execution.qerrorPrefix);
+        }
         
-        return generatePostgresStylePlan(joinInfo);
+        int failures = 0;
+        csv << "query_id,join_plan,join_count,join_predicates,planning_ms";
+        if (executor) {
+            csv << ",compass_ms,postgres_ms,compass_shared_hit,compass_shared_read,"
+                   "postgres_shared_hit,postgres_shared_read,compass_memory_kb,postgres_memory_kb";
+        }
+        csv << "\n";
+        for (size_t q = 0; q < queries.size(); q++) {
+            const QueryOutcome& outcome = outcomes[q];
+            if (!outcome.error.empty()) {
+                std::cerr << "Error planning " << queries[q].queryId << ": " << outcome.error << std::endl;
+                failures++;
+                continue;
+            }
+            csv << csvEscape(queries[q].queryId) << ","
+                << csvEscape(outcome.result.plan) << ","
+                << outcome.result.joinCount << ","
+                << outcome.result.joinPredicates << ","
+                << outcome.result.planningMs;
+            if (executor) {
+                csv << "," << outcome.compass.wallMs << "," << outcome.postgres.wallMs
+                    << "," << outcome.compass.sharedHitBlocks << "," << outcome.compass.sharedReadBlocks
+                    << "," << outcome.postgres.sharedHitBlocks << "," << outcome.postgres.sharedReadBlocks
+                    << "," << outcome.compass.memoryKb << "," << outcome.postgres.memoryKb;
+            }
+            csv << "\n";
+        }
+        return failures;
+    }
+};
+
+// Planner daemon: one JoinPlanGenerator (and connection) per worker over shared
+// statistics, so catalog stats and sketches stay resident between requests.
+// Each request is answered with one line of JSON.
+class PlannerServer {
+private:
+    std::vector<std::unique_ptr<JoinPlanGenerator>> pool;
+    std::shared_ptr<PlannerMetrics> metrics;
+    
+    // The METRICS; request returns the latency histograms instead of a plan
+    static bool isMetricsRequest(const std::string& request) {
+        std::string word;
+        for (char c : request) {
+            if (c == ';' || std::isspace(static_cast<unsigned char>(c))) continue;
+            word += static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+            if (word.size() > 7) return false;
+        }
+        return word == "METRICS";
+    }
+    
+    static std::string jsonEscape(const std::string& value) {
+        std::string escaped;
+        for (char c : value) {
+            if (c == '"' || c == '\\') {
+                escaped += '\\';
+                escaped += c;
+            } else if (c == '\n') {
+                escaped += "\\n";
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                escaped += ' ';
+            } else {
+                escaped += c;
+            }
+        }
+        return escaped;
+    }
+    
+    std::string answer(int worker, const std::string& request) {
+        if (metrics && isMetricsRequest(request)) return metrics->json();
+        try {
+            PlanResult result = pool[worker]->planQuery(request);
+            if (result.tree.empty()) throw std::runtime_error("Query has no FROM relations to join");
+            std::ostringstream out;
+            out << "{\"plan\": \"" << jsonEscape(result.plan) << "\""
+                << ", \"join_count\": " << result.joinCount
+                << ", \"join_predicates\": " << result.joinPredicates
+                << ", \"estimated_rows\": " << result.tree.nodes[result.tree.root].cardinality
+                << ", \"estimated_cost\": " << result.tree.cost()
+                << ", \"planning_ms\": " << result.planningMs
+                << ", \"cached\": " << (result.cached ? "true" : "false")
+                << ", \"sql\": \"" << jsonEscape(result.sql) << "\"}";
+            return out.str();
+        } catch (const std::exception& e) {
+            return "{\"error\": \"" + jsonEscape(e.what()) + "\"}";
+        }
+    }
+    
+public:
+    PlannerServer(const std::string& conninfo, int workers, PlannerOptions options,
+                  std::shared_ptr<StatisticsCatalog> statistics)
+        : metrics(options.metrics) {
+        for (int i = 0; i < std::max(1, workers); i++) {
+            pool.push_back(std::make_unique<JoinPlanGenerator>(conninfo.c_str(), statistics, options));
+        }
+        pool[0]->refreshStatistics();
+    }
+    
+    // Serves clients of a Unix domain socket until SIGINT or SIGTERM, or a single
+    // client on stdin/stdout until end of input when socketPath is "-"
+    void run(const std::string& socketPath) {
+        LineServer server(static_cast<int>(pool.size()),
+                          [this](int worker, const std::string& request) { return answer(worker, request); });
+        if (socketPath == "-") {
+            server.serve(0, STDIN_FILENO, STDOUT_FILENO);
+        } else {
+            std::cerr << "Planning on " << socketPath << " with " << pool.size() << " workers" << std::endl;
+            server.listen(socketPath);
+        }
     }
 };
 
-int main() {
-    const char *conninfo = "dbname=job user=postgres password=postgres hostaddr=127.0.0.1 port=5432";
+static void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [--jobs N] [--output FILE] [--conninfo STR] [--planner dp|greedy|anytime]\n"
+              << "       [--estimator sketch|postgres|sampling] [--plan-budget-ms MS]\n"
+              << "       [--stats-snapshot FILE] [--column-store DIR] [--change-slot NAME]\n"
+              << "       [--execute [--warmup N] [--repeat N]]\n"
+              << "       [--qerror PREFIX] [--ground-truth FILE [--truth-max-relations N] [--truth-timeout-ms MS]]\n"
+              << "       [--evaluate PREFIX [--truth FILE] [--compare ESTIMATOR,...]]\n"
+              << "       [--serve SOCKET|-] [--plan-cache-mb N] [--plan-cache FILE] [--metrics PREFIX]\n"
+              << "       [<file.sql|dir>...]\n"
+              << "  Without paths, plans the built-in example query.\n"
+              << "  --column-store takes statistics from files written by imdb_loader; no database is\n"
+              << "  needed unless --execute, --qerror, --ground-truth or --estimator postgres is given.\n"
+              << "  --estimator picks where subset cardinalities come from: join-key sketches (default),\n"
+              << "  Postgres's EXPLAIN estimate of each subset, or joins of correlated key samples.\n"
+              << "  --change-slot applies the inserts and deletes queued in a test_decoding replication slot\n"
+              << "  (created on first use; needs wal_level=logical) to the snapshot's sketches before planning.\n"
+              << "  Tables need REPLICA IDENTITY FULL, or their deletes and updates force a rebuild.\n"
+              << "  --serve keeps statistics warm and plans each ';'-terminated query sent to a Unix socket\n"
+              << "  (or read from stdin with -), answering with one JSON line; the snapshot is saved on exit.\n"
+              << "  --plan-cache-mb keeps up to N MB of join trees keyed by query fingerprint (constants and\n"
+              << "  alias names ignored), so repeats of a query template skip enumeration until the statistics\n"
+              << "  change; a cached tree is only re-estimated for the query at hand. --plan-cache also loads\n"
+              << "  and saves the cache in FILE (64 MB unless given).\n"
+              << "  --metrics writes per-phase planning latency percentiles to PREFIX.csv and PREFIX.json\n"
+              << "  on exit; a server also answers the request METRICS; with them at any time.\n"
+              << "  --execute runs our plan and Postgres's plan with EXPLAIN ANALYZE after planning.\n"
+              << "  --qerror also writes per-node, per-query and per-bucket q-errors (implies --execute).\n"
+              << "  --ground-truth counts every connected sub-join of the given queries into FILE instead\n"
+              << "  of planning them; cached counts are not recomputed.\n"
+              << "  --evaluate ranks the sub-joins of each query with a count in the --truth file (default\n"
+              << "  compass_truth.cache) by each --compare estimator (default sketch,postgres) instead of\n"
+              << "  planning, and writes L1 ordering distances, q-errors and per-query winners per sub-join,\n"
+              << "  query and join bucket to PREFIX_subplans.csv, PREFIX_queries.csv, PREFIX_buckets.csv\n"
+              << "  and PREFIX.json.\n"
+              << "  An empty --stats-snapshot disables the statistics snapshot." << std::endl;
+}
+
+// Fills the true cardinality cache for every query of the workload; returns the failure count
+static int computeGroundTruth(const QueryWorkload& workload, const std::string& conninfo, int jobs,
+                              const std::string& cachePath, int maxRelations, int timeoutMs) {
+    TrueCardinalityCache cache;
+    cache.load(cachePath);
+    size_t cached = cache.size();
+    CardinalityOracle oracle(conninfo, jobs, cache, timeoutMs);
+    
+    int failures = 0;
+    for (const auto& query : workload) {
+        try {
+            JoinGraph graph = SqlParser::parseQuery(query.sql).joinGraph();
+            auto start = std::chrono::steady_clock::now();
+            auto counts = oracle.trueCardinalities(graph, maxRelations);
+            double elapsedMs = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+            std::cout << query.queryId << ": " << counts.size() << "/" << graph.connectedSubsets(maxRelations).size()
+                      << " sub-joins in " << elapsedMs << " ms" << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << "Error counting " << query.queryId << ": " << e.what() << std::endl;
+            failures++;
+        }
+        // Saved after every query so an interrupted run keeps its progress
+        if (cache.isModified()) cache.save(cachePath);
+    }
+    std::cout << "True cardinality cache " << cachePath << ": " << cache.size() << " entries ("
+              << cache.size() - cached << " new)" << std::endl;
+    return failures;
+}
+
+// Scores the subset estimates of each estimator named in systems against the true cardinalities in
+// truthPath, over every sub-join of two or more relations with a known count. Queries are spread over
+// jobs workers, each with a generator per estimator; returns the failure count
+static int evaluatePlanQuality(const QueryWorkload& workload, const std::string& conninfo, int jobs,
+                               PlannerOptions options, const std::shared_ptr<StatisticsCatalog>& statistics,
+                               const std::vector<std::string>& systems, const std::string& truthPath,
+                               const std::string& prefix) {
+    TrueCardinalityCache truth;
+    if (!truth.load(truthPath)) {
+        throw std::runtime_error("No true cardinalities in " + truthPath + "; count them with --ground-truth");
+    }
+    
+    int poolSize = std::min<int>(std::max(1, jobs), std::max<size_t>(1, workload.size()));
+    std::vector<std::vector<std::unique_ptr<JoinPlanGenerator>>> pool(poolSize);
+    for (auto& generators : pool) {
+        for (const auto& system : systems) {
+            options.estimator = parseEstimatorKind(system);
+            generators.push_back(std::make_unique<JoinPlanGenerator>(conninfo.c_str(), statistics, options));
+        }
+    }
+    pool[0][0]->refreshStatistics();
+    
+    struct Outcome {
+        int joinPredicates = 0;
+        std::vector<SubplanCardinality> subplans;
+        std::string error;
+    };
+    std::vector<Outcome> outcomes(workload.size());
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < poolSize; i++) {
+        threads.emplace_back([&, i]() {
+            for (size_t q = next++; q < workload.size(); q = next++) {
+                Outcome& outcome = outcomes[q];
+                try {
+                    JoinGraph graph = SqlParser::parseQuery(workload[q].sql).joinGraph();
+                    uint64_t query = TrueCardinalityCache::fingerprint(graph);
+                    std::vector<std::unique_ptr<CardinalityEstimator>> estimators;
+                    for (auto& generator : pool[i]) estimators.push_back(generator->makeEstimator(graph));
+                    
+                    outcome.joinPredicates = static_cast<int>(graph.joinPredicates().size());
+                    for (uint64_t subset : graph.connectedSubsets()) {
+                        SubplanCardinality subplan;
+                        if (__builtin_popcountll(subset) < 2 || !truth.find(query, subset, subplan.actualRows)) continue;
+                        for (uint64_t rest = subset; rest; rest &= rest - 1) {
+                            if (!subplan.subplan.empty()) subplan.subplan += " ⨝ ";
+                            subplan.subplan += graph.relation(__builtin_ctzll(rest)).alias;
+                        }
+                        subplan.relations = __builtin_popcountll(subset);
+                        for (const auto& estimator : estimators) subplan.estimates.push_back(estimator->estimate(subset));
+                        outcome.subplans.push_back(std::move(subplan));
+                    }
+                } catch (const std::exception& e) {
+                    outcome.error = e.what();
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    
+    PlanQualityReport report(systems);
+    int failures = 0;
+    for (size_t q = 0; q < workload.size(); q++) {
+        if (!outcomes[q].error.empty()) {
+            std::cerr << "Error evaluating " << workload[q].queryId << ": " << outcomes[q].error << std::endl;
+            failures++;
+            continue;
+        }
+        if (outcomes[q].subplans.empty()) {
+            std::cerr << "No true cardinalities for " << workload[q].queryId << " in " << truthPath << std::endl;
+        }
+        report.addQuery(workload[q].queryId, outcomes[q].joinPredicates, std::move(outcomes[q].subplans));
+    }
+    report.write(prefix);
+    return failures;
+}
+
+// Seeds statistics from the snapshot file when there is one; with a column store
+// directory the rest is computed from it instead of the database, sketching
+// each column on up to jobs threads
+static std::shared_ptr<StatisticsCatalog> loadStatistics(const std::string& snapshotPath,
+                                                         const std::string& columnStorePath, int jobs) {
+    std::shared_ptr<const ColumnStore> store;
+    if (!columnStorePath.empty()) store = std::make_shared<ColumnStore>(columnStorePath);
+    auto statistics = std::make_shared<StatisticsCatalog>(store, jobs);
+    StatsSnapshot snapshot;
+    try {
+        if (!snapshotPath.empty() && StatsSnapshot::load(snapshotPath, snapshot)) {
+            statistics->load(std::move(snapshot));
+        }
+    } catch (const std::exception& e) {
+        // The snapshot is only a cache: rebuild it rather than fail
+        std::cerr << "Ignoring stats snapshot: " << e.what() << std::endl;
+    }
+    return statistics;
+}
+
+// Applies the row changes waiting in a test_decoding replication slot to the cached
+// sketches, so they follow inserts and deletes without being rebuilt
+static void catchUpChanges(StatisticsCatalog& statistics, const std::string& conninfo, const std::string& slot) {
+    ChangeStream stream(conninfo, slot);
+    int dropped = statistics.trackChanges(stream.startLsn());
+    uint64_t changes = 0;
+    uint64_t lsn = stream.consume(
+        [&](const RowChange& change) {
+            statistics.applyChange(change);
+            changes++;
+        },
+        [&](const std::string& table) { statistics.invalidateTable(table); });
+    statistics.markSynchronized(stream.connection(), lsn);
+    std::cout << "Applied " << changes << " row changes from slot " << slot << " up to LSN " << formatLsn(lsn);
+    if (dropped > 0) std::cout << " (" << dropped << " sketches predate the stream and will be rebuilt)";
+    std::cout << std::endl;
+}
+
+// Plan cache of capacityMb megabytes, seeded from path when it names an existing file;
+// null when caching is off
+static std::shared_ptr<PlanCache> loadPlanCache(const std::string& path, double capacityMb) {
+    if (capacityMb <= 0) return nullptr;
+    auto cache = std::make_shared<PlanCache>(static_cast<size_t>(capacityMb * 1024 * 1024));
+    try {
+        if (!path.empty()) cache->load(path);
+    } catch (const std::exception& e) {
+        std::cerr << "Ignoring plan cache: " << e.what() << std::endl;
+    }
+    return cache;
+}
+
+static void savePlanCache(const std::shared_ptr<PlanCache>& cache, const std::string& path) {
+    if (!cache) return;
+    std::cout << "Plan cache: " << cache->hitCount() << " hits, " << cache->missCount() << " misses, "
+              << cache->size() << " entries" << std::endl;
+    if (!path.empty() && cache->isModified()) cache->save(path);
+}
+
+static void saveStatistics(const StatisticsCatalog& statistics, const std::string& snapshotPath) {
+    if (!snapshotPath.empty() && statistics.isModified()) {
+        statistics.snapshot().save(snapshotPath);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::string conninfo = "dbname=job user=postgres password=postgres hostaddr=127.0.0.1 port=5432";
+    std::string outputPath = "compass_results.csv";
+    int jobs = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    std::string plannerName = "dp";
+    std::string estimatorName = "sketch";
+    double budgetMs = 0;
+    std::string snapshotPath = "compass_stats.snapshot";
+    std::string columnStorePath;
+    std::string changeSlot;
+    std::string serveSocket;
+    std::string planCachePath;
+    double planCacheMb = 0;
+    std::string metricsPrefix;
+    ExecutionOptions execution;
+    std::string groundTruthPath;
+    int truthMaxRelations = 0;
+    int truthTimeoutMs = 0;
+    std::string evaluatePrefix;
+    std::string truthPath = "compass_truth.cache";
+    std::string compareNames = "sketch,postgres";
+    std::vector<std::string> paths;
+    
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--jobs" && hasValue) {
+            jobs = std::atoi(argv[++i]);
+        } else if (arg == "--output" && hasValue) {
+            outputPath = argv[++i];
+        } else if (arg == "--conninfo" && hasValue) {
+            conninfo = argv[++i];
+        } else if (arg == "--planner" && hasValue) {
+            plannerName = argv[++i];
+        } else if (arg == "--estimator" && hasValue) {
+            estimatorName = argv[++i];
+        } else if (arg == "--plan-budget-ms" && hasValue) {
+            budgetMs = std::atof(argv[++i]);
+        } else if (arg == "--stats-snapshot" && hasValue) {
+            snapshotPath = argv[++i];
+        } else if (arg == "--column-store" && hasValue) {
+            columnStorePath = argv[++i];
+        } else if (arg == "--change-slot" && hasValue) {
+            changeSlot = argv[++i];
+        } else if (arg == "--serve" && hasValue) {
+            serveSocket = argv[++i];
+        } else if (arg == "--plan-cache-mb" && hasValue) {
+            planCacheMb = std::atof(argv[++i]);
+        } else if (arg == "--plan-cache" && hasValue) {
+            planCachePath = argv[++i];
+        } else if (arg == "--metrics" && hasValue) {
+            metricsPrefix = argv[++i];
+        } else if (arg == "--execute") {
+            execution.enabled = true;
+        } else if (arg == "--qerror" && hasValue) {
+            execution.enabled = true;
+            execution.qerrorPrefix = argv[++i];
+        } else if (arg == "--ground-truth" && hasValue) {
+            groundTruthPath = argv[++i];
+        } else if (arg == "--truth-max-relations" && hasValue) {
+            truthMaxRelations = std::atoi(argv[++i]);
+        } else if (arg == "--truth-timeout-ms" && hasValue) {
+            truthTimeoutMs = std::atoi(argv[++i]);
+        } else if (arg == "--evaluate" && hasValue) {
+            evaluatePrefix = argv[++i];
+        } else if (arg == "--truth" && hasValue) {
+            truthPath = argv[++i];
+        } else if (arg == "--compare" && hasValue) {
+            compareNames = argv[++i];
+        } else if (arg == "--warmup" && hasValue) {
+            execution.warmupRuns = std::atoi(argv[++i]);
+        } else if (arg == "--repeat" && hasValue) {
+            execution.measuredRuns = std::atoi(argv[++i]);
+        } else if (arg == "--help" || arg.rfind("--", 0) == 0) {
+            printUsage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        } else {
+            paths.push_back(arg);
+        }
+    }
     
     try {
-        JoinPlanGenerator generator(conninfo);
+        PlannerOptions options;
+        options.algorithm = parsePlannerAlgorithm(plannerName);
+        options.estimator = parseEstimatorKind(estimatorName);
+        options.budgetMs = budgetMs;
+        if (!planCachePath.empty() && planCacheMb <= 0) planCacheMb = 64;
+        options.planCache = loadPlanCache(planCachePath, planCacheMb);
+        if (!metricsPrefix.empty() || !serveSocket.empty()) options.metrics = std::make_shared<PlannerMetrics>();
+        if (!groundTruthPath.empty()) {
+            QueryWorkload workload;
+            for (const auto& path : paths) {
+                workload.addPath(path);
+            }
+            return computeGroundTruth(workload, conninfo, jobs, groundTruthPath, truthMaxRelations,
+                                      truthTimeoutMs) == 0 ? 0 : 1;
+        }
+        
+        auto statistics = loadStatistics(snapshotPath, columnStorePath, jobs);
+        if (!changeSlot.empty()) {
+            if (statistics->offline()) throw std::runtime_error("--change-slot cannot be used with --column-store");
+            catchUpChanges(*statistics, conninfo, changeSlot);
+        }
+        
+        if (!evaluatePrefix.empty()) {
+            std::vector<std::string> systems;
+            std::stringstream names(compareNames);
+            for (std::string name; std::getline(names, name, ',');) {
+                parseEstimatorKind(name);
+                // Each system names its own columns of the report
+                if (std::find(systems.begin(), systems.end(), name) != systems.end()) {
+                    throw std::invalid_argument("Estimator '" + name + "' is compared more than once");
+                }
+                systems.push_back(name);
+            }
+            if (systems.empty()) {
+                printUsage(argv[0]);
+                return 1;
+            }
+            QueryWorkload workload;
+            for (const auto& path : paths) {
+                workload.addPath(path);
+            }
+            auto start = std::chrono::steady_clock::now();
+            int failures = evaluatePlanQuality(workload, conninfo, jobs, options, statistics, systems, truthPath,
+                                               evaluatePrefix);
+            saveStatistics(*statistics, snapshotPath);
+            double elapsedMs = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+            std::cout << "Evaluated " << workload.size() - failures << "/" << workload.size()
+                      << " queries with " << jobs << " workers in " << elapsedMs << " ms -> "
+                      << evaluatePrefix << ".json" << std::endl;
+            return failures == 0 ? 0 : 1;
+        }
+        
+        if (!serveSocket.empty()) {
+            PlannerServer server(conninfo, jobs, options, statistics);
+            server.run(serveSocket);
+            saveStatistics(*statistics, snapshotPath);
+            savePlanCache(options.planCache, planCachePath);
+            if (!metricsPrefix.empty()) options.metrics->write(metricsPrefix);
+            return 0;
+        }
+        
+        if (!paths.empty()) {
+            BatchPlanner batch(conninfo, jobs, options, statistics, execution);
+            for (const auto& path : paths) {
+                batch.addPath(path);
+            }
+            
+            std::ofstream csv(outputPath);
+            if (!csv.is_open()) {
+                throw std::runtime_error("Could not open output file " + outputPath);
+            }
+            
+            auto start = std::chrono::steady_clock::now();
+            int failures = batch.run(csv);
+            saveStatistics(*statistics, snapshotPath);
+            savePlanCache(options.planCache, planCachePath);
+            if (!metricsPrefix.empty()) options.metrics->write(metricsPrefix);
+            double elapsedMs = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+            std::cout << "Planned " << batch.size() - failures << "/" << batch.size()
+                      << " queries with " << jobs << " workers in " << elapsedMs << " ms -> "
+                      << outputPath << std::endl;
+            return failures == 0 ? 0 : 1;
+        }
+        
+        JoinPlanGenerator generator(conninfo.c_str(), statistics, options);
+        generator.refreshStatistics();
     
         std::string input_query = R"SQL(
         SELECT MIN(k.keyword) AS movie_keyword,
@@ -344,8 +1709,31 @@ WHERE k.keyword = 'marvel-cinematic-universe'
   AND n.id = ci.person_id;
         )SQL";
         
-        std::string optimalPlan = generator.getOptimalJoinPlan(input_query);
-        std::cout << "Optimal Join Plan:\n" << optimalPlan << std::endl;
+        PlanResult result = generator.planQuery(input_query);
+        std::cout << "Optimal Join Plan:\n" << result.plan << std::endl;
+        saveStatistics(*statistics, snapshotPath);
+        savePlanCache(options.planCache, planCachePath);
+        if (!metricsPrefix.empty()) options.metrics->write(metricsPrefix);
+        
+        if (execution.enabled) {
+            PlanExecutor executor(conninfo, execution.warmupRuns, execution.measuredRuns);
+            auto report = [](const char* name, const ExecutionStats& stats) {
+                std::cout << name << ": " << stats.wallMs << " ms (min " << stats.minWallMs << " ms over "
+                          << stats.runs << " runs), shared hit " << stats.sharedHitBlocks << ", read "
+                          << stats.sharedReadBlocks << ", memory " << stats.memoryKb << " kB\n"
+                          << "  executed as " << stats.joinOrder << std::endl;
+            };
+            ExecutionStats compass = executor.runForced(result.sql);
+            report("COMPASS plan", compass);
+            report("Postgres plan", executor.runNative(input_query));
+            
+            if (!execution.qerrorPrefix.empty()) {
+                QErrorReport qerrors;
+                qerrors.addQuery("example", result.joinPredicates,
+                                 QErrorSample::collect(compass.plan, result.tree, result.graph));
+                qerrors.write(execution.qerrorPrefix);
+            }
+        }
         
         return 0;
     } catch (const std::exception& e) {
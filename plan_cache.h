@@ -0,0 +1,293 @@
+#pragma once
+
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <list>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+
+#include "binary_io.h"
+#include "join_enumerator.h"
+#include "sql_parser.h"
+
+// Normalized text of a query that only keeps what decides its join graph's
+// shape: literals become '?', IN lists collapse to one '?', aliases are
+// renamed to their position in the FROM list and unquoted names are
+// lowercased. Queries of one template with different constants share a
+// fingerprint. Relation i of the join graph is FROM entry i, so a join tree
+// planned for one query of the template applies unchanged to the others.
+class QueryFingerprint {
+public:
+    static std::string normalize(const ParsedQuery& query) {
+        using TokenType = SqlLexer::TokenType;
+        std::unordered_map<std::string, int> aliases;
+        for (size_t i = 0; i < query.tables.size(); i++) {
+            aliases.emplace(lower(query.tables[i].alias), static_cast<int>(i));
+        }
+
+        std::string text;
+        // The last two tokens appended, to fold "? , ?" into "?"
+        std::string previous;
+        std::string beforePrevious;
+        auto append = [&](const std::string& token) {
+            if (token == "?" && previous == "," && beforePrevious == "?") {
+                text.resize(text.size() - 2);
+                previous = "?";
+                beforePrevious.clear();
+                return;
+            }
+            text += token;
+            text += ' ';
+            beforePrevious = std::move(previous);
+            previous = token;
+        };
+
+        SqlLexer lexer(query.sql);
+        for (SqlLexer::Token token = lexer.next(); token.type != TokenType::End; token = lexer.next()) {
+            if (token.type == TokenType::String || token.type == TokenType::Number) {
+                append("?");
+            } else if (token.type == TokenType::Identifier) {
+                std::string name = lower(token.text);
+                auto alias = aliases.find(name);
+                append(alias == aliases.end() ? name : "$" + std::to_string(alias->second));
+            } else {
+                append(std::string(token.text));
+            }
+        }
+        return text;
+    }
+
+    // FNV-1a, for bucketing; entries keep the full normalized text to rule out collisions
+    static uint64_t hash(std::string_view text) {
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (char c : text) {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 0x100000001b3ULL;
+        }
+        return hash;
+    }
+
+private:
+    static std::string lower(std::string_view text) {
+        std::string result(text);
+        for (char& c : result) {
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        }
+        return result;
+    }
+};
+
+// Bounded LRU cache of join trees keyed by query fingerprint. Each entry
+// records the statistics epoch it was planned under and is only returned
+// while the statistics still have that epoch. Thread-safe; can be saved to
+// and loaded from a file so the cache survives restarts.
+class PlanCache {
+private:
+    static constexpr uint32_t FORMAT_VERSION = 1;
+    static constexpr char MAGIC[8] = {'C', 'M', 'P', 'P', 'L', 'A', 'N', 'C'};
+    // Rough per-entry bookkeeping cost of the list node and the index
+    static constexpr size_t ENTRY_OVERHEAD = 128;
+
+    struct Entry {
+        std::string key;
+        uint64_t epoch = 0;
+        JoinTree tree;
+
+        size_t bytes() const {
+            return key.size() + tree.nodes.size() * sizeof(JoinTree::Node) + ENTRY_OVERHEAD;
+        }
+    };
+
+    mutable std::mutex mutex;
+    size_t capacityBytes;
+    size_t usedBytes = 0;
+    // Most recently used first
+    std::list<Entry> entries;
+    std::unordered_multimap<uint64_t, std::list<Entry>::iterator> index;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    bool modified = false;
+
+    std::list<Entry>::iterator locate(const std::string& key) {
+        auto range = index.equal_range(QueryFingerprint::hash(key));
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second->key == key) return it->second;
+        }
+        return entries.end();
+    }
+
+    void erase(std::list<Entry>::iterator entry) {
+        auto range = index.equal_range(QueryFingerprint::hash(entry->key));
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == entry) {
+                index.erase(it);
+                break;
+            }
+        }
+        usedBytes -= entry->bytes();
+        entries.erase(entry);
+    }
+
+    void insertFront(Entry entry) {
+        usedBytes += entry.bytes();
+        entries.push_front(std::move(entry));
+        index.emplace(QueryFingerprint::hash(entries.front().key), entries.begin());
+        while (usedBytes > capacityBytes && !entries.empty()) {
+            erase(std::prev(entries.end()));
+        }
+    }
+
+public:
+    explicit PlanCache(size_t capacityBytes) : capacityBytes(capacityBytes) {}
+
+    // The join tree cached for key under epoch, if any; entries of older epochs are dropped
+    bool find(const std::string& key, uint64_t epoch, JoinTree& tree) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto entry = locate(key);
+        if (entry == entries.end() || entry->epoch != epoch) {
+            if (entry != entries.end()) {
+                erase(entry);
+                modified = true;
+            }
+            misses++;
+            return false;
+        }
+        entries.splice(entries.begin(), entries, entry);
+        tree = entry->tree;
+        hits++;
+        return true;
+    }
+
+    void insert(const std::string& key, uint64_t epoch, const JoinTree& tree) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto existing = locate(key);
+        if (existing != entries.end()) erase(existing);
+        insertFront({key, epoch, tree});
+        modified = true;
+    }
+
+    uint64_t hitCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return hits;
+    }
+
+    uint64_t missCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return misses;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.size();
+    }
+
+    bool isModified() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return modified;
+    }
+
+    // Returns false when the file does not exist; throws when it is corrupt or from another version
+    bool load(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+
+        struct stat info;
+        if (::fstat(fd, &info) != 0 || info.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        size_t size = static_cast<size_t>(info.st_size);
+        void* data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            throw std::runtime_error("Failed to mmap plan cache " + path);
+        }
+
+        std::list<Entry> loaded;
+        try {
+            BinaryReader reader(static_cast<const char*>(data), size);
+            char magic[sizeof(MAGIC)];
+            reader.readBytes(magic, sizeof(magic));
+            if (std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) throw std::runtime_error("bad magic");
+            if (reader.read<uint32_t>() != FORMAT_VERSION) throw std::runtime_error("unsupported format version");
+            uint32_t count = reader.read<uint32_t>();
+            for (uint32_t i = 0; i < count; i++) {
+                Entry entry;
+                entry.key = reader.readString();
+                entry.epoch = reader.read<uint64_t>();
+                entry.tree.root = reader.read<int32_t>();
+                entry.tree.nodes.resize(reader.read<uint32_t>());
+                for (auto& node : entry.tree.nodes) {
+                    node.relation = reader.read<int32_t>();
+                    node.left = reader.read<int32_t>();
+                    node.right = reader.read<int32_t>();
+                    node.relations = reader.read<uint64_t>();
+                    node.cardinality = reader.read<double>();
+                }
+                loaded.push_back(std::move(entry));
+            }
+            if (!reader.atEnd()) throw std::runtime_error("trailing data");
+        } catch (const std::exception& e) {
+            ::munmap(data, size);
+            throw std::runtime_error("Invalid plan cache " + path + ": " + e.what());
+        }
+        ::munmap(data, size);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.clear();
+        index.clear();
+        usedBytes = 0;
+        // Stored most recent first; inserting from the back keeps that order
+        for (auto it = loaded.rbegin(); it != loaded.rend(); ++it) {
+            insertFront(std::move(*it));
+        }
+        modified = false;
+        return true;
+    }
+
+    // Writes to a temporary file first so readers never see a partial cache
+    void save(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::string buffer;
+        BinaryWriter writer(buffer);
+        writer.writeBytes(MAGIC, sizeof(MAGIC));
+        writer.write<uint32_t>(FORMAT_VERSION);
+        writer.write<uint32_t>(static_cast<uint32_t>(entries.size()));
+        for (const auto& entry : entries) {
+            writer.writeString(entry.key);
+            writer.write<uint64_t>(entry.epoch);
+            writer.write<int32_t>(entry.tree.root);
+            writer.write<uint32_t>(static_cast<uint32_t>(entry.tree.nodes.size()));
+            for (const auto& node : entry.tree.nodes) {
+                writer.write<int32_t>(node.relation);
+                writer.write<int32_t>(node.left);
+                writer.write<int32_t>(node.right);
+                writer.write<uint64_t>(node.relations);
+                writer.write<double>(node.cardinality);
+            }
+        }
+
+        std::string tmpPath = path + ".tmp";
+        {
+            std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+            if (!file.write(buffer.data(), buffer.size())) {
+                throw std::runtime_error("Failed to write plan cache " + tmpPath);
+            }
+        }
+        if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+            throw std::runtime_error("Failed to replace plan cache " + path);
+        }
+        modified = false;
+    }
+};
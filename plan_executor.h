@@ -0,0 +1,210 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <libpq-fe.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "explain_plan.h"
+#include "join_enumerator.h"
+#include "join_graph.h"
+#include "sql_parser.h"
+
+// Rewrites a comma-join query into explicit JOIN syntax nested like a join
+// tree. With join_collapse_limit = 1 Postgres keeps that join order and only
+// picks the join methods and the inner/outer side of each join.
+class JoinOrderRewriter {
+private:
+    struct JoinCondition {
+        int left;
+        int right;
+        std::string_view text;
+        bool used = false;
+    };
+
+    const ParsedQuery& query;
+    const JoinGraph& graph;
+    const JoinTree& tree;
+    std::vector<JoinCondition> conditions;
+
+    static bool contains(uint64_t relations, int relation) {
+        return (relations & JoinGraph::bit(relation)) != 0;
+    }
+
+    // Each join predicate goes to the lowest join that has both of its relations
+    std::string format(int node) {
+        const JoinTree::Node& n = tree.nodes[node];
+        if (n.relation >= 0) {
+            const JoinGraph::Relation& relation = graph.relation(n.relation);
+            return relation.alias == relation.table ? relation.table : relation.table + " AS " + relation.alias;
+        }
+
+        std::string left = format(n.left);
+        std::string right = format(n.right);
+        uint64_t leftSet = tree.nodes[n.left].relations;
+        uint64_t rightSet = tree.nodes[n.right].relations;
+
+        std::string on;
+        for (auto& condition : conditions) {
+            if (condition.used) continue;
+            if ((contains(leftSet, condition.left) && contains(rightSet, condition.right)) ||
+                (contains(leftSet, condition.right) && contains(rightSet, condition.left))) {
+                if (!on.empty()) on += " AND ";
+                on += condition.text;
+                condition.used = true;
+            }
+        }
+        if (on.empty()) return "(" + left + " CROSS JOIN " + right + ")";
+        return "(" + left + " JOIN " + right + " ON " + on + ")";
+    }
+
+public:
+    JoinOrderRewriter(const ParsedQuery& query, const JoinGraph& graph, const JoinTree& tree)
+        : query(query), graph(graph), tree(tree) {
+        for (const auto& join : query.joins) {
+            int left = graph.relationIndex(std::string(join.left.alias));
+            int right = graph.relationIndex(std::string(join.right.alias));
+            if (left < 0 || right < 0) continue;
+            conditions.push_back({left, right, query.nodeText(join.node)});
+        }
+    }
+
+    std::string rewrite() {
+        if (tree.empty()) throw std::runtime_error("JoinOrderRewriter: empty join tree");
+        std::string from = format(tree.root);
+
+        // Local filters and any other conjunct stay in WHERE; Postgres pushes them down itself
+        std::vector<std::string_view> where;
+        for (const auto& filter : query.filters) where.push_back(query.nodeText(filter.node));
+        for (int node : query.otherPredicates) where.push_back(query.nodeText(node));
+        for (const auto& condition : conditions) {
+            if (!condition.used) where.push_back(condition.text);
+        }
+
+        std::string sql = "SELECT " + std::string(query.selectList) + "\nFROM " + from;
+        for (size_t i = 0; i < where.size(); i++) {
+            sql += i == 0 ? "\nWHERE " : "\n  AND ";
+            sql += "(" + std::string(where[i]) + ")";
+        }
+        if (!query.trailer.empty()) sql += "\n" + std::string(query.trailer);
+        return sql + ";";
+    }
+};
+
+// Measurements of one query, taken from the run with the median wall time
+struct ExecutionStats {
+    int runs = 0;
+    double wallMs = 0;            // client-side time of EXPLAIN ANALYZE, median over runs
+    double minWallMs = 0;
+    double executionMs = 0;       // server-reported "Execution Time"
+    double planningMs = 0;        // server-reported "Planning Time"
+    double sharedHitBlocks = 0;
+    double sharedReadBlocks = 0;
+    double memoryKb = 0;          // hash and sort memory of the plan
+    std::string joinOrder;        // join order Postgres actually executed
+    ExplainPlan plan;             // the analyzed plan of that run
+};
+
+// Runs queries with EXPLAIN (ANALYZE, BUFFERS, FORMAT JSON) on its own
+// connection, after warm-up runs that fill the buffer cache
+class PlanExecutor {
+private:
+    PGconn* conn;
+    int warmupRuns;
+    int measuredRuns;
+
+    void exec(const std::string& sql) {
+        PGresult* res = PQexec(conn, sql.c_str());
+        if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+            std::string error = PQerrorMessage(conn);
+            PQclear(res);
+            throw std::runtime_error("Failed to run '" + sql + "': " + error);
+        }
+        PQclear(res);
+    }
+
+    ExplainPlan explainAnalyze(const std::string& sql, double& wallMs) {
+        std::string explain = "EXPLAIN (ANALYZE, BUFFERS, FORMAT JSON) " + sql;
+        auto start = std::chrono::steady_clock::now();
+        PGresult* res = PQexec(conn, explain.c_str());
+        wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+            std::string error = PQerrorMessage(conn);
+            PQclear(res);
+            throw std::runtime_error("EXPLAIN ANALYZE failed: " + error);
+        }
+        std::string json = PQgetvalue(res, 0, 0);
+        PQclear(res);
+        return ExplainPlan::parse(json);
+    }
+
+    ExecutionStats measure(const std::string& sql) {
+        double wallMs;
+        for (int i = 0; i < warmupRuns; i++) {
+            explainAnalyze(sql, wallMs);
+        }
+
+        std::vector<std::pair<double, ExplainPlan>> runs;
+        for (int i = 0; i < measuredRuns; i++) {
+            ExplainPlan plan = explainAnalyze(sql, wallMs);
+            runs.emplace_back(wallMs, std::move(plan));
+        }
+        std::sort(runs.begin(), runs.end(),
+            [](const auto& a, const auto& b) { return a.first < b.first; });
+
+        const auto& [medianMs, plan] = runs[runs.size() / 2];
+        ExecutionStats stats;
+        stats.runs = static_cast<int>(runs.size());
+        stats.wallMs = medianMs;
+        stats.minWallMs = runs.front().first;
+        stats.executionMs = plan.executionTime;
+        stats.planningMs = plan.planningTime;
+        stats.sharedHitBlocks = plan.nodes[plan.root].sharedHitBlocks;
+        stats.sharedReadBlocks = plan.nodes[plan.root].sharedReadBlocks;
+        stats.memoryKb = plan.memoryKb();
+        stats.joinOrder = plan.joinOrder();
+        stats.plan = plan;
+        return stats;
+    }
+
+public:
+    PlanExecutor(const std::string& conninfo, int warmupRuns, int measuredRuns)
+        : warmupRuns(std::max(0, warmupRuns)), measuredRuns(std::max(1, measuredRuns)) {
+        conn = PQconnectdb(conninfo.c_str());
+        if (PQstatus(conn) != CONNECTION_OK) {
+            std::string error = PQerrorMessage(conn);
+            PQfinish(conn);
+            throw std::runtime_error("Database connection failed: " + error);
+        }
+    }
+
+    ~PlanExecutor() {
+        PQfinish(conn);
+    }
+
+    PlanExecutor(const PlanExecutor&) = delete;
+    PlanExecutor& operator=(const PlanExecutor&) = delete;
+
+    // Postgres plans the query itself
+    ExecutionStats runNative(const std::string& sql) {
+        return measure(sql);
+    }
+
+    // Postgres keeps the join order spelled out by explicit JOIN syntax
+    ExecutionStats runForced(const std::string& sql) {
+        exec("SET join_collapse_limit = 1");
+        exec("SET from_collapse_limit = 1");
+        try {
+            ExecutionStats stats = measure(sql);
+            exec("RESET join_collapse_limit");
+            exec("RESET from_collapse_limit");
+            return stats;
+        } catch (...) {
+            exec("RESET join_collapse_limit");
+            exec("RESET from_collapse_limit");
+            throw;
+        }
+    }
+};
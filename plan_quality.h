@@ -0,0 +1,301 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <numeric>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "qerror.h"
+
+// True row count of one sub-join of a query and every compared system's estimate of it
+struct SubplanCardinality {
+    std::string subplan;            // relations of the subset, "a ⨝ b ⨝ c"
+    int relations = 0;
+    double actualRows = 0;
+    std::vector<double> estimates;  // one per system, in the order of the report's systems
+};
+
+// L1 distance between the ordering of a query's sub-joins by a system's
+// estimates and their ordering by true cardinality: L1 = Σ|Si - Ci| over the
+// positions of each sub-join in both orderings, and NormL1 = L1 / subplans.
+// Positions are 1-based ranks of the cardinalities clamped to one row, and
+// equal cardinalities share the mean of their positions, so the order in which
+// ties are listed does not count.
+struct OrderingDistance {
+    double l1 = 0;
+    double normalized = 0;
+
+    static std::vector<double> ranks(const std::vector<double>& values) {
+        std::vector<size_t> order(values.size());
+        std::iota(order.begin(), order.end(), 0);
+        auto rows = [&](size_t i) { return std::max(1.0, values[i]); };
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return rows(a) < rows(b); });
+
+        std::vector<double> result(values.size());
+        for (size_t first = 0; first < order.size();) {
+            size_t last = first;
+            while (last + 1 < order.size() && rows(order[last + 1]) == rows(order[first])) last++;
+            double rank = (first + last) / 2.0 + 1;
+            for (size_t i = first; i <= last; i++) result[order[i]] = rank;
+            first = last + 1;
+        }
+        return result;
+    }
+
+    static OrderingDistance between(const std::vector<double>& estimated, const std::vector<double>& actual) {
+        OrderingDistance distance;
+        if (actual.empty()) return distance;
+        std::vector<double> estimatedRanks = ranks(estimated);
+        std::vector<double> actualRanks = ranks(actual);
+        for (size_t i = 0; i < actual.size(); i++) {
+            distance.l1 += std::abs(estimatedRanks[i] - actualRanks[i]);
+        }
+        distance.normalized = distance.l1 / actual.size();
+        return distance;
+    }
+};
+
+// Scores several systems' cardinality estimates against true sub-join
+// cardinalities, query by query: the normalized L1 ordering distance, the
+// q-errors, and the winner of each query, i.e. the system with the smallest
+// normalized L1 (none on a tie). Results are written per sub-join, per query
+// and per bucket of join predicates, the buckets of QErrorReport.
+class PlanQualityReport {
+private:
+    struct QueryEntry {
+        std::string queryId;
+        int joinPredicates;
+        std::vector<SubplanCardinality> subplans;
+        std::vector<OrderingDistance> distances;  // per system
+        int winner;                               // system index, -1 on a tie or without sub-joins
+    };
+
+    std::vector<std::string> systems;
+    std::vector<QueryEntry> queries;
+
+    static std::string csvEscape(const std::string& field) {
+        if (field.find_first_of(",\"\n") == std::string::npos) return field;
+        std::string escaped = "\"";
+        for (char c : field) {
+            if (c == '"') escaped += '"';
+            escaped += c;
+        }
+        return escaped + "\"";
+    }
+
+    static std::string jsonEscape(const std::string& value) {
+        std::string escaped;
+        for (char c : value) {
+            if (c == '"' || c == '\\') escaped += '\\';
+            if (c == '\n') {
+                escaped += "\\n";
+                continue;
+            }
+            escaped += c;
+        }
+        return escaped;
+    }
+
+    static std::ofstream open(const std::string& path) {
+        std::ofstream file(path);
+        if (!file.is_open()) {
+            throw std::runtime_error("Could not open output file " + path);
+        }
+        return file;
+    }
+
+    // One query, or the queries of one bucket
+    struct Group {
+        std::string name;
+        int joinPredicates;   // -1 for buckets
+        std::vector<const QueryEntry*> entries;
+    };
+
+    // Per-system summary of a group
+    struct SystemScore {
+        double meanNormalizedL1 = 0;
+        QErrorDistribution normalizedL1;
+        QErrorDistribution qError;
+        size_t wins = 0;
+    };
+
+    SystemScore score(const Group& group, size_t system) const {
+        SystemScore result;
+        std::vector<double> distances;
+        std::vector<double> qErrors;
+        for (const QueryEntry* entry : group.entries) {
+            if (entry->subplans.empty()) continue;
+            distances.push_back(entry->distances[system].normalized);
+            if (entry->winner == static_cast<int>(system)) result.wins++;
+            for (const auto& subplan : entry->subplans) {
+                qErrors.push_back(QErrorSample::qError(subplan.estimates[system], subplan.actualRows));
+            }
+        }
+        if (!distances.empty()) {
+            result.meanNormalizedL1 = std::accumulate(distances.begin(), distances.end(), 0.0) / distances.size();
+        }
+        result.normalizedL1 = QErrorDistribution::of(std::move(distances));
+        result.qError = QErrorDistribution::of(std::move(qErrors));
+        return result;
+    }
+
+    static size_t ties(const Group& group) {
+        size_t count = 0;
+        for (const QueryEntry* entry : group.entries) {
+            if (entry->winner < 0 && !entry->subplans.empty()) count++;
+        }
+        return count;
+    }
+
+    static size_t subplanCount(const Group& group) {
+        size_t count = 0;
+        for (const QueryEntry* entry : group.entries) count += entry->subplans.size();
+        return count;
+    }
+
+    std::vector<Group> queryGroups() const {
+        std::vector<Group> groups;
+        for (const auto& query : queries) {
+            groups.push_back({query.queryId, query.joinPredicates, {&query}});
+        }
+        return groups;
+    }
+
+    std::vector<Group> bucketGroups() const {
+        std::vector<Group> groups;
+        for (int bucket = 0; bucket < QErrorReport::BUCKETS; bucket++) {
+            Group group{"", -1, {}};
+            int low = 0;
+            int high = 0;
+            for (const auto& query : queries) {
+                if (QErrorReport::bucketOf(query.joinPredicates) != bucket) continue;
+                if (group.entries.empty() || query.joinPredicates < low) low = query.joinPredicates;
+                if (group.entries.empty() || query.joinPredicates > high) high = query.joinPredicates;
+                group.entries.push_back(&query);
+            }
+            if (group.entries.empty()) continue;
+            group.name = std::to_string(low) + "-" + std::to_string(high);
+            groups.push_back(std::move(group));
+        }
+        return groups;
+    }
+
+    void writeGroupsCsv(const std::string& path, const char* firstColumn, bool perQuery,
+                        const std::vector<Group>& groups) const {
+        std::ofstream csv = open(path);
+        csv << firstColumn << (perQuery ? ",join_predicates" : "") << ",queries,subplans,ties";
+        for (const auto& system : systems) {
+            csv << "," << system << "_wins," << system << "_norm_l1_mean," << system << "_norm_l1_median,"
+                << system << "_norm_l1_max," << system << "_qerror_median," << system << "_qerror_p90,"
+                << system << "_qerror_max";
+        }
+        csv << "\n";
+        for (const auto& group : groups) {
+            csv << csvEscape(group.name);
+            if (perQuery) csv << "," << group.joinPredicates;
+            csv << "," << group.entries.size() << "," << subplanCount(group) << "," << ties(group);
+            for (size_t s = 0; s < systems.size(); s++) {
+                SystemScore result = score(group, s);
+                csv << "," << result.wins << "," << result.meanNormalizedL1 << "," << result.normalizedL1.median
+                    << "," << result.normalizedL1.max << "," << result.qError.median << "," << result.qError.p90
+                    << "," << result.qError.max;
+            }
+            csv << "\n";
+        }
+    }
+
+    void writeGroupsJson(std::ostream& out, const char* key, const std::vector<Group>& groups) const {
+        out << "  \"" << key << "\": [";
+        for (size_t i = 0; i < groups.size(); i++) {
+            const Group& group = groups[i];
+            out << (i == 0 ? "\n" : ",\n") << "    {\"name\": \"" << jsonEscape(group.name) << "\"";
+            if (group.joinPredicates >= 0) out << ", \"join_predicates\": " << group.joinPredicates;
+            out << ", \"queries\": " << group.entries.size() << ", \"subplans\": " << subplanCount(group)
+                << ", \"ties\": " << ties(group);
+            for (size_t s = 0; s < systems.size(); s++) {
+                SystemScore result = score(group, s);
+                out << ", \"" << jsonEscape(systems[s]) << "\": {\"wins\": " << result.wins
+                    << ", \"norm_l1\": {\"mean\": " << result.meanNormalizedL1
+                    << ", \"median\": " << result.normalizedL1.median << ", \"p90\": " << result.normalizedL1.p90
+                    << ", \"max\": " << result.normalizedL1.max << "}"
+                    << ", \"qerror\": {\"median\": " << result.qError.median << ", \"p90\": " << result.qError.p90
+                    << ", \"p99\": " << result.qError.p99 << ", \"max\": " << result.qError.max << "}}";
+            }
+            out << "}";
+        }
+        out << "\n  ]";
+    }
+
+public:
+    explicit PlanQualityReport(std::vector<std::string> systems) : systems(std::move(systems)) {}
+
+    void addQuery(const std::string& queryId, int joinPredicates, std::vector<SubplanCardinality> subplans) {
+        QueryEntry entry{queryId, joinPredicates, std::move(subplans), {}, -1};
+        std::vector<double> actual;
+        for (const auto& subplan : entry.subplans) actual.push_back(subplan.actualRows);
+        double best = 0;
+        for (size_t s = 0; s < systems.size(); s++) {
+            std::vector<double> estimated;
+            for (const auto& subplan : entry.subplans) estimated.push_back(subplan.estimates[s]);
+            entry.distances.push_back(OrderingDistance::between(estimated, actual));
+            double distance = entry.distances.back().normalized;
+            if (s == 0 || distance < best) {
+                best = distance;
+                entry.winner = static_cast<int>(s);
+            } else if (distance == best) {
+                entry.winner = -1;
+            }
+        }
+        if (entry.subplans.empty()) entry.winner = -1;
+        queries.push_back(std::move(entry));
+    }
+
+    // Writes <prefix>_subplans.csv, <prefix>_queries.csv, <prefix>_buckets.csv and <prefix>.json
+    void write(const std::string& prefix) const {
+        std::ofstream subplans = open(prefix + "_subplans.csv");
+        subplans << "query_id,join_predicates,relations,subplan,actual_rows,actual_rank";
+        for (const auto& system : systems) subplans << "," << system << "_estimate," << system << "_rank";
+        subplans << "\n";
+        for (const auto& query : queries) {
+            std::vector<double> actual;
+            std::vector<std::vector<double>> estimated(systems.size());
+            for (const auto& subplan : query.subplans) {
+                actual.push_back(subplan.actualRows);
+                for (size_t s = 0; s < systems.size(); s++) estimated[s].push_back(subplan.estimates[s]);
+            }
+            std::vector<double> actualRanks = OrderingDistance::ranks(actual);
+            std::vector<std::vector<double>> estimatedRanks;
+            for (const auto& estimates : estimated) estimatedRanks.push_back(OrderingDistance::ranks(estimates));
+            for (size_t i = 0; i < query.subplans.size(); i++) {
+                const SubplanCardinality& subplan = query.subplans[i];
+                subplans << csvEscape(query.queryId) << "," << query.joinPredicates << "," << subplan.relations << ","
+                         << csvEscape(subplan.subplan) << "," << subplan.actualRows << "," << actualRanks[i];
+                for (size_t s = 0; s < systems.size(); s++) {
+                    subplans << "," << subplan.estimates[s] << "," << estimatedRanks[s][i];
+                }
+                subplans << "\n";
+            }
+        }
+
+        std::vector<Group> perQuery = queryGroups();
+        std::vector<Group> perBucket = bucketGroups();
+        writeGroupsCsv(prefix + "_queries.csv", "query_id", true, perQuery);
+        writeGroupsCsv(prefix + "_buckets.csv", "bucket", false, perBucket);
+
+        std::ofstream json = open(prefix + ".json");
+        json << "{\n  \"systems\": [";
+        for (size_t s = 0; s < systems.size(); s++) {
+            json << (s == 0 ? "" : ", ") << "\"" << jsonEscape(systems[s]) << "\"";
+        }
+        json << "],\n";
+        writeGroupsJson(json, "queries", perQuery);
+        json << ",\n";
+        writeGroupsJson(json, "buckets", perBucket);
+        json << "\n}\n";
+    }
+};
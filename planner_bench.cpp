@@ -0,0 +1,278 @@
+// Microbenchmarks of the planner's hot paths: sketch updates and estimates,
+// parsing every JOB query and join enumeration per query size. Needs no
+// database: sketches are built from synthetic keys.
+//
+//   planner_bench [--filter TEXT] [--min-time-ms MS] [--save FILE] [--baseline FILE [--tolerance F]] [paths...]
+//
+// --save writes benchmark,ns_per_op,iterations rows; --baseline compares against
+// such a file and exits with 1 when a benchmark got slower than the tolerance allows.
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "cardinality_estimator.h"
+#include "fast_agm_sketch.h"
+#include "heavy_hitters.h"
+#include "join_enumerator.h"
+#include "query_workload.h"
+#include "sql_parser.h"
+
+namespace {
+
+struct BenchmarkResult {
+    std::string name;
+    double nsPerOp = 0;
+    uint64_t iterations = 0;
+};
+
+// Runs each benchmark for at least minTime per sample and reports the median of several samples
+class BenchmarkRunner {
+private:
+    static constexpr int SAMPLES = 5;
+
+    std::string filter;
+    std::chrono::duration<double> minTime;
+    std::vector<BenchmarkResult> results;
+
+public:
+    BenchmarkRunner(std::string filter, double minTimeMs) : filter(std::move(filter)), minTime(minTimeMs / 1000) {}
+
+    // body runs one call of opsPerCall operations; results are reported per operation
+    void run(const std::string& name, uint64_t opsPerCall, const std::function<void()>& body) {
+        using Clock = std::chrono::steady_clock;
+        if (!filter.empty() && name.find(filter) == std::string::npos) return;
+
+        // Calibrate the number of calls per sample
+        uint64_t calls = 1;
+        while (true) {
+            auto start = Clock::now();
+            for (uint64_t i = 0; i < calls; i++) body();
+            std::chrono::duration<double> elapsed = Clock::now() - start;
+            if (elapsed >= minTime || calls >= (1ULL << 30)) break;
+            double scale = elapsed.count() > 0 ? minTime / elapsed * 1.2 : 10;
+            calls = std::max(calls + 1, static_cast<uint64_t>(calls * std::min(scale, 10.0)));
+        }
+
+        std::vector<double> samples;
+        for (int s = 0; s < SAMPLES; s++) {
+            auto start = Clock::now();
+            for (uint64_t i = 0; i < calls; i++) body();
+            std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+            samples.push_back(elapsed.count() / (calls * opsPerCall));
+        }
+        std::nth_element(samples.begin(), samples.begin() + SAMPLES / 2, samples.end());
+
+        BenchmarkResult result{name, samples[SAMPLES / 2], calls * opsPerCall};
+        std::cout << std::left << std::setw(44) << name << std::right << std::setw(14) << std::fixed
+                  << std::setprecision(1) << result.nsPerOp << " ns/op" << std::setw(14) << result.iterations
+                  << " ops" << std::endl;
+        results.push_back(result);
+    }
+
+    const std::vector<BenchmarkResult>& all() const { return results; }
+};
+
+// Keeps the optimizer from discarding results
+template <typename T>
+void doNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+std::vector<int32_t> zipfKeys(size_t count, int32_t distinct, uint64_t seed) {
+    std::mt19937_64 gen(seed);
+    std::vector<double> weights(distinct);
+    for (int32_t i = 0; i < distinct; i++) weights[i] = 1.0 / (i + 1);
+    std::discrete_distribution<int32_t> pick(weights.begin(), weights.end());
+    std::vector<int32_t> keys(count);
+    for (auto& key : keys) key = pick(gen);
+    return keys;
+}
+
+void benchmarkSketch(BenchmarkRunner& runner) {
+    const size_t KEYS = 1 << 20;
+    std::vector<int32_t> keys = zipfKeys(KEYS, 100000, 1);
+    std::vector<int64_t> wideKeys(keys.begin(), keys.end());
+
+    FastAGMSketch sketch;
+    runner.run("sketch/update_batch_int32", KEYS, [&]() { sketch.update(keys.data(), keys.size()); });
+    runner.run("sketch/update_batch_int64", KEYS, [&]() { sketch.update(wideKeys.data(), wideKeys.size()); });
+    runner.run("sketch/update_single", KEYS, [&]() {
+        for (int64_t key : wideKeys) sketch.update(key);
+    });
+
+    FastAGMSketch other;
+    other.update(zipfKeys(KEYS, 100000, 2).data(), KEYS);
+    runner.run("sketch/estimate_join_size", 1, [&]() { doNotOptimize(sketch.estimateJoinSize(other)); });
+    runner.run("sketch/merge", 1, [&]() { sketch.merge(other); });
+
+    JoinKeySketch joinKeys;
+    runner.run("join_key/update_batch_int32", KEYS, [&]() { joinKeys.update(keys.data(), keys.size()); });
+    JoinKeySketch otherJoinKeys;
+    std::vector<int32_t> otherKeys = zipfKeys(KEYS, 100000, 2);
+    otherJoinKeys.update(otherKeys.data(), KEYS);
+    joinKeys.finalize();
+    otherJoinKeys.finalize();
+    runner.run("join_key/estimate_join_size", 1, [&]() { doNotOptimize(joinKeys.estimateJoinSize(otherJoinKeys)); });
+    runner.run("join_key/merge", 1, [&]() { joinKeys.merge(otherJoinKeys); });
+}
+
+void benchmarkParser(BenchmarkRunner& runner, const QueryWorkload& workload) {
+    for (const auto& query : workload) {
+        runner.run("parse/" + query.queryId, 1, [&]() {
+            JoinGraph graph = SqlParser::parseQuery(query.sql).joinGraph();
+            doNotOptimize(graph.size());
+        });
+    }
+    runner.run("parse/all", workload.size(), [&]() {
+        for (const auto& query : workload) {
+            JoinGraph graph = SqlParser::parseQuery(query.sql).joinGraph();
+            doNotOptimize(graph.size());
+        }
+    });
+}
+
+// Estimator construction plus DPccp over every query with the same number of relations
+void benchmarkEnumeration(BenchmarkRunner& runner, const QueryWorkload& workload) {
+    // One synthetic sketch per table.column, so shared columns behave like real join keys
+    std::map<std::string, JoinKeySketch> sketches;
+    auto sketchFor = [&](const JoinGraph::Relation& relation, const std::string& column) -> const JoinKeySketch& {
+        std::string key = relation.table + "." + column;
+        auto it = sketches.find(key);
+        if (it == sketches.end()) {
+            uint64_t seed = std::hash<std::string>{}(key);
+            JoinKeySketch sketch;
+            std::vector<int32_t> keys = zipfKeys(20000 + seed % 80000, 50000, seed);
+            sketch.update(keys.data(), keys.size());
+            sketch.finalize();
+            it = sketches.emplace(key, std::move(sketch)).first;
+        }
+        return it->second;
+    };
+
+    std::map<int, std::vector<JoinGraph>> graphsBySize;
+    for (const auto& query : workload) {
+        JoinGraph graph = SqlParser::parseQuery(query.sql).joinGraph();
+        if (graph.size() < 2) continue;
+        for (const auto& cls : graph.equivalenceClasses()) {
+            for (const auto& ref : cls) sketchFor(graph.relation(ref.relation), ref.column);
+        }
+        graphsBySize[graph.size()].push_back(std::move(graph));
+    }
+
+    for (const auto& [relations, graphs] : graphsBySize) {
+        std::vector<std::vector<double>> cardinalities;
+        for (const auto& graph : graphs) {
+            std::vector<double> rows;
+            for (int i = 0; i < graph.size(); i++) rows.push_back(10000.0 * (1 + i % 7));
+            cardinalities.push_back(std::move(rows));
+        }
+        runner.run("enumerate/dp/" + std::to_string(relations) + "_relations", graphs.size(), [&]() {
+            for (size_t g = 0; g < graphs.size(); g++) {
+                SketchEstimator estimator(graphs[g], cardinalities[g], sketchFor);
+                JoinTree tree = DPccpEnumerator(estimator, std::chrono::steady_clock::time_point::max()).run();
+                doNotOptimize(tree.root);
+            }
+        });
+    }
+}
+
+std::map<std::string, double> loadBaseline(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) throw std::runtime_error("Could not open baseline " + path);
+    std::map<std::string, double> baseline;
+    std::string line;
+    std::getline(file, line);
+    while (std::getline(file, line)) {
+        std::istringstream row(line);
+        std::string name;
+        std::string nsPerOp;
+        if (std::getline(row, name, ',') && std::getline(row, nsPerOp, ',')) baseline[name] = std::stod(nsPerOp);
+    }
+    return baseline;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    std::string filter;
+    double minTimeMs = 100;
+    std::string savePath;
+    std::string baselinePath;
+    double tolerance = 0.15;
+    std::vector<std::string> paths;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--filter" && hasValue) {
+            filter = argv[++i];
+        } else if (arg == "--min-time-ms" && hasValue) {
+            minTimeMs = std::atof(argv[++i]);
+        } else if (arg == "--save" && hasValue) {
+            savePath = argv[++i];
+        } else if (arg == "--baseline" && hasValue) {
+            baselinePath = argv[++i];
+        } else if (arg == "--tolerance" && hasValue) {
+            tolerance = std::atof(argv[++i]);
+        } else if (arg.rfind("--", 0) == 0) {
+            std::cerr << "Usage: " << argv[0] << " [--filter TEXT] [--min-time-ms MS] [--save FILE]\n"
+                      << "       [--baseline FILE [--tolerance F]] [<file.sql|dir>...]\n"
+                      << "  Queries default to job/. --baseline fails when a benchmark is more than\n"
+                      << "  tolerance (default 0.15) slower than in FILE, as written by --save." << std::endl;
+            return arg == "--help" ? 0 : 1;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.empty()) paths.push_back("job");
+
+    try {
+        QueryWorkload workload;
+        for (const auto& path : paths) workload.addPath(path);
+
+        BenchmarkRunner runner(filter, minTimeMs);
+        benchmarkSketch(runner);
+        benchmarkParser(runner, workload);
+        benchmarkEnumeration(runner, workload);
+
+        if (!savePath.empty()) {
+            std::ofstream csv(savePath);
+            if (!csv.is_open()) throw std::runtime_error("Could not open output file " + savePath);
+            csv << "benchmark,ns_per_op,iterations\n";
+            for (const auto& result : runner.all()) {
+                csv << result.name << "," << result.nsPerOp << "," << result.iterations << "\n";
+            }
+        }
+
+        if (!baselinePath.empty()) {
+            std::map<std::string, double> baseline = loadBaseline(baselinePath);
+            int regressions = 0;
+            for (const auto& result : runner.all()) {
+                auto it = baseline.find(result.name);
+                if (it == baseline.end() || it->second <= 0) continue;
+                double change = result.nsPerOp / it->second - 1;
+                if (change > tolerance) {
+                    std::cout << "REGRESSION " << result.name << ": " << it->second << " -> " << result.nsPerOp
+                              << " ns/op (+" << std::setprecision(0) << change * 100 << "%)" << std::endl;
+                    regressions++;
+                }
+            }
+            std::cout << regressions << " regressions against " << baselinePath << std::endl;
+            return regressions == 0 ? 0 : 1;
+        }
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+// Latency histogram in the style of HdrHistogram: values (nanoseconds) fall into
+// power-of-two ranges, each split into SUB_BUCKETS linear buckets, so every
+// recorded value is known to within 1/SUB_BUCKETS (about 3%) from 1 ns to hours.
+// Recording is a handful of relaxed atomic increments and never blocks.
+class LatencyHistogram {
+private:
+    static constexpr int SUB_BUCKET_BITS = 5;
+    static constexpr uint64_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    // Ranges [2^k, 2^(k+1)) for k >= SUB_BUCKET_BITS, after the exact buckets below SUB_BUCKETS
+    static constexpr int RANGES = 64 - SUB_BUCKET_BITS;
+    static constexpr size_t BUCKETS = SUB_BUCKETS + RANGES * SUB_BUCKETS;
+
+    std::array<std::atomic<uint64_t>, BUCKETS> counts{};
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> maximum{0};
+
+    static size_t bucketOf(uint64_t value) {
+        if (value < SUB_BUCKETS) return static_cast<size_t>(value);
+        int range = 63 - __builtin_clzll(value) - SUB_BUCKET_BITS;
+        uint64_t sub = (value >> range) - SUB_BUCKETS;
+        return static_cast<size_t>(SUB_BUCKETS + range * SUB_BUCKETS + sub);
+    }
+
+    // Upper bound of the values a bucket holds
+    static uint64_t bucketLimit(size_t bucket) {
+        if (bucket < SUB_BUCKETS) return bucket;
+        size_t range = (bucket - SUB_BUCKETS) / SUB_BUCKETS;
+        uint64_t sub = (bucket - SUB_BUCKETS) % SUB_BUCKETS;
+        return ((SUB_BUCKETS + sub + 1) << range) - 1;
+    }
+
+public:
+    void record(uint64_t nanoseconds) {
+        counts[bucketOf(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+        uint64_t seen = maximum.load(std::memory_order_relaxed);
+        while (nanoseconds > seen && !maximum.compare_exchange_weak(seen, nanoseconds, std::memory_order_relaxed)) {
+        }
+    }
+
+    uint64_t count() const { return total.load(std::memory_order_relaxed); }
+
+    double meanNs() const {
+        uint64_t n = count();
+        return n == 0 ? 0 : static_cast<double>(sum.load(std::memory_order_relaxed)) / n;
+    }
+
+    uint64_t maxNs() const { return maximum.load(std::memory_order_relaxed); }
+
+    // Smallest bucket bound with at least fraction of the values at or below it
+    uint64_t percentileNs(double fraction) const {
+        uint64_t n = count();
+        if (n == 0) return 0;
+        uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(fraction * n + 0.5));
+        uint64_t seen = 0;
+        for (size_t bucket = 0; bucket < BUCKETS; bucket++) {
+            seen += counts[bucket].load(std::memory_order_relaxed);
+            if (seen >= rank) return std::min(bucketLimit(bucket), maxNs());
+        }
+        return maxNs();
+    }
+};
+
+// Where planning time goes: one latency histogram per phase of planQuery
+class PlannerMetrics {
+public:
+    enum class Phase {
+        Parse,        // SQL to ParsedQuery and JoinGraph
+        Catalog,      // table stats and filtered row counts of the base relations
+        Sketch,       // looking up (and on first use building) join-key sketches
+        Estimation,   // sketch inner products of the cardinality estimator, sketches excluded
+        Enumeration,  // join ordering, including the subset estimates it asks for
+        Rewrite,      // plan string and join-order SQL
+        Total
+    };
+
+    static constexpr int PHASES = static_cast<int>(Phase::Total) + 1;
+
+    static const char* name(Phase phase) {
+        static const char* const names[PHASES] = {"parse", "catalog", "sketch", "estimation",
+                                                  "enumeration", "rewrite", "total"};
+        return names[static_cast<int>(phase)];
+    }
+
+    // Times the enclosing scope into one phase
+    class Timer {
+    private:
+        PlannerMetrics* metrics;
+        Phase phase;
+        std::chrono::steady_clock::time_point start;
+
+    public:
+        // A null metrics makes the timer a no-op
+        Timer(PlannerMetrics* metrics, Phase phase)
+            : metrics(metrics), phase(phase),
+              start(metrics ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point()) {}
+
+        ~Timer() {
+            if (metrics) metrics->record(phase, std::chrono::steady_clock::now() - start);
+        }
+
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+    };
+
+private:
+    std::array<LatencyHistogram, PHASES> histograms;
+
+    static std::ofstream open(const std::string& path) {
+        std::ofstream file(path);
+        if (!file.is_open()) {
+            throw std::runtime_error("Could not open output file " + path);
+        }
+        return file;
+    }
+
+    static double ms(uint64_t nanoseconds) { return nanoseconds / 1e6; }
+
+public:
+    void record(Phase phase, std::chrono::steady_clock::duration elapsed) {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        histograms[static_cast<int>(phase)].record(static_cast<uint64_t>(std::max<int64_t>(0, ns)));
+    }
+
+    const LatencyHistogram& histogram(Phase phase) const { return histograms[static_cast<int>(phase)]; }
+
+    // One line of JSON with count, mean and percentiles (ms) per phase
+    std::string json() const {
+        std::ostringstream out;
+        out << "{";
+        for (int i = 0; i < PHASES; i++) {
+            const LatencyHistogram& h = histograms[i];
+            out << (i == 0 ? "" : ", ") << "\"" << name(static_cast<Phase>(i)) << "\": {\"count\": " << h.count()
+                << ", \"mean_ms\": " << h.meanNs() / 1e6 << ", \"p50_ms\": " << ms(h.percentileNs(0.5))
+                << ", \"p90_ms\": " << ms(h.percentileNs(0.9)) << ", \"p99_ms\": " << ms(h.percentileNs(0.99))
+                << ", \"p999_ms\": " << ms(h.percentileNs(0.999)) << ", \"max_ms\": " << ms(h.maxNs()) << "}";
+        }
+        out << "}";
+        return out.str();
+    }
+
+    // Writes <prefix>.csv (one row per phase) and <prefix>.json
+    void write(const std::string& prefix) const {
+        std::ofstream csv = open(prefix + ".csv");
+        csv << "phase,count,mean_ms,p50_ms,p90_ms,p99_ms,p999_ms,max_ms\n";
+        for (int i = 0; i < PHASES; i++) {
+            const LatencyHistogram& h = histograms[i];
+            csv << name(static_cast<Phase>(i)) << "," << h.count() << "," << h.meanNs() / 1e6 << ","
+                << ms(h.percentileNs(0.5)) << "," << ms(h.percentileNs(0.9)) << "," << ms(h.percentileNs(0.99))
+                << "," << ms(h.percentileNs(0.999)) << "," << ms(h.maxNs()) << "\n";
+        }
+        std::ofstream json = open(prefix + ".json");
+        json << this->json() << "\n";
+    }
+};
@@ -1,8 +1,8 @@
 #include <iostream>
 #include <libpq-fe.h>
 #include <string>
-#include <regex>
-#include <stack>
+
+#include "explain_plan.h"
 
 // Función para obtener el plan JSON del join directamente desde PostgreSQL
 std::string getJoinPlanJSON(PGconn *conn, const std::string &query) {
@@ -21,38 +21,20 @@ std::string getJoinPlanJSON(PGconn *conn, const std::string &query) {
     return jsonPlan;
 }
 
-// Función para analizar manualmente el JSON y construir el plan de joins
-std::string parseJSONPlan(const std::string &jsonPlan) {
-    // Expresiones regulares para detectar los nombres de las tablas y los operadores de join
-    std::regex seqScanRegex(R"("Relation Name":\s*\"(\w+)\")");
-    std::regex joinRegex(R"("Node Type":\s*\"(Merge Join|Nested Loop|Hash Join)\")");
-    std::smatch match;
-
-    std::stack<std::string> joinStack;
-    auto begin = jsonPlan.cbegin();
-    auto end = jsonPlan.cend();
-
-    // Extraer todas las tablas (Seq Scan) y añadirlas a la pila
-    while (std::regex_search(begin, end, match, seqScanRegex)) {
-        joinStack.push(match[1]); // Agregar tabla a la pila
-        begin = match.suffix().first;
+// Imprime el árbol del plan con las filas y el costo estimados de cada nodo
+void printPlanTree(const ExplainPlan &plan, int node, int depth = 0) {
+    const PlanNode &n = plan.nodes[node];
+    std::cout << std::string(depth * 2, ' ') << n.nodeType;
+    if (!n.relation.empty()) {
+        std::cout << " on " << n.relation;
+        if (!n.alias.empty() && n.alias != n.relation) std::cout << " " << n.alias;
     }
-
-    // Reiniciar el análisis para procesar los operadores de join
-    begin = jsonPlan.cbegin();
-    while (std::regex_search(begin, end, match, joinRegex)) {
-        if (joinStack.size() >= 2) {
-            std::string right = joinStack.top();
-            joinStack.pop();
-            std::string left = joinStack.top();
-            joinStack.pop();
-            std::string combined = "(" + left + " ⨝ " + right + ")";
-            joinStack.push(combined); // Agregar el resultado combinado
-        }
-        begin = match.suffix().first;
+    std::cout << " (rows=" << n.planRows << " cost=" << n.startupCost << ".." << n.totalCost;
+    if (n.actualRows >= 0) std::cout << " actual rows=" << n.actualRows << " loops=" << n.actualLoops;
+    std::cout << ")" << std::endl;
+    for (int child : n.children) {
+        printPlanTree(plan, child, depth + 1);
     }
-
-    return joinStack.empty() ? "Error: No se pudo construir el plan." : joinStack.top();
 }
 
 int main() {
@@ -93,10 +75,14 @@ WHERE ct.kind = 'production companies'
         // Obtener el plan JSON
         std::string jsonPlan = getJoinPlanJSON(conn, query);
 
-        // Analizar el JSON para construir el plan de joins
-        std::string formattedPlan = parseJSONPlan(jsonPlan);
+        // Analizar el JSON para construir el árbol del plan y el plan de joins
+        ExplainPlan plan = ExplainPlan::parse(jsonPlan);
+        std::string formattedPlan = plan.joinOrder();
         // std::cout << "Plan de joins en formato ((table_a ⨝ table_b) ⨝ table_c):\n" << formattedPlan << std::endl;
-        std::cout << "Join Plan:\n" << formattedPlan << std::endl;
+        std::cout << "Join Plan:\n" << (formattedPlan.empty() ? "Error: No se pudo construir el plan." : formattedPlan)
+                  << std::endl;
+        std::cout << "\nPlan Tree:" << std::endl;
+        printPlanTree(plan, plan.root);
     } catch (const std::exception &e) {
         std::cerr << "Error: " << e.what() << std::endl;
     }
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <libpq-fe.h>
+#include <stdexcept>
+#include <string>
+
+#include "cardinality_estimator.h"
+#include "explain_plan.h"
+#include "join_graph.h"
+
+// Postgres's own row estimates: each subset is planned with EXPLAIN and the
+// estimate of the plan's root is taken, which is what Postgres would assume
+// for that intermediate result. Relations are listed with CROSS JOIN under
+// join_collapse_limit = 1, so Postgres plans one fixed order instead of
+// searching all of them; a join relation's row estimate does not depend on
+// the order. Costs one round trip per subset the enumerator asks for.
+class PostgresEstimator final : public CardinalityEstimator {
+private:
+    PGconn* conn;
+
+protected:
+    double estimateSubset(uint64_t subset) const override {
+        std::string sql = "EXPLAIN (FORMAT JSON) " + joinGraph().subsetQuery(subset, "1", true);
+        PGresult* res = PQexec(conn, sql.c_str());
+        if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+            std::string error = PQerrorMessage(conn);
+            PQclear(res);
+            throw std::runtime_error("Failed to explain '" + sql + "': " + error);
+        }
+        std::string json = PQgetvalue(res, 0, 0);
+        PQclear(res);
+        ExplainPlan plan = ExplainPlan::parse(json);
+        if (plan.root < 0) throw std::runtime_error("EXPLAIN returned no plan for '" + sql + "'");
+        return plan.nodes[plan.root].planRows;
+    }
+
+public:
+    // Sets join_collapse_limit for the rest of conn's session
+    PostgresEstimator(const JoinGraph& graph, PGconn* conn) : CardinalityEstimator(graph), conn(conn) {
+        if (!conn) throw std::runtime_error("PostgresEstimator: the postgres estimator needs a database connection");
+        PGresult* res = PQexec(conn, "SET join_collapse_limit = 1");
+        bool ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+        std::string error = ok ? "" : PQerrorMessage(conn);
+        PQclear(res);
+        if (!ok) throw std::runtime_error("Failed to set join_collapse_limit: " + error);
+    }
+};
@@ -0,0 +1,278 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "explain_plan.h"
+#include "join_enumerator.h"
+#include "join_graph.h"
+
+// Estimated and actual rows of one intermediate join of an executed plan
+struct QErrorSample {
+    std::string subplan;          // join order of the subset, "(a ⨝ b)"
+    int relations = 0;
+    double compassEstimate = 0;
+    double postgresEstimate = 0;
+    double actualRows = 0;
+
+    // max(estimate / actual, actual / estimate), both clamped to one row
+    static double qError(double estimate, double actual) {
+        double e = std::max(1.0, estimate);
+        double a = std::max(1.0, actual);
+        return std::max(e / a, a / e);
+    }
+
+    double compassQError() const { return qError(compassEstimate, actualRows); }
+    double postgresQError() const { return qError(postgresEstimate, actualRows); }
+
+    // Pairs every join node of an EXPLAIN ANALYZE run of a forced plan with the
+    // node of tree that joins the same relations. Inner sides of nested loops are
+    // rescanned per outer row, so their counts are not subset cardinalities and
+    // are skipped; elsewhere loops > 1 means parallel workers and counts are summed.
+    static std::vector<QErrorSample> collect(const ExplainPlan& plan, const JoinTree& tree, const JoinGraph& graph) {
+        std::vector<QErrorSample> samples;
+        if (plan.root >= 0) collect(plan, plan.root, false, tree, graph, samples);
+        return samples;
+    }
+
+private:
+    static uint64_t collect(const ExplainPlan& plan, int index, bool rescanned, const JoinTree& tree,
+                            const JoinGraph& graph, std::vector<QErrorSample>& samples) {
+        const PlanNode& node = plan.nodes[index];
+        uint64_t relations = 0;
+        int relation = node.alias.empty() ? -1 : graph.relationIndex(node.alias);
+        if (relation >= 0) relations |= JoinGraph::bit(relation);
+
+        for (size_t i = 0; i < node.children.size(); i++) {
+            bool inner = node.nodeType == "Nested Loop" && i == 1;
+            relations |= collect(plan, node.children[i], rescanned || inner, tree, graph, samples);
+        }
+
+        if (!node.isJoin() || rescanned || node.actualRows < 0) return relations;
+        for (size_t i = 0; i < tree.nodes.size(); i++) {
+            const JoinTree::Node& treeNode = tree.nodes[i];
+            if (treeNode.relation >= 0 || treeNode.relations != relations) continue;
+            double loops = std::max(1.0, node.actualLoops);
+            QErrorSample sample;
+            sample.subplan = format(tree, graph, static_cast<int>(i));
+            sample.relations = __builtin_popcountll(relations);
+            sample.compassEstimate = treeNode.cardinality;
+            sample.postgresEstimate = node.planRows * loops;
+            sample.actualRows = node.actualRows * loops;
+            samples.push_back(std::move(sample));
+            break;
+        }
+        return relations;
+    }
+
+    static std::string format(const JoinTree& tree, const JoinGraph& graph, int node) {
+        const JoinTree::Node& n = tree.nodes[node];
+        if (n.relation >= 0) return graph.relation(n.relation).alias;
+        return "(" + format(tree, graph, n.left) + " ⨝ " + format(tree, graph, n.right) + ")";
+    }
+};
+
+// Summary of a set of q-errors; percentiles use the nearest-rank method
+struct QErrorDistribution {
+    size_t count = 0;
+    double median = 0;
+    double p90 = 0;
+    double p99 = 0;
+    double max = 0;
+
+    static QErrorDistribution of(std::vector<double> values) {
+        QErrorDistribution result;
+        result.count = values.size();
+        if (values.empty()) return result;
+        std::sort(values.begin(), values.end());
+        auto rank = [&](double p) {
+            size_t index = static_cast<size_t>(std::ceil(p * values.size()));
+            return values[std::min(values.size(), std::max<size_t>(1, index)) - 1];
+        };
+        result.median = rank(0.5);
+        result.p90 = rank(0.9);
+        result.p99 = rank(0.99);
+        result.max = values.back();
+        return result;
+    }
+};
+
+// Collects the samples of a workload and writes per-node, per-query and
+// per-bucket distributions. Buckets group queries by their number of join
+// predicates (up to 9, 10 to 19, 20 and more) and are labelled by the range
+// actually observed, e.g. "4-9".
+class QErrorReport {
+public:
+    static const int BUCKETS = 3;
+
+    static int bucketOf(int joinPredicates) {
+        return joinPredicates < 10 ? 0 : joinPredicates < 20 ? 1 : 2;
+    }
+
+private:
+    struct QueryEntry {
+        std::string queryId;
+        int joinPredicates;
+        std::vector<QErrorSample> samples;
+    };
+
+    std::vector<QueryEntry> queries;
+
+    static std::string csvEscape(const std::string& field) {
+        if (field.find_first_of(",\"\n") == std::string::npos) return field;
+        std::string escaped = "\"";
+        for (char c : field) {
+            if (c == '"') escaped += '"';
+            escaped += c;
+        }
+        return escaped + "\"";
+    }
+
+    static std::string jsonEscape(const std::string& value) {
+        std::string escaped;
+        for (char c : value) {
+            if (c == '"' || c == '\\') escaped += '\\';
+            if (c == '\n') {
+                escaped += "\\n";
+                continue;
+            }
+            escaped += c;
+        }
+        return escaped;
+    }
+
+    static std::ofstream open(const std::string& path) {
+        std::ofstream file(path);
+        if (!file.is_open()) {
+            throw std::runtime_error("Could not open output file " + path);
+        }
+        return file;
+    }
+
+    template <typename Getter>
+    static QErrorDistribution distribution(const std::vector<const QueryEntry*>& entries, Getter qError) {
+        std::vector<double> values;
+        for (const QueryEntry* entry : entries) {
+            for (const auto& sample : entry->samples) values.push_back((sample.*qError)());
+        }
+        return QErrorDistribution::of(std::move(values));
+    }
+
+    static void writeCsvColumns(std::ostream& out, const QErrorDistribution& d) {
+        out << "," << d.median << "," << d.p90 << "," << d.p99 << "," << d.max;
+    }
+
+    static void writeJson(std::ostream& out, const QErrorDistribution& d) {
+        out << "{\"median\": " << d.median << ", \"p90\": " << d.p90 << ", \"p99\": " << d.p99
+            << ", \"max\": " << d.max << "}";
+    }
+
+    // One query, or the queries of one bucket
+    struct Group {
+        std::string name;
+        int joinPredicates;   // -1 for buckets
+        std::vector<const QueryEntry*> entries;
+    };
+
+    std::vector<Group> queryGroups() const {
+        std::vector<Group> groups;
+        for (const auto& query : queries) {
+            groups.push_back({query.queryId, query.joinPredicates, {&query}});
+        }
+        return groups;
+    }
+
+    std::vector<Group> bucketGroups() const {
+        std::vector<Group> groups;
+        for (int bucket = 0; bucket < BUCKETS; bucket++) {
+            Group group{"", -1, {}};
+            int low = 0;
+            int high = 0;
+            for (const auto& query : queries) {
+                if (bucketOf(query.joinPredicates) != bucket) continue;
+                if (group.entries.empty() || query.joinPredicates < low) low = query.joinPredicates;
+                if (group.entries.empty() || query.joinPredicates > high) high = query.joinPredicates;
+                group.entries.push_back(&query);
+            }
+            if (group.entries.empty()) continue;
+            group.name = std::to_string(low) + "-" + std::to_string(high);
+            groups.push_back(std::move(group));
+        }
+        return groups;
+    }
+
+    static size_t nodeCount(const Group& group) {
+        size_t count = 0;
+        for (const QueryEntry* entry : group.entries) count += entry->samples.size();
+        return count;
+    }
+
+    static void writeGroupsCsv(const std::string& path, const char* firstColumn, bool perQuery,
+                               const std::vector<Group>& groups) {
+        std::ofstream csv = open(path);
+        csv << firstColumn << (perQuery ? ",join_predicates" : "") << ",queries,nodes,compass_median,compass_p90,compass_p99,compass_max,"
+            << "postgres_median,postgres_p90,postgres_p99,postgres_max\n";
+        for (const auto& group : groups) {
+            csv << csvEscape(group.name);
+            if (perQuery) csv << "," << group.joinPredicates;
+            csv << "," << group.entries.size() << "," << nodeCount(group);
+            writeCsvColumns(csv, distribution(group.entries, &QErrorSample::compassQError));
+            writeCsvColumns(csv, distribution(group.entries, &QErrorSample::postgresQError));
+            csv << "\n";
+        }
+    }
+
+    static void writeGroupsJson(std::ostream& out, const char* key, const std::vector<Group>& groups) {
+        out << "  \"" << key << "\": [";
+        for (size_t i = 0; i < groups.size(); i++) {
+            const Group& group = groups[i];
+            out << (i == 0 ? "\n" : ",\n") << "    {\"name\": \"" << jsonEscape(group.name) << "\"";
+            if (group.joinPredicates >= 0) out << ", \"join_predicates\": " << group.joinPredicates;
+            out << ", \"queries\": " << group.entries.size() << ", \"nodes\": " << nodeCount(group)
+                << ", \"compass\": ";
+            writeJson(out, distribution(group.entries, &QErrorSample::compassQError));
+            out << ", \"postgres\": ";
+            writeJson(out, distribution(group.entries, &QErrorSample::postgresQError));
+            out << "}";
+        }
+        out << "\n  ]";
+    }
+
+public:
+    void addQuery(const std::string& queryId, int joinPredicates, std::vector<QErrorSample> samples) {
+        queries.push_back({queryId, joinPredicates, std::move(samples)});
+    }
+
+    // Writes <prefix>_nodes.csv, <prefix>_queries.csv, <prefix>_buckets.csv and <prefix>.json
+    void write(const std::string& prefix) const {
+        std::ofstream nodes = open(prefix + "_nodes.csv");
+        nodes << "query_id,join_predicates,relations,subplan,compass_estimate,postgres_estimate,actual_rows,"
+              << "compass_qerror,postgres_qerror\n";
+        for (const auto& query : queries) {
+            for (const auto& sample : query.samples) {
+                nodes << csvEscape(query.queryId) << "," << query.joinPredicates << "," << sample.relations << ","
+                      << csvEscape(sample.subplan) << "," << sample.compassEstimate << ","
+                      << sample.postgresEstimate << "," << sample.actualRows << ","
+                      << sample.compassQError() << "," << sample.postgresQError() << "\n";
+            }
+        }
+
+        std::vector<Group> perQuery = queryGroups();
+        std::vector<Group> perBucket = bucketGroups();
+        writeGroupsCsv(prefix + "_queries.csv", "query_id", true, perQuery);
+        writeGroupsCsv(prefix + "_buckets.csv", "bucket", false, perBucket);
+
+        std::ofstream json = open(prefix + ".json");
+        json << "{\n";
+        writeGroupsJson(json, "queries", perQuery);
+        json << ",\n";
+        writeGroupsJson(json, "buckets", perBucket);
+        json << "\n}\n";
+    }
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// A workload of .sql query files, ordered by query id
+class QueryWorkload {
+public:
+    struct QueryFile {
+        std::string queryId;
+        std::string sql;
+    };
+
+private:
+    std::vector<QueryFile> queries;
+
+    // Orders JOB names naturally: 1a, 1b, ..., 2a, ..., 10a
+    static bool queryIdLess(const std::string& a, const std::string& b) {
+        auto numericPrefix = [](const std::string& s) {
+            size_t i = 0;
+            while (i < s.size() && std::isdigit(static_cast<unsigned char>(s[i]))) i++;
+            return std::make_pair(i == 0 ? LONG_MAX : std::stol(s.substr(0, i)), s.substr(i));
+        };
+        return numericPrefix(a) < numericPrefix(b);
+    }
+
+    static std::string readFile(const std::filesystem::path& path) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            throw std::runtime_error("Could not open file " + path.string());
+        }
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        return buffer.str();
+    }
+
+    void addFile(const std::filesystem::path& path) {
+        std::string sql = readFile(path);
+        // Skip DDL scripts such as job/schema.sql and job/fkindexes.sql
+        if (sql.find("SELECT") == std::string::npos) return;
+        queries.push_back({path.stem().string(), sql});
+    }
+
+public:
+    // Accepts .sql files and directories containing them
+    void addPath(const std::string& pathName) {
+        std::filesystem::path path(pathName);
+        if (std::filesystem::is_directory(path)) {
+            for (const auto& entry : std::filesystem::directory_iterator(path)) {
+                if (entry.is_regular_file() && entry.path().extension() == ".sql") {
+                    addFile(entry.path());
+                }
+            }
+        } else {
+            addFile(path);
+        }
+        std::sort(queries.begin(), queries.end(),
+            [](const QueryFile& a, const QueryFile& b) { return queryIdLess(a.queryId, b.queryId); });
+    }
+
+    size_t size() const { return queries.size(); }
+    bool empty() const { return queries.empty(); }
+    const QueryFile& operator[](size_t i) const { return queries[i]; }
+    std::vector<QueryFile>::const_iterator begin() const { return queries.begin(); }
+    std::vector<QueryFile>::const_iterator end() const { return queries.end(); }
+};
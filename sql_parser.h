@@ -0,0 +1,551 @@
+#pragma once
+
+#include <cctype>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "join_graph.h"
+
+// Single-pass lexer for the SELECT-FROM-WHERE subset used by JOB-style
+// queries. Tokens are views into the query text, nothing is copied.
+class SqlLexer {
+public:
+    enum class TokenType { Identifier, Number, String, QuotedIdentifier, Operator, Punctuation, End };
+
+    struct Token {
+        TokenType type = TokenType::End;
+        std::string_view text;
+        size_t offset = 0;
+
+        // Case-insensitive keyword test for identifiers
+        bool is(std::string_view keyword) const {
+            if (type != TokenType::Identifier || text.size() != keyword.size()) return false;
+            for (size_t i = 0; i < text.size(); i++) {
+                if (std::toupper(static_cast<unsigned char>(text[i])) != keyword[i]) return false;
+            }
+            return true;
+        }
+
+        bool isSymbol(std::string_view symbol) const {
+            return (type == TokenType::Operator || type == TokenType::Punctuation) && text == symbol;
+        }
+    };
+
+private:
+    std::string_view input;
+    size_t pos = 0;
+
+    static bool isIdentifierStart(char c) {
+        return std::isalpha(static_cast<unsigned char>(c)) || c == '_';
+    }
+
+    static bool isIdentifierChar(char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$';
+    }
+
+    void skipWhitespaceAndComments() {
+        while (pos < input.size()) {
+            char c = input[pos];
+            if (std::isspace(static_cast<unsigned char>(c))) {
+                pos++;
+            } else if (c == '-' && pos + 1 < input.size() && input[pos + 1] == '-') {
+                while (pos < input.size() && input[pos] != '\n') pos++;
+            } else if (c == '/' && pos + 1 < input.size() && input[pos + 1] == '*') {
+                size_t end = input.find("*/", pos + 2);
+                pos = end == std::string_view::npos ? input.size() : end + 2;
+            } else {
+                break;
+            }
+        }
+    }
+
+    // Scans a quoted token; a doubled quote character is an escaped quote
+    size_t scanQuoted(size_t start, char quote) const {
+        size_t i = start + 1;
+        while (i < input.size()) {
+            if (input[i] == quote) {
+                if (i + 1 < input.size() && input[i + 1] == quote) {
+                    i += 2;
+                    continue;
+                }
+                return i + 1;
+            }
+            i++;
+        }
+        throw std::runtime_error("SQL: unterminated quoted token at offset " + std::to_string(start));
+    }
+
+public:
+    explicit SqlLexer(std::string_view input) : input(input) {}
+
+    Token next() {
+        skipWhitespaceAndComments();
+        Token token;
+        token.offset = pos;
+        if (pos >= input.size()) {
+            token.text = input.substr(input.size());
+            return token;
+        }
+
+        size_t start = pos;
+        char c = input[pos];
+        if (isIdentifierStart(c)) {
+            while (pos < input.size() && isIdentifierChar(input[pos])) pos++;
+            token.type = TokenType::Identifier;
+        } else if (std::isdigit(static_cast<unsigned char>(c)) ||
+                   (c == '.' && pos + 1 < input.size() && std::isdigit(static_cast<unsigned char>(input[pos + 1])))) {
+            while (pos < input.size() && (std::isalnum(static_cast<unsigned char>(input[pos])) || input[pos] == '.')) pos++;
+            token.type = TokenType::Number;
+        } else if (c == '\'') {
+            pos = scanQuoted(pos, '\'');
+            token.type = TokenType::String;
+        } else if (c == '"') {
+            pos = scanQuoted(pos, '"');
+            token.type = TokenType::QuotedIdentifier;
+        } else if (c == '(' || c == ')' || c == ',' || c == ';' || c == '.') {
+            pos++;
+            token.type = TokenType::Punctuation;
+        } else {
+            // Longest match over the two-character operators
+            static const char* twoChar[] = {"<=", ">=", "<>", "!=", "::", "||"};
+            token.type = TokenType::Operator;
+            pos++;
+            for (const char* op : twoChar) {
+                if (input.compare(start, 2, op) == 0) {
+                    pos = start + 2;
+                    break;
+                }
+            }
+        }
+        token.text = input.substr(start, pos - start);
+        return token;
+    }
+};
+
+// Query parsed into its FROM list and a predicate tree over the WHERE clause.
+// All string_views point into the original query text, which must outlive it.
+struct ParsedQuery {
+    struct TableRef {
+        std::string_view table;
+        std::string_view alias;
+    };
+
+    struct ColumnRef {
+        std::string_view alias;   // empty for unqualified columns
+        std::string_view column;
+    };
+
+    struct PredicateNode {
+        enum class Type { And, Or, Not, Comparison, Between, In, Like, IsNull, Other };
+
+        Type type = Type::Other;
+        std::string_view text;       // source span of the whole predicate
+        std::string_view op;         // comparison operator, e.g. "=" or "LIKE"
+        bool negated = false;        // NOT BETWEEN / NOT IN / NOT LIKE / IS NOT NULL
+        int firstChild = -1;         // And/Or/Not operands, linked through nextSibling
+        int nextSibling = -1;
+        uint32_t firstColumn = 0;    // referenced columns: columns[firstColumn, firstColumn + columnCount)
+        uint32_t columnCount = 0;
+        // For Comparison: whether each side is exactly one column reference
+        bool leftIsColumn = false;
+        bool rightIsColumn = false;
+    };
+
+    // Equi-join between two relations, e.g. t.id = mk.movie_id
+    struct JoinPredicate {
+        ColumnRef left;
+        ColumnRef right;
+        int node;
+    };
+
+    // Conjunct of the WHERE clause that only references one relation; OR groups
+    // such as (mc.note LIKE '%a%' OR mc.note LIKE '%b%') count as one filter
+    struct LocalFilter {
+        std::string_view alias;
+        int node;
+    };
+
+    std::string_view sql;
+    std::string_view selectList;   // text between SELECT and FROM
+    std::string_view trailer;      // GROUP BY, ORDER BY, ... after the WHERE clause, without the ';'
+    std::vector<TableRef> tables;
+    std::vector<PredicateNode> nodes;
+    std::vector<ColumnRef> columns;
+    int whereRoot = -1;
+
+    std::vector<JoinPredicate> joins;
+    std::vector<LocalFilter> filters;
+    // Conjuncts over several relations that are not equi-joins, plus anything unqualified
+    std::vector<int> otherPredicates;
+
+    std::string_view nodeText(int node) const { return nodes[node].text; }
+
+    // Relations come from the FROM list in order, edges from the equi-join conjuncts of WHERE
+    // and each relation's filter from its single-relation conjuncts
+    JoinGraph joinGraph() const {
+        JoinGraph graph;
+        for (const auto& table : tables) {
+            graph.addRelation(std::string(table.alias), std::string(table.table));
+        }
+        for (const auto& filter : filters) {
+            int relation = graph.relationIndex(std::string(filter.alias));
+            if (relation < 0) continue;
+            graph.addFilter(relation, std::string(nodeText(filter.node)));
+        }
+        for (const auto& join : joins) {
+            int relation1 = graph.relationIndex(std::string(join.left.alias));
+            int relation2 = graph.relationIndex(std::string(join.right.alias));
+            if (relation1 < 0 || relation2 < 0) continue;
+            graph.addPredicate(relation1, std::string(join.left.column),
+                               relation2, std::string(join.right.column));
+        }
+        return graph;
+    }
+};
+
+// Recursive-descent parser producing a ParsedQuery in one pass over the tokens
+class SqlParser {
+private:
+    using Token = SqlLexer::Token;
+    using TokenType = SqlLexer::TokenType;
+    using Node = ParsedQuery::PredicateNode;
+
+    SqlLexer lexer;
+    Token current;
+    Token previous;
+    ParsedQuery& query;
+
+    void advance() {
+        previous = current;
+        current = lexer.next();
+    }
+
+    bool accept(std::string_view keyword) {
+        if (!current.is(keyword)) return false;
+        advance();
+        return true;
+    }
+
+    bool acceptSymbol(std::string_view symbol) {
+        if (!current.isSymbol(symbol)) return false;
+        advance();
+        return true;
+    }
+
+    void expectSymbol(std::string_view symbol) {
+        if (!acceptSymbol(symbol)) {
+            throw std::runtime_error("SQL: expected '" + std::string(symbol) + "' at offset " +
+                                     std::to_string(current.offset));
+        }
+    }
+
+    bool atEnd() const {
+        return current.type == TokenType::End || current.isSymbol(";");
+    }
+
+    static std::string_view unquote(const Token& token) {
+        if (token.type == TokenType::QuotedIdentifier) return token.text.substr(1, token.text.size() - 2);
+        return token.text;
+    }
+
+    std::string_view span(size_t begin) const {
+        size_t end = previous.offset + previous.text.size();
+        return query.sql.substr(begin, end > begin ? end - begin : 0);
+    }
+
+    bool isNameToken() const {
+        return current.type == TokenType::Identifier || current.type == TokenType::QuotedIdentifier;
+    }
+
+    bool isClauseKeyword() const {
+        return current.is("WHERE") || current.is("GROUP") || current.is("ORDER") || current.is("LIMIT") ||
+               current.is("HAVING") || current.is("UNION");
+    }
+
+    // Skips a balanced parenthesised group; current is the opening parenthesis
+    void skipGroup() {
+        int depth = 0;
+        do {
+            if (current.isSymbol("(")) depth++;
+            else if (current.isSymbol(")")) depth--;
+            if (current.type == TokenType::End) throw std::runtime_error("SQL: unbalanced parentheses");
+            advance();
+        } while (depth > 0);
+    }
+
+    void parseSelectList() {
+        if (!accept("SELECT")) throw std::runtime_error("SQL: query must start with SELECT");
+        size_t begin = current.offset;
+        while (!atEnd() && !current.is("FROM")) {
+            if (current.isSymbol("(")) skipGroup();
+            else advance();
+        }
+        query.selectList = span(begin);
+    }
+
+    void parseFromList() {
+        if (!accept("FROM")) return;
+        while (!atEnd() && !isClauseKeyword()) {
+            if (!isNameToken()) throw std::runtime_error("SQL: expected table name at offset " +
+                                                         std::to_string(current.offset));
+            ParsedQuery::TableRef ref;
+            ref.table = unquote(current);
+            advance();
+            if (acceptSymbol(".")) {
+                // schema-qualified name: keep the relation name only
+                ref.table = unquote(current);
+                advance();
+            }
+            accept("AS");
+            if (isNameToken() && !isClauseKeyword()) {
+                ref.alias = unquote(current);
+                advance();
+            } else {
+                ref.alias = ref.table;
+            }
+            query.tables.push_back(ref);
+            if (!acceptSymbol(",")) break;
+        }
+    }
+
+    int addNode(Node node) {
+        query.nodes.push_back(node);
+        return static_cast<int>(query.nodes.size()) - 1;
+    }
+
+    void appendChild(int parent, int& lastChild, int child) {
+        if (lastChild < 0) query.nodes[parent].firstChild = child;
+        else query.nodes[lastChild].nextSibling = child;
+        lastChild = child;
+    }
+
+    // Columns referenced below a node are the contiguous range recorded while parsing it
+    void closeColumns(int node, uint32_t firstColumn) {
+        query.nodes[node].firstColumn = firstColumn;
+        query.nodes[node].columnCount = static_cast<uint32_t>(query.columns.size()) - firstColumn;
+    }
+
+    int parseBoolean(Node::Type type, std::string_view keyword, int (SqlParser::*operand)()) {
+        size_t begin = current.offset;
+        uint32_t firstColumn = static_cast<uint32_t>(query.columns.size());
+        int first = (this->*operand)();
+        if (!current.is(keyword)) return first;
+
+        Node node;
+        node.type = type;
+        int parent = addNode(node);
+        int last = -1;
+        appendChild(parent, last, first);
+        while (accept(keyword)) {
+            appendChild(parent, last, (this->*operand)());
+        }
+        query.nodes[parent].text = span(begin);
+        closeColumns(parent, firstColumn);
+        return parent;
+    }
+
+    int parseOr() { return parseBoolean(Node::Type::Or, "OR", &SqlParser::parseAnd); }
+    int parseAnd() { return parseBoolean(Node::Type::And, "AND", &SqlParser::parseNot); }
+
+    int parseNot() {
+        if (!current.is("NOT")) return parsePrimary();
+        size_t begin = current.offset;
+        uint32_t firstColumn = static_cast<uint32_t>(query.columns.size());
+        advance();
+        Node node;
+        node.type = Node::Type::Not;
+        int parent = addNode(node);
+        query.nodes[parent].firstChild = parseNot();
+        query.nodes[parent].text = span(begin);
+        closeColumns(parent, firstColumn);
+        return parent;
+    }
+
+    // One value expression: column, literal, function call or parenthesised
+    // list, optionally chained with arithmetic, concatenation or casts.
+    // Returns true when it was a single column reference.
+    bool parseOperand() {
+        bool singleColumn = false;
+        int terms = 0;
+        while (true) {
+            terms++;
+            if (current.isSymbol("(")) {
+                advance();
+                while (!current.isSymbol(")")) {
+                    if (current.type == TokenType::End) throw std::runtime_error("SQL: unbalanced parentheses");
+                    parseOperand();
+                    acceptSymbol(",");
+                }
+                advance();
+            } else if (isNameToken()) {
+                Token first = current;
+                advance();
+                if (acceptSymbol(".")) {
+                    query.columns.push_back({unquote(first), unquote(current)});
+                    advance();
+                    singleColumn = true;
+                } else if (current.isSymbol("(")) {
+                    // function call
+                    advance();
+                    while (!current.isSymbol(")")) {
+                        if (current.type == TokenType::End) throw std::runtime_error("SQL: unbalanced parentheses");
+                        parseOperand();
+                        acceptSymbol(",");
+                    }
+                    advance();
+                } else if (!first.is("NULL") && !first.is("TRUE") && !first.is("FALSE")) {
+                    query.columns.push_back({std::string_view(), unquote(first)});
+                    singleColumn = true;
+                }
+            } else if (current.type == TokenType::Number || current.type == TokenType::String ||
+                       current.isSymbol("-") || current.isSymbol("+")) {
+                if (current.isSymbol("-") || current.isSymbol("+")) advance();
+                advance();
+            } else {
+                throw std::runtime_error("SQL: unexpected token '" + std::string(current.text) +
+                                         "' at offset " + std::to_string(current.offset));
+            }
+            while (acceptSymbol("::")) advance();
+
+            if (!current.isSymbol("+") && !current.isSymbol("-") && !current.isSymbol("*") &&
+                !current.isSymbol("/") && !current.isSymbol("||")) {
+                break;
+            }
+            advance();
+        }
+        return singleColumn && terms == 1;
+    }
+
+    // Tokens that can follow a value but not a predicate
+    bool continuesValue() const {
+        return current.type == TokenType::Operator || current.is("BETWEEN") || current.is("IN") ||
+               current.is("LIKE") || current.is("ILIKE") || current.is("IS") || current.is("NOT");
+    }
+
+    int parsePrimary() {
+        size_t begin = current.offset;
+        uint32_t firstColumn = static_cast<uint32_t>(query.columns.size());
+        // A leading "(" is first taken as a nested predicate. When its contents do not
+        // parse as one, or a value operator follows the ")", as in
+        // (t.production_year + 1) > 2000, it is reparsed as a parenthesised value.
+        if (current.isSymbol("(")) {
+            SqlLexer savedLexer = lexer;
+            Token savedCurrent = current;
+            Token savedPrevious = previous;
+            size_t nodeCount = query.nodes.size();
+            int inner = -1;
+            try {
+                advance();
+                inner = parseOr();
+                expectSymbol(")");
+                if (continuesValue()) inner = -1;
+            } catch (const std::runtime_error&) {
+                inner = -1;
+            }
+            if (inner >= 0) {
+                query.nodes[inner].text = span(begin);
+                return inner;
+            }
+            lexer = savedLexer;
+            current = savedCurrent;
+            previous = savedPrevious;
+            query.nodes.resize(nodeCount);
+            query.columns.resize(firstColumn);
+        }
+
+        Node node;
+        node.leftIsColumn = parseOperand();
+        if (accept("NOT")) node.negated = true;
+
+        if (accept("BETWEEN")) {
+            node.type = Node::Type::Between;
+            node.op = previous.text;
+            parseOperand();
+            if (!accept("AND")) throw std::runtime_error("SQL: BETWEEN without AND");
+            parseOperand();
+        } else if (accept("IN")) {
+            node.type = Node::Type::In;
+            node.op = previous.text;
+            parseOperand();
+        } else if (accept("LIKE") || accept("ILIKE")) {
+            node.type = Node::Type::Like;
+            node.op = previous.text;
+            parseOperand();
+        } else if (accept("IS")) {
+            node.type = Node::Type::IsNull;
+            node.op = previous.text;
+            if (accept("NOT")) node.negated = true;
+            if (!accept("NULL")) throw std::runtime_error("SQL: only IS [NOT] NULL is supported");
+        } else if (current.type == TokenType::Operator && !current.isSymbol("+") && !current.isSymbol("-")) {
+            node.type = Node::Type::Comparison;
+            node.op = current.text;
+            advance();
+            node.rightIsColumn = parseOperand();
+        }
+        int index = addNode(node);
+        query.nodes[index].text = span(begin);
+        closeColumns(index, firstColumn);
+        return index;
+    }
+
+    // Splits the top-level conjuncts into joins, single-relation filters and the rest
+    void classify(int node) {
+        const Node& n = query.nodes[node];
+        if (n.type == Node::Type::And) {
+            for (int child = n.firstChild; child >= 0; child = query.nodes[child].nextSibling) {
+                classify(child);
+            }
+            return;
+        }
+
+        std::string_view alias;
+        bool single = n.columnCount > 0;
+        for (uint32_t i = 0; i < n.columnCount; i++) {
+            const auto& column = query.columns[n.firstColumn + i];
+            if (column.alias.empty() || (!alias.empty() && column.alias != alias)) {
+                single = false;
+            }
+            alias = column.alias;
+        }
+
+        if (n.type == Node::Type::Comparison && n.op == "=" && n.leftIsColumn && n.rightIsColumn &&
+            n.columnCount == 2 && !single && !query.columns[n.firstColumn].alias.empty() &&
+            !query.columns[n.firstColumn + 1].alias.empty()) {
+            query.joins.push_back({query.columns[n.firstColumn], query.columns[n.firstColumn + 1], node});
+        } else if (single) {
+            query.filters.push_back({alias, node});
+        } else {
+            query.otherPredicates.push_back(node);
+        }
+    }
+
+public:
+    SqlParser(std::string_view sql, ParsedQuery& query) : lexer(sql), query(query) {
+        query.sql = sql;
+        advance();
+    }
+
+    void parse() {
+        parseSelectList();
+        parseFromList();
+        if (accept("WHERE")) {
+            query.whereRoot = parseOr();
+            classify(query.whereRoot);
+        }
+        if (!atEnd()) {
+            size_t begin = current.offset;
+            while (!atEnd()) advance();
+            query.trailer = span(begin);
+        }
+    }
+
+    // Convenience wrapper; sql must outlive the result
+    static ParsedQuery parseQuery(std::string_view sql) {
+        ParsedQuery query;
+        SqlParser(sql, query).parse();
+        return query;
+    }
+};
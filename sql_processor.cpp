@@ -4,11 +4,333 @@
 #include <string>
 #include <libpq-fe.h>
 #include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "statement_splitter.h"
+
+// Rewrites INSERT INTO t [(columns)] VALUES (...), ... statements whose values are
+// all plain literals into rows of COPY text format. Anything else (expressions,
+// casts, DEFAULT, E'' strings, ON CONFLICT, RETURNING) is left to PQexec.
+class InsertRewriter {
+private:
+    const std::string& sql;
+    size_t pos = 0;
+
+    void skipSpaces() {
+        while (pos < sql.size() && std::isspace(static_cast<unsigned char>(sql[pos]))) pos++;
+    }
+
+    bool keyword(const char* word) {
+        skipSpaces();
+        size_t length = std::strlen(word);
+        if (sql.size() - pos < length) return false;
+        for (size_t i = 0; i < length; i++) {
+            if (std::toupper(static_cast<unsigned char>(sql[pos + i])) != word[i]) return false;
+        }
+        if (pos + length < sql.size() &&
+            (std::isalnum(static_cast<unsigned char>(sql[pos + length])) || sql[pos + length] == '_')) {
+            return false;
+        }
+        pos += length;
+        return true;
+    }
+
+    bool symbol(char c) {
+        skipSpaces();
+        if (pos < sql.size() && sql[pos] == c) {
+            pos++;
+            return true;
+        }
+        return false;
+    }
+
+    // Possibly schema-qualified, possibly quoted name, copied verbatim
+    bool name(std::string& out) {
+        skipSpaces();
+        size_t start = pos;
+        while (pos < sql.size()) {
+            if (sql[pos] == '"') {
+                size_t close = sql.find('"', pos + 1);
+                while (close != std::string::npos && close + 1 < sql.size() && sql[close + 1] == '"') {
+                    close = sql.find('"', close + 2);
+                }
+                if (close == std::string::npos) return false;
+                pos = close + 1;
+            } else if (std::isalnum(static_cast<unsigned char>(sql[pos])) || sql[pos] == '_' || sql[pos] == '.') {
+                pos++;
+            } else {
+                break;
+            }
+        }
+        out = sql.substr(start, pos - start);
+        return !out.empty();
+    }
+
+    static void appendCopyText(std::string& row, const char* begin, const char* end) {
+        for (const char* p = begin; p < end; p++) {
+            switch (*p) {
+            case '\\': row += "\\\\"; break;
+            case '\t': row += "\\t"; break;
+            case '\n': row += "\\n"; break;
+            case '\r': row += "\\r"; break;
+            default: row += *p;
+            }
+        }
+    }
+
+    // One literal in COPY text form
+    bool value(std::string& row) {
+        skipSpaces();
+        if (pos >= sql.size()) return false;
+        if (sql[pos] == '\'') {
+            for (pos++; pos < sql.size(); pos++) {
+                size_t close = sql.find('\'', pos);
+                if (close == std::string::npos) return false;
+                appendCopyText(row, sql.data() + pos, sql.data() + close);
+                pos = close;
+                if (close + 1 < sql.size() && sql[close + 1] == '\'') {
+                    row += '\'';
+                    pos++;
+                    continue;
+                }
+                pos++;
+                return true;
+            }
+            return false;
+        }
+        if (keyword("NULL")) {
+            row += "\\N";
+            return true;
+        }
+        if (keyword("TRUE")) {
+            row += "t";
+            return true;
+        }
+        if (keyword("FALSE")) {
+            row += "f";
+            return true;
+        }
+        size_t start = pos;
+        if (sql[pos] == '-' || sql[pos] == '+') pos++;
+        size_t digits = pos;
+        while (pos < sql.size() && (std::isdigit(static_cast<unsigned char>(sql[pos])) || sql[pos] == '.')) pos++;
+        if (pos == digits) return false;
+        if (pos < sql.size() && (sql[pos] == 'e' || sql[pos] == 'E')) {
+            pos++;
+            if (pos < sql.size() && (sql[pos] == '-' || sql[pos] == '+')) pos++;
+            while (pos < sql.size() && std::isdigit(static_cast<unsigned char>(sql[pos]))) pos++;
+        }
+        row.append(sql, start, pos - start);
+        return true;
+    }
+
+public:
+    explicit InsertRewriter(const std::string& sql) : sql(sql) {}
+
+    // On success sets target to "table (columns)" as written and appends one COPY line per row
+    bool rewrite(std::string& target, std::string& rows) {
+        std::string table;
+        if (!keyword("INSERT") || !keyword("INTO") || !name(table)) return false;
+        target = table;
+        skipSpaces();
+        if (pos < sql.size() && sql[pos] == '(') {
+            size_t close = sql.find(')', pos);
+            if (close == std::string::npos) return false;
+            target += " " + sql.substr(pos, close + 1 - pos);
+            pos = close + 1;
+        }
+        if (!keyword("VALUES")) return false;
+
+        size_t rowsStart = rows.size();
+        do {
+            if (!symbol('(')) break;
+            bool first = true;
+            do {
+                if (!first) rows += '\t';
+                first = false;
+                if (!value(rows)) break;
+            } while (symbol(','));
+            if (!symbol(')')) break;
+            rows += '\n';
+        } while (symbol(','));
+        skipSpaces();
+        if (pos != sql.size()) {
+            rows.resize(rowsStart);
+            return false;
+        }
+        return true;
+    }
+};
+
+// Writes query results to stdout through one reusable buffer, so output costs a
+// write() per buffer instead of a flush per row. TSV prints NULL as NULL, CSV
+// quotes fields as needed and leaves NULL empty, and binary writes each row as
+// a field count followed by length-prefixed values (-1 for NULL) in the
+// server's binary format, as in COPY BINARY tuples. Count-only mode writes
+// nothing and only counts rows and bytes.
+class ResultWriter {
+public:
+    enum class Format { Tsv, Csv, Binary };
+
+private:
+    static const size_t BUFFER_SIZE = 1 << 20;
+
+    Format format;
+    bool countOnly;
+    std::string buffer;
+    uint64_t rows = 0;
+    uint64_t bytes = 0;
+
+    void writeAll(const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t n = ::write(STDOUT_FILENO, data, size);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) throw std::runtime_error("Failed to write results: " + std::string(std::strerror(errno)));
+            data += n;
+            size -= static_cast<size_t>(n);
+        }
+    }
+
+    void reserve() {
+        if (buffer.size() >= BUFFER_SIZE) flush();
+    }
+
+    void appendCsv(const char* value, int length) {
+        bool quote = false;
+        for (int i = 0; i < length && !quote; i++) {
+            char c = value[i];
+            quote = c == ',' || c == '"' || c == '\n' || c == '\r';
+        }
+        if (!quote) {
+            buffer.append(value, length);
+            return;
+        }
+        buffer += '"';
+        for (int i = 0; i < length; i++) {
+            if (value[i] == '"') buffer += '"';
+            buffer += value[i];
+        }
+        buffer += '"';
+    }
+
+    template <typename T>
+    void appendBigEndian(T value) {
+        for (int shift = (sizeof(T) - 1) * 8; shift >= 0; shift -= 8) {
+            buffer += static_cast<char>((static_cast<uint64_t>(value) >> shift) & 0xff);
+        }
+    }
+
+public:
+    ResultWriter(Format format, bool countOnly) : format(format), countOnly(countOnly) {
+        buffer.reserve(BUFFER_SIZE + (64 << 10));
+    }
+
+    static Format parseFormat(const std::string& name) {
+        if (name == "tsv") return Format::Tsv;
+        if (name == "csv") return Format::Csv;
+        if (name == "binary") return Format::Binary;
+        throw std::invalid_argument("Unknown format '" + name + "' (expected tsv, csv or binary)");
+    }
+
+    bool binary() const { return format == Format::Binary; }
+
+    // Column names; binary output has no header
+    void header(const PGresult* res) {
+        if (countOnly || format == Format::Binary) return;
+        int fields = PQnfields(res);
+        for (int j = 0; j < fields; j++) {
+            if (j > 0) buffer += format == Format::Csv ? ',' : '\t';
+            const char* name = PQfname(res, j);
+            if (format == Format::Csv) appendCsv(name, static_cast<int>(std::strlen(name)));
+            else buffer += name;
+        }
+        buffer += '\n';
+        reserve();
+    }
+
+    // Every row of res, which may be one row or one chunk of a larger result
+    void rowsOf(const PGresult* res) {
+        int fields = PQnfields(res);
+        int count = PQntuples(res);
+        rows += static_cast<uint64_t>(count);
+        for (int i = 0; i < count; i++) {
+            if (countOnly) {
+                for (int j = 0; j < fields; j++) bytes += static_cast<uint64_t>(PQgetlength(res, i, j));
+                continue;
+            }
+            if (format == Format::Binary) appendBigEndian<int16_t>(static_cast<int16_t>(fields));
+            for (int j = 0; j < fields; j++) {
+                bool isNull = PQgetisnull(res, i, j);
+                const char* value = PQgetvalue(res, i, j);
+                int length = PQgetlength(res, i, j);
+                bytes += static_cast<uint64_t>(length);
+                if (format == Format::Binary) {
+                    appendBigEndian<int32_t>(isNull ? -1 : length);
+                    if (!isNull) buffer.append(value, length);
+                    continue;
+                }
+                if (j > 0) buffer += format == Format::Csv ? ',' : '\t';
+                if (format == Format::Csv) {
+                    if (!isNull) appendCsv(value, length);
+                } else {
+                    if (isNull) buffer += "NULL";
+                    else buffer.append(value, length);
+                }
+            }
+            if (format != Format::Binary) buffer += '\n';
+            reserve();
+        }
+    }
+
+    // One row of COPY ... TO STDOUT output, passed through as the server formatted it
+    void copyRow(const char* data, int length) {
+        rows++;
+        bytes += static_cast<uint64_t>(length);
+        if (countOnly) return;
+        buffer.append(data, length);
+        reserve();
+    }
+
+    void flush() {
+        if (buffer.empty()) return;
+        writeAll(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+
+    uint64_t rowCount() const { return rows; }
+    uint64_t byteCount() const { return bytes; }
+};
 
 class SQLProcessor {
 private:
     PGconn* conn;
-    
+    // Turns runs of INSERTs into COPY streams
+    bool bulk = false;
+    bool verbose = true;
+    ResultWriter::Format format = ResultWriter::Format::Tsv;
+    bool countOnly = false;
+    // Rows per result chunk; 1 uses single-row mode
+    int chunkRows = 1000;
+    // Target of the COPY stream that is open, if any
+    std::string copyTarget;
+    std::string copyBuffer;
+    size_t copiedRows = 0;
+    size_t statements = 0;
+
+    static const size_t READ_CHUNK = 1 << 20;
+    // COPY data is sent in pieces of about this size
+    static const size_t COPY_CHUNK = 1 << 20;
+
     // Helper function to trim whitespace
     std::string trim(const std::string& str) {
         size_t first = str.find_first_not_of(" \t\n\r");
@@ -17,7 +339,23 @@ private:
         return str.substr(first, (last - first + 1));
     }
 
-    // Helper function to execute a single SQL statement
+    // Passes the rows of a COPY ... TO STDOUT on to writer; the command's own result follows
+    bool copyOut(ResultWriter& writer) {
+        char* row = nullptr;
+        int length;
+        while ((length = PQgetCopyData(conn, &row, 0)) > 0) {
+            writer.copyRow(row, length);
+            PQfreemem(row);
+        }
+        if (length == -2) {
+            std::cerr << "Error reading COPY data: " << PQerrorMessage(conn) << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Executes a single SQL statement, streaming its rows: libpq hands them over in
+    // single-row or chunked mode, so client memory stays bounded by one chunk
     bool executeQuery(const std::string& query) {
         std::string trimmedQuery = trim(query);
         if (trimmedQuery.empty()) {
@@ -25,45 +363,233 @@ private:
         }
 
         // Debug output
-        std::cout << "Executing query: " << trimmedQuery << std::endl;
+        if (verbose) std::cout << "Executing query: " << trimmedQuery << std::endl;
 
-        PGresult* res = PQexec(conn, trimmedQuery.c_str());
-        if (!res) {
-            std::cerr << "Memory allocation error or lost connection" << std::endl;
+        ResultWriter writer(format, countOnly);
+        auto start = std::chrono::steady_clock::now();
+        // Binary results need the extended protocol, which takes a single statement
+        int sent = writer.binary()
+            ? PQsendQueryParams(conn, trimmedQuery.c_str(), 0, nullptr, nullptr, nullptr, nullptr, 1)
+            : PQsendQuery(conn, trimmedQuery.c_str());
+        if (!sent) {
+            std::cerr << "Error executing query: " << PQerrorMessage(conn) << std::endl;
             return false;
         }
+#ifdef LIBPQ_HAS_CHUNK_MODE
+        int rowModeSet = chunkRows > 1 ? PQsetChunkedRowsMode(conn, chunkRows) : PQsetSingleRowMode(conn);
+#else
+        int rowModeSet = PQsetSingleRowMode(conn);
+#endif
+        if (!rowModeSet) {
+            std::cerr << "Could not stream rows, the result is fetched whole" << std::endl;
+        }
 
+        // Rows must go out after the "Executing query" line
+        std::cout.flush();
+        bool ok = true;
+        bool headerWritten = false;
+        bool tuples = false;
+        while (PGresult* res = PQgetResult(conn)) {
+            ExecStatusType status = PQresultStatus(res);
+            bool rowsResult = status == PGRES_SINGLE_TUPLE || status == PGRES_TUPLES_OK;
+#ifdef LIBPQ_HAS_CHUNK_MODE
+            rowsResult = rowsResult || status == PGRES_TUPLES_CHUNK;
+#endif
+            if (status == PGRES_COPY_OUT) {
+                // Until its data is read, every PQgetResult would return COPY_OUT again
+                PQclear(res);
+                tuples = true;
+                if (!copyOut(writer)) ok = false;
+                continue;
+            }
+            if (status == PGRES_COPY_IN) {
+                // Inline COPY data is only read after statements recognized by isCopyFromStdin,
+                // so there is none to send; the server answers the abort with an error result
+                PQclear(res);
+                PQputCopyEnd(conn, "COPY FROM STDIN data was not found after the statement");
+                continue;
+            }
+            if (rowsResult) {
+                tuples = true;
+                if (!headerWritten) {
+                    writer.header(res);
+                    headerWritten = true;
+                }
+                writer.rowsOf(res);
+            } else if (status != PGRES_COMMAND_OK && ok) {
+                std::cerr << "Error executing query: " << PQresultErrorMessage(res);
+                std::cerr << "Status: " << PQresStatus(status) << std::endl;
+                ok = false;
+            }
+            // Results keep coming until the null that ends the command, even after an error
+            PQclear(res);
+        }
+        writer.flush();
+
+        if (tuples && countOnly) {
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "(" << writer.rowCount() << " rows, " << writer.byteCount() << " bytes, " << ms << " ms)"
+                      << std::endl;
+        }
+        return ok;
+    }
+
+    static bool isFailure(ExecStatusType status) {
+        return status != PGRES_COPY_IN && status != PGRES_COMMAND_OK && status != PGRES_TUPLES_OK;
+    }
+
+    // Sends a COPY ... FROM STDIN statement; when it answers PGRES_COPY_IN, the data follows with putCopyData
+    ExecStatusType sendCopy(const std::string& copySql) {
+        if (verbose) std::cout << "Executing query: " << copySql << std::endl;
+        PGresult* res = PQexec(conn, copySql.c_str());
         ExecStatusType status = PQresultStatus(res);
-        
-        if (status != PGRES_COMMAND_OK && status != PGRES_TUPLES_OK) {
-            std::cerr << "Error executing query: " << PQerrorMessage(conn) << std::endl;
-            std::cerr << "Status: " << PQresStatus(status) << std::endl;
+        if (isFailure(status)) std::cerr << "Error starting COPY: " << PQerrorMessage(conn) << std::endl;
+        PQclear(res);
+        return status;
+    }
+
+    bool beginCopy(const std::string& copySql) {
+        return sendCopy(copySql) == PGRES_COPY_IN;
+    }
+
+    bool flushCopyBuffer() {
+        bool ok = copyBuffer.empty() ||
+                  PQputCopyData(conn, copyBuffer.data(), static_cast<int>(copyBuffer.size())) == 1;
+        copyBuffer.clear();
+        return ok;
+    }
+
+    bool putCopyData(const char* data, size_t size) {
+        copyBuffer.append(data, size);
+        return copyBuffer.size() < COPY_CHUNK || flushCopyBuffer();
+    }
+
+    bool endCopy() {
+        bool ok = flushCopyBuffer() && PQputCopyEnd(conn, nullptr) == 1;
+        // COPY reports one result, then the null that ends the command
+        while (PGresult* res = PQgetResult(conn)) {
+            if (PQresultStatus(res) != PGRES_COMMAND_OK) ok = false;
             PQclear(res);
-            return false;
         }
+        if (!ok) std::cerr << "Error loading COPY data: " << PQerrorMessage(conn) << std::endl;
+        return ok;
+    }
+
+    // Ends the COPY stream fed by INSERT rows, if one is open
+    bool closeInsertCopy() {
+        if (copyTarget.empty()) return true;
+        copyTarget.clear();
+        return endCopy();
+    }
+
+    // Next token of statement from pos on, skipping whitespace and comments; "" at the end.
+    // Punctuation is a token of its own, a string literal keeps its quotes, and a possibly
+    // qualified name is one token, upper-cased outside of double quotes.
+    static std::string nextToken(const std::string& statement, size_t& pos) {
+        size_t n = statement.size();
+        while (pos < n) {
+            if (std::isspace(static_cast<unsigned char>(statement[pos]))) {
+                pos++;
+            } else if (statement.compare(pos, 2, "--") == 0) {
+                pos = statement.find('\n', pos);
+                if (pos == std::string::npos) pos = n;
+            } else if (statement.compare(pos, 2, "/*") == 0) {
+                int depth = 0;
+                do {
+                    if (statement.compare(pos, 2, "/*") == 0) {
+                        depth++;
+                        pos += 2;
+                    } else if (statement.compare(pos, 2, "*/") == 0) {
+                        depth--;
+                        pos += 2;
+                    } else {
+                        pos++;
+                    }
+                } while (depth > 0 && pos < n);
+            } else {
+                break;
+            }
+        }
+        if (pos >= n) return "";
 
-        // Print results if it's a SELECT query
-        if (status == PGRES_TUPLES_OK) {
-            int nFields = PQnfields(res);
-            int nRows = PQntuples(res);
-            
-            // Print column headers
-            for (int i = 0; i < nFields; i++) {
-                std::cout << PQfname(res, i) << "\t";
+        auto quoted = [&](char quote) {
+            size_t start = pos++;
+            while (pos < n) {
+                if (statement[pos++] != quote) continue;
+                // A doubled quote stands for itself
+                if (pos < n && statement[pos] == quote) pos++;
+                else break;
             }
-            std::cout << std::endl;
+            return statement.substr(start, pos - start);
+        };
+        char c = statement[pos];
+        if (c == '\'') return quoted('\'');
+        if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_' && c != '"') return std::string(1, statement[pos++]);
 
-            // Print rows
-            for (int i = 0; i < nRows; i++) {
-                for (int j = 0; j < nFields; j++) {
-                    std::cout << (PQgetisnull(res, i, j) ? "NULL" : PQgetvalue(res, i, j)) << "\t";
-                }
-                std::cout << std::endl;
+        std::string token;
+        while (pos < n) {
+            c = statement[pos];
+            if (c == '"') {
+                token += quoted('"');
+            } else if (std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '.' || c == '$') {
+                token += static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+                pos++;
+            } else {
+                break;
             }
         }
+        return token;
+    }
 
-        PQclear(res);
-        return true;
+    // COPY <table> [(<columns>)] FROM STDIN ..., whose data lines follow in the script
+    static bool isCopyFromStdin(const std::string& statement) {
+        size_t pos = 0;
+        if (nextToken(statement, pos) != "COPY") return false;
+        std::string table = nextToken(statement, pos);
+        // COPY (query) only goes TO somewhere
+        if (table.empty() || table == "(") return false;
+        std::string token = nextToken(statement, pos);
+        if (token == "(") {
+            do {
+                token = nextToken(statement, pos);
+                if (token.empty()) return false;
+            } while (token != ")");
+            token = nextToken(statement, pos);
+        }
+        return token == "FROM" && nextToken(statement, pos) == "STDIN";
+    }
+
+    // Runs one statement of a script, appending INSERT rows to a COPY stream in bulk mode.
+    // copyOpen tells whether the server now takes COPY data, copyFollows whether the
+    // script's next lines are COPY data rather than statements.
+    bool processStatement(const std::string& statement, bool& copyOpen, bool& copyFollows) {
+        statements++;
+        copyOpen = false;
+        copyFollows = false;
+        if (bulk) {
+            std::string target;
+            std::string rows;
+            if (InsertRewriter(statement).rewrite(target, rows)) {
+                bool ok = true;
+                if (target != copyTarget) {
+                    ok = closeInsertCopy();
+                    if (!beginCopy("COPY " + target + " FROM STDIN")) return false;
+                    copyTarget = target;
+                }
+                copiedRows += static_cast<size_t>(std::count(rows.begin(), rows.end(), '\n'));
+                return putCopyData(rows.data(), rows.size()) && ok;
+            }
+        }
+        bool ok = closeInsertCopy();
+        if (isCopyFromStdin(statement)) {
+            ExecStatusType status = sendCopy(trim(statement));
+            copyOpen = status == PGRES_COPY_IN;
+            // The data of a rejected COPY is still skipped up to "\."; a statement that ran
+            // without starting one has none
+            copyFollows = copyOpen || isFailure(status);
+            return !isFailure(status) && ok;
+        }
+        return executeQuery(statement) && ok;
     }
 
 public:
@@ -80,91 +606,222 @@ public:
         }
     }
 
+    SQLProcessor(const SQLProcessor&) = delete;
+    SQLProcessor& operator=(const SQLProcessor&) = delete;
+
+    // Bulk mode sends runs of literal INSERTs into the same table as one COPY stream.
+    // A bad row then fails its whole run instead of a single statement.
+    void setBulk(bool enabled) { bulk = enabled; }
+
+    void setVerbose(bool enabled) { verbose = enabled; }
+
+    // How SELECT results are written; count-only just reports row count, size and time
+    void setOutput(ResultWriter::Format resultFormat, bool onlyCount, int rowsPerChunk) {
+        format = resultFormat;
+        countOnly = onlyCount;
+        chunkRows = std::max(1, rowsPerChunk);
+    }
+
+    // Streams a script in fixed-size chunks ("-" reads stdin), executing statements as they complete
     bool processFile(const std::string& filename) {
-        std::ifstream file(filename);
-        if (!file.is_open()) {
+        int fd = filename == "-" ? STDIN_FILENO : ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
             std::cerr << "Error: Could not open file " << filename << std::endl;
             return false;
         }
 
-        std::stringstream buffer;
-        buffer << file.rdbuf();
-        std::string content = buffer.str();
-        file.close();
-
-        // Split the content into individual queries
-        std::string query;
-        bool inQuotes = false;
-        bool inComment = false;
         bool success = true;
-        
-        for (size_t i = 0; i < content.length(); i++) {
-            char c = content[i];
-            char next = (i + 1 < content.length()) ? content[i + 1] : '\0';
-
-            // Handle comments
-            if (!inQuotes && c == '-' && next == '-') {
-                inComment = true;
-                i++; // Skip next character
-                continue;
-            }
-            if (inComment && c == '\n') {
-                inComment = false;
-                continue;
-            }
-            if (inComment) {
-                continue;
-            }
-
-            // Handle quotes
-            if (c == '\'') {
-                if (inQuotes && next == '\'') {
-                    // Handle escaped quote
-                    query += c;
-                    query += next;
-                    i++; // Skip next character
-                    continue;
-                }
-                inQuotes = !inQuotes;
-            }
-
-            // Process query termination
-            if (c == ';' && !inQuotes) {
-                // Execute the query and check for success
-                if (!executeQuery(query)) {
+        bool copyOk = false;
+        StatementSplitter splitter({
+            [&](const std::string& statement) {
+                bool copyOpen = false;
+                bool copyFollows = false;
+                if (!processStatement(statement, copyOpen, copyFollows)) {
                     success = false;
-                    std::cerr << "Failed query: " << query << std::endl;
+                    std::cerr << "Failed query: " << trim(statement) << std::endl;
                 }
-                query.clear();
-            } else {
-                query += c;
+                copyOk = copyOpen;
+                return copyFollows;
+            },
+            [&](const char* data, size_t size) {
+                if (copyOk && !putCopyData(data, size)) copyOk = false;
+            },
+            [&]() {
+                if (copyOk && !endCopy()) success = false;
+                copyOk = false;
+            }});
+
+        std::vector<char> chunk(READ_CHUNK);
+        while (true) {
+            ssize_t n = ::read(fd, chunk.data(), chunk.size());
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) {
+                std::cerr << "Error reading " << filename << ": " << std::strerror(errno) << std::endl;
+                success = false;
+                break;
             }
+            if (n == 0) break;
+            splitter.feed(chunk.data(), static_cast<size_t>(n));
         }
+        if (fd != STDIN_FILENO) ::close(fd);
+        splitter.finish();
+        if (!closeInsertCopy()) success = false;
+        return success;
+    }
 
-        // Execute any remaining query
-        query = trim(query);
-        if (!query.empty() && !executeQuery(query)) {
-            success = false;
-            std::cerr << "Failed final query: " << query << std::endl;
+    // Streams a CSV file into table with COPY ... FROM STDIN (FORMAT csv)
+    bool loadCsv(const std::string& table, const std::string& filename, bool header) {
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            std::cerr << "Error: Could not open file " << filename << std::endl;
+            return false;
         }
-
-        return success;
+        std::string copySql = "COPY " + table + " FROM STDIN WITH (FORMAT csv" + (header ? ", HEADER true" : "") + ")";
+        if (!beginCopy(copySql)) {
+            ::close(fd);
+            return false;
+        }
+        std::vector<char> chunk(READ_CHUNK);
+        bool ok = true;
+        while (ok) {
+            ssize_t n = ::read(fd, chunk.data(), chunk.size());
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                ok = n == 0;
+                break;
+            }
+            ok = PQputCopyData(conn, chunk.data(), static_cast<int>(n)) == 1;
+        }
+        ::close(fd);
+        if (!ok) PQputCopyEnd(conn, "read error");
+        return endCopy() && ok;
     }
+
+    size_t statementCount() const { return statements; }
+    size_t copiedInsertRows() const { return copiedRows; }
+};
+
+// TABLE=FILE pairs loaded with COPY, each table on its own connection
+struct CsvLoad {
+    std::string table;
+    std::string path;
 };
 
+static bool loadCsvParallel(const char* conninfo, const std::vector<CsvLoad>& loads, int jobs, bool header) {
+    std::atomic<size_t> next{0};
+    std::atomic<int> failures{0};
+    std::vector<std::thread> threads;
+    int workers = std::max(1, std::min<int>(jobs, static_cast<int>(loads.size())));
+    for (int w = 0; w < workers; w++) {
+        threads.emplace_back([&]() {
+            try {
+                SQLProcessor processor(conninfo);
+                for (size_t i = next++; i < loads.size(); i = next++) {
+                    auto start = std::chrono::steady_clock::now();
+                    bool ok = processor.loadCsv(loads[i].table, loads[i].path, header);
+                    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                    std::cout << (ok ? "Loaded " : "Failed to load ") << loads[i].table << " from "
+                              << loads[i].path << " in " << seconds << " s" << std::endl;
+                    if (!ok) failures++;
+                }
+            } catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << std::endl;
+                failures++;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return failures == 0;
+}
+
+static void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [--conninfo STR] [--bulk] [--quiet] [--csv TABLE=FILE]... [--header]\n"
+              << "       [--jobs N] [--format tsv|csv|binary] [--count-only] [--chunk-rows N] [<sql_file|->...]\n"
+              << "  Scripts are streamed and run statement by statement, in order; pg_dump style\n"
+              << "  COPY ... FROM stdin data is passed through.\n"
+              << "  --bulk sends runs of literal INSERTs into one table as a single COPY stream.\n"
+              << "  --csv loads a CSV file into TABLE with COPY after the scripts ran; --jobs loads\n"
+              << "  that many tables at once over separate connections.\n"
+              << "  Query results are streamed in chunks of --chunk-rows rows (single rows before libpq 17)\n"
+              << "  and written through a buffer; --count-only prints row count, size and time instead." << std::endl;
+}
+
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " <sql_file>" << std::endl;
+    std::string conninfo = "dbname=job user=postgres password=postgres hostaddr=127.0.0.1 port=5432";
+    bool bulk = false;
+    bool quiet = false;
+    bool header = false;
+    int jobs = 1;
+    std::string formatName = "tsv";
+    bool countOnly = false;
+    int chunkRows = 1000;
+    std::vector<CsvLoad> csvLoads;
+    std::vector<std::string> scripts;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--conninfo" && hasValue) {
+            conninfo = argv[++i];
+        } else if (arg == "--bulk") {
+            bulk = true;
+        } else if (arg == "--quiet") {
+            quiet = true;
+        } else if (arg == "--header") {
+            header = true;
+        } else if (arg == "--format" && hasValue) {
+            formatName = argv[++i];
+        } else if (arg == "--count-only") {
+            countOnly = true;
+        } else if (arg == "--chunk-rows" && hasValue) {
+            chunkRows = std::atoi(argv[++i]);
+        } else if (arg == "--jobs" && hasValue) {
+            jobs = std::atoi(argv[++i]);
+        } else if (arg == "--csv" && hasValue) {
+            std::string load = argv[++i];
+            size_t equals = load.find('=');
+            if (equals == std::string::npos || equals == 0) {
+                printUsage(argv[0]);
+                return 1;
+            }
+            csvLoads.push_back({load.substr(0, equals), load.substr(equals + 1)});
+        } else if (arg == "--help" || (arg.rfind("--", 0) == 0)) {
+            printUsage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        } else {
+            scripts.push_back(arg);
+        }
+    }
+    if (scripts.empty() && csvLoads.empty()) {
+        printUsage(argv[0]);
         return 1;
     }
 
     try {
-        const char* conninfo = "dbname=job user=postgres password=postgres hostaddr=127.0.0.1 port=5432";
         std::cout << "Attempting to connect with: " << conninfo << std::endl;
-        
-        SQLProcessor processor(conninfo);
-        
-        if (processor.processFile(argv[1])) {
+
+        bool success = true;
+        if (!scripts.empty()) {
+            SQLProcessor processor(conninfo.c_str());
+            processor.setBulk(bulk);
+            processor.setVerbose(!quiet && !bulk);
+            processor.setOutput(ResultWriter::parseFormat(formatName), countOnly, chunkRows);
+            auto start = std::chrono::steady_clock::now();
+            for (const auto& script : scripts) {
+                if (!processor.processFile(script)) success = false;
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "Ran " << processor.statementCount() << " statements";
+            if (bulk) std::cout << " (" << processor.copiedInsertRows() << " INSERT rows sent with COPY)";
+            std::cout << " in " << seconds << " s" << std::endl;
+        }
+        if (!csvLoads.empty() && !loadCsvParallel(conninfo.c_str(), csvLoads, jobs, header)) {
+            success = false;
+        }
+
+        if (success) {
             std::cout << "SQL file processed successfully." << std::endl;
             return 0;
         } else {
@@ -175,4 +832,4 @@ int main(int argc, char* argv[]) {
         std::cerr << "Error: " << e.what() << std::endl;
         return 1;
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+
+// Incremental splitter of SQL scripts into statements. Input is fed in chunks of
+// any size; a state machine tracks quotes, dollar quotes ($$ or $tag$), line
+// comments and nested block comments, so a ';' only ends a statement outside
+// them. Comments are replaced by whitespace. After a COPY ... FROM STDIN
+// statement, the lines up to "\." are passed on as COPY data (pg_dump format).
+class StatementSplitter {
+public:
+    struct Sink {
+        // Returns true when the statement is followed by inline COPY data
+        std::function<bool(const std::string& statement)> statement;
+        std::function<void(const char* data, size_t size)> copyData;
+        std::function<void()> copyEnd;
+    };
+
+private:
+    enum class State { Normal, SingleQuote, DoubleQuote, DollarQuote, LineComment, BlockComment, CopyData };
+
+    Sink sink;
+    State state = State::Normal;
+    std::string statement;
+    // Opening tag of the current dollar quote, including both '$'
+    std::string dollarTag;
+    int commentDepth = 0;
+    // Tail of the last chunk whose meaning depends on the next one, e.g. a lone '-' or '$tag'
+    std::string pending;
+    // Partial COPY data line
+    std::string copyLine;
+    // False until the rest of the COPY statement's own line is skipped
+    bool copyLineStart = false;
+
+    static bool isTagChar(char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+    }
+
+    void emit() {
+        size_t first = statement.find_first_not_of(" \t\n\r");
+        if (first != std::string::npos && sink.statement(statement) && sink.copyData) {
+            state = State::CopyData;
+            copyLineStart = false;
+        }
+        statement.clear();
+    }
+
+    void copyCharacters(const char* data, size_t size, size_t& i) {
+        if (!copyLineStart) {
+            const char* newline = static_cast<const char*>(std::memchr(data + i, '\n', size - i));
+            if (!newline) {
+                i = size;
+                return;
+            }
+            i = static_cast<size_t>(newline - data) + 1;
+            copyLineStart = true;
+        }
+        // Whole lines go straight to the sink; only a line split across chunks is buffered
+        while (i < size) {
+            const char* newline = static_cast<const char*>(std::memchr(data + i, '\n', size - i));
+            size_t end = newline ? static_cast<size_t>(newline - data) + 1 : size;
+            if (copyLine.empty() && newline && end - i >= 2 && data[i] == '\\' && data[i + 1] == '.' &&
+                (end - i == 3 || (end - i == 4 && data[i + 2] == '\r'))) {
+                i = end;
+                sink.copyEnd();
+                state = State::Normal;
+                return;
+            }
+            if (!copyLine.empty() || !newline) {
+                copyLine.append(data + i, end - i);
+                i = end;
+                if (!newline) return;
+                if (copyLine == "\\.\n" || copyLine == "\\.\r\n") {
+                    copyLine.clear();
+                    sink.copyEnd();
+                    state = State::Normal;
+                    return;
+                }
+                sink.copyData(copyLine.data(), copyLine.size());
+                copyLine.clear();
+                continue;
+            }
+            // Passes the run of complete lines before the terminator in one call
+            size_t runEnd = end;
+            while (runEnd < size) {
+                if (size - runEnd >= 2 && data[runEnd] == '\\' && data[runEnd + 1] == '.') break;
+                const char* next = static_cast<const char*>(std::memchr(data + runEnd, '\n', size - runEnd));
+                if (!next) break;
+                runEnd = static_cast<size_t>(next - data) + 1;
+            }
+            sink.copyData(data + i, runEnd - i);
+            i = runEnd;
+        }
+    }
+
+public:
+    explicit StatementSplitter(Sink sink) : sink(std::move(sink)) {}
+
+    void feed(const char* data, size_t size) {
+        if (pending.empty()) {
+            scan(data, size, false);
+            return;
+        }
+        // A held-back tail is re-read in front of the new chunk; this is rare, so the copy is cheap
+        std::string joined = std::move(pending);
+        pending.clear();
+        joined.append(data, size);
+        scan(joined.data(), joined.size(), false);
+    }
+
+    // Flushes a final statement without ';'
+    void finish() {
+        if (state == State::CopyData) {
+            if (!copyLine.empty()) sink.copyData(copyLine.data(), copyLine.size());
+            copyLine.clear();
+            sink.copyEnd();
+            state = State::Normal;
+        }
+        std::string rest = std::move(pending);
+        pending.clear();
+        scan(rest.data(), rest.size(), true);
+        emit();
+    }
+
+private:
+    // Scans data; a tail whose meaning depends on what follows is left in pending,
+    // unless last is set, in which case it is taken literally
+    void scan(const char* data, size_t size, bool last) {
+        size_t i = 0;
+        auto holdBack = [&]() {
+            if (last) return false;
+            pending.assign(data + i, size - i);
+            i = size;
+            return true;
+        };
+        while (i < size) {
+            if (state == State::CopyData) {
+                copyCharacters(data, size, i);
+                continue;
+            }
+            char c = data[i];
+            bool hasNext = i + 1 < size;
+            char next = hasNext ? data[i + 1] : '\0';
+            switch (state) {
+            case State::Normal:
+                if ((c == '-' || c == '/') && !hasNext) {
+                    if (holdBack()) break;
+                }
+                if (c == '-' && next == '-') {
+                    state = State::LineComment;
+                    i += 2;
+                } else if (c == '/' && next == '*') {
+                    state = State::BlockComment;
+                    commentDepth = 1;
+                    statement += ' ';
+                    i += 2;
+                } else if (c == '\'') {
+                    state = State::SingleQuote;
+                    statement += c;
+                    i++;
+                } else if (c == '"') {
+                    state = State::DoubleQuote;
+                    statement += c;
+                    i++;
+                } else if (c == '$' && (statement.empty() || !isTagChar(statement.back()))) {
+                    // $tag$ opens a dollar quote; $1 is a parameter
+                    size_t end = i + 1;
+                    while (end < size && isTagChar(data[end])) end++;
+                    if (end == size) {
+                        if (holdBack()) break;
+                        statement += c;
+                        i++;
+                    } else if (data[end] == '$' && !std::isdigit(static_cast<unsigned char>(data[i + 1]))) {
+                        dollarTag.assign(data + i, end + 1 - i);
+                        statement += dollarTag;
+                        state = State::DollarQuote;
+                        i = end + 1;
+                    } else {
+                        statement.append(data + i, end - i);
+                        i = end;
+                    }
+                } else if (c == ';') {
+                    i++;
+                    emit();
+                } else {
+                    statement += c;
+                    i++;
+                }
+                break;
+            case State::SingleQuote:
+            case State::DoubleQuote: {
+                char quote = state == State::SingleQuote ? '\'' : '"';
+                const char* close = static_cast<const char*>(std::memchr(data + i, quote, size - i));
+                if (!close) {
+                    statement.append(data + i, size - i);
+                    i = size;
+                    break;
+                }
+                size_t end = static_cast<size_t>(close - data);
+                statement.append(data + i, end + 1 - i);
+                i = end + 1;
+                // A doubled quote stays inside; the next chunk decides when it is last here
+                if (i == size) {
+                    if (!last) {
+                        statement.pop_back();
+                        pending.assign(1, quote);
+                    } else {
+                        state = State::Normal;
+                    }
+                } else if (data[i] == quote) {
+                    statement += quote;
+                    i++;
+                } else {
+                    state = State::Normal;
+                }
+                break;
+            }
+            case State::DollarQuote: {
+                size_t end = std::string_view(data, size).find(dollarTag, i);
+                if (end == std::string_view::npos) {
+                    // Keeps a possible partial closing tag for the next chunk
+                    size_t keep = std::min(size - i, dollarTag.size() - 1);
+                    statement.append(data + i, size - i - keep);
+                    i = size - keep;
+                    if (keep > 0 && holdBack()) break;
+                    statement.append(data + i, size - i);
+                    i = size;
+                    break;
+                }
+                statement.append(data + i, end + dollarTag.size() - i);
+                i = end + dollarTag.size();
+                state = State::Normal;
+                break;
+            }
+            case State::LineComment: {
+                const char* newline = static_cast<const char*>(std::memchr(data + i, '\n', size - i));
+                if (!newline) {
+                    i = size;
+                    break;
+                }
+                statement += '\n';
+                i = static_cast<size_t>(newline - data) + 1;
+                state = State::Normal;
+                break;
+            }
+            case State::BlockComment:
+                if ((c == '*' || c == '/') && !hasNext) {
+                    if (holdBack()) break;
+                }
+                if (c == '*' && next == '/') {
+                    i += 2;
+                    if (--commentDepth == 0) state = State::Normal;
+                } else if (c == '/' && next == '*') {
+                    i += 2;
+                    commentDepth++;
+                } else {
+                    i++;
+                }
+                break;
+            case State::CopyData:
+                break;
+            }
+        }
+    }
+};
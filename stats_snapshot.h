@@ -0,0 +1,203 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "binary_io.h"
+#include "heavy_hitters.h"
+
+// pg_stats entry for one column
+struct ColumnStats {
+    std::string name;
+    double nDistinct = 0;
+    double correlation = 0;
+    // Postgres text forms of most_common_vals and most_common_freqs
+    std::string mostCommonValues;
+    std::string mostCommonFreqs;
+};
+
+struct TableStats {
+    double reltuples = 0;
+    // n_tup_ins + n_tup_upd + n_tup_del from pg_stat_user_tables when the stats were taken
+    int64_t changeCounter = 0;
+    std::vector<ColumnStats> columns;
+};
+
+// How far a change stream has been applied to the maintained statistics
+struct ChangeWatermark {
+    // Commit LSN of the last applied transaction; 0 when no stream is applied
+    uint64_t lsn = 0;
+    // Wall-clock time (ms since the epoch) when the stream was last drained, so
+    // every change committed before it is reflected
+    int64_t syncedAtMs = 0;
+};
+
+// Versioned binary dump of everything the planner reads from the catalog plus
+// the join-key sketches built from the data. Loaded with mmap at startup so a
+// warm run needs no per-table round trips.
+struct StatsSnapshot {
+    static constexpr uint32_t FORMAT_VERSION = 9;
+
+    std::map<std::string, TableStats> tables;
+    // Keyed like the sketch catalog: "table.column", plus " AS alias WHERE filter" for filtered sketches
+    std::map<std::string, JoinKeySketch> sketches;
+    // LSN each sketch's rows were read at, for sketches maintained from a change stream
+    std::map<std::string, uint64_t> sketchLsns;
+    // Row counts of filtered relations, keyed "table AS alias WHERE filter"
+    std::map<std::string, double> filteredCardinalities;
+    ChangeWatermark watermark;
+    // Identifies the statistics contents; changes whenever cached statistics are invalidated
+    // or updated, so plans cached under another epoch are known to be stale
+    uint64_t epoch = 0;
+
+    // Returns false when the file does not exist; throws when it is corrupt or from another version
+    static bool load(const std::string& path, StatsSnapshot& snapshot) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+
+        struct stat info;
+        if (::fstat(fd, &info) != 0 || info.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        size_t size = static_cast<size_t>(info.st_size);
+        void* data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            throw std::runtime_error("Failed to mmap stats snapshot " + path);
+        }
+
+        try {
+            snapshot = parse(BinaryReader(static_cast<const char*>(data), size));
+        } catch (const std::exception& e) {
+            ::munmap(data, size);
+            throw std::runtime_error("Invalid stats snapshot " + path + ": " + e.what());
+        }
+        ::munmap(data, size);
+        return true;
+    }
+
+    // Writes to a temporary file first so readers never see a partial snapshot
+    void save(const std::string& path) const {
+        std::string buffer;
+        BinaryWriter writer(buffer);
+        writer.writeBytes(MAGIC, sizeof(MAGIC));
+        writer.write<uint32_t>(FORMAT_VERSION);
+
+        writer.write<uint32_t>(static_cast<uint32_t>(tables.size()));
+        for (const auto& [name, table] : tables) {
+            writer.writeString(name);
+            writer.write<double>(table.reltuples);
+            writer.write<int64_t>(table.changeCounter);
+            writer.write<uint32_t>(static_cast<uint32_t>(table.columns.size()));
+            for (const auto& column : table.columns) {
+                writer.writeString(column.name);
+                writer.write<double>(column.nDistinct);
+                writer.write<double>(column.correlation);
+                writer.writeString(column.mostCommonValues);
+                writer.writeString(column.mostCommonFreqs);
+            }
+        }
+
+        writer.write<uint32_t>(static_cast<uint32_t>(sketches.size()));
+        for (const auto& [key, sketch] : sketches) {
+            writer.writeString(key);
+            sketch.serialize(writer);
+        }
+
+        writer.write<uint32_t>(static_cast<uint32_t>(filteredCardinalities.size()));
+        for (const auto& [key, rows] : filteredCardinalities) {
+            writer.writeString(key);
+            writer.write<double>(rows);
+        }
+
+        writer.write<uint32_t>(static_cast<uint32_t>(sketchLsns.size()));
+        for (const auto& [key, lsn] : sketchLsns) {
+            writer.writeString(key);
+            writer.write<uint64_t>(lsn);
+        }
+        writer.write<uint64_t>(watermark.lsn);
+        writer.write<int64_t>(watermark.syncedAtMs);
+        writer.write<uint64_t>(epoch);
+
+        std::string tmpPath = path + ".tmp";
+        {
+            std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+            if (!file.write(buffer.data(), buffer.size())) {
+                throw std::runtime_error("Failed to write stats snapshot " + tmpPath);
+            }
+        }
+        if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+            throw std::runtime_error("Failed to replace stats snapshot " + path);
+        }
+    }
+
+private:
+    static constexpr char MAGIC[8] = {'C', 'M', 'P', 'S', 'S', 'N', 'A', 'P'};
+
+    static StatsSnapshot parse(BinaryReader reader) {
+        char magic[sizeof(MAGIC)];
+        reader.readBytes(magic, sizeof(magic));
+        if (std::string(magic, sizeof(magic)) != std::string(MAGIC, sizeof(MAGIC))) {
+            throw std::runtime_error("bad magic");
+        }
+        uint32_t version = reader.read<uint32_t>();
+        if (version != FORMAT_VERSION) {
+            throw std::runtime_error("format version " + std::to_string(version) + ", expected " +
+                                     std::to_string(FORMAT_VERSION));
+        }
+
+        StatsSnapshot snapshot;
+        uint32_t tableCount = reader.read<uint32_t>();
+        for (uint32_t i = 0; i < tableCount; i++) {
+            std::string name = reader.readString();
+            TableStats& table = snapshot.tables[name];
+            table.reltuples = reader.read<double>();
+            table.changeCounter = reader.read<int64_t>();
+            uint32_t columnCount = reader.read<uint32_t>();
+            for (uint32_t c = 0; c < columnCount; c++) {
+                ColumnStats column;
+                column.name = reader.readString();
+                column.nDistinct = reader.read<double>();
+                column.correlation = reader.read<double>();
+                column.mostCommonValues = reader.readString();
+                column.mostCommonFreqs = reader.readString();
+                table.columns.push_back(std::move(column));
+            }
+        }
+
+        uint32_t sketchCount = reader.read<uint32_t>();
+        for (uint32_t i = 0; i < sketchCount; i++) {
+            std::string key = reader.readString();
+            snapshot.sketches.emplace(key, JoinKeySketch::deserialize(reader));
+        }
+
+        uint32_t cardinalityCount = reader.read<uint32_t>();
+        for (uint32_t i = 0; i < cardinalityCount; i++) {
+            std::string key = reader.readString();
+            snapshot.filteredCardinalities[key] = reader.read<double>();
+        }
+
+        uint32_t lsnCount = reader.read<uint32_t>();
+        for (uint32_t i = 0; i < lsnCount; i++) {
+            std::string key = reader.readString();
+            snapshot.sketchLsns[key] = reader.read<uint64_t>();
+        }
+        snapshot.watermark.lsn = reader.read<uint64_t>();
+        snapshot.watermark.syncedAtMs = reader.read<int64_t>();
+        snapshot.epoch = reader.read<uint64_t>();
+        if (!reader.atEnd()) {
+            throw std::runtime_error("trailing data");
+        }
+        return snapshot;
+    }
+};
@@ -0,0 +1,13 @@
+-- COPY ... TO STDOUT is written out like query results and the script goes on after it
+CREATE TEMP TABLE copy_stdout_test (id integer, name text);
+INSERT INTO copy_stdout_test VALUES (1, 'one'), (2, 'two');
+COPY copy_stdout_test TO STDOUT;
+COPY (SELECT * FROM copy_stdout_test ORDER BY id) TO STDOUT WITH (FORMAT csv);
+
+-- Naming stdin is not COPY FROM STDIN: the statements after it still run
+CREATE TEMP TABLE stdin_log (line text);
+COPY (SELECT * FROM stdin_log) TO STDOUT;
+COPY copy_stdout_test (id, name) FROM stdin;
+3	three
+\.
+SELECT count(*) AS copied FROM copy_stdout_test;
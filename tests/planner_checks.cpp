@@ -0,0 +1,238 @@
+// Checks of the planner's pure logic, runnable without a database:
+//   g++ -O2 -o planner_checks tests/planner_checks.cpp -std=c++17 && ./planner_checks job
+// Prints every failed check and exits non-zero when there was one.
+
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../cardinality_estimator.h"
+#include "../fast_agm_sketch.h"
+#include "../heavy_hitters.h"
+#include "../join_enumerator.h"
+#include "../plan_cache.h"
+#include "../query_workload.h"
+#include "../sql_parser.h"
+#include "../statement_splitter.h"
+
+static int failures = 0;
+
+static void check(bool ok, const std::string& what) {
+    if (ok) return;
+    std::cerr << "FAILED: " << what << std::endl;
+    failures++;
+}
+
+// Statements, COPY data and COPY ends in the order the splitter reported them.
+// COPY data is concatenated up to its end, since chunking may split it anywhere.
+static std::vector<std::string> splitEvents(const std::string& script, size_t chunk) {
+    std::vector<std::string> events;
+    std::string copy;
+    StatementSplitter splitter(StatementSplitter::Sink{
+        [&](const std::string& statement) {
+            events.push_back("statement:" + statement);
+            return statement.find("FROM STDIN") != std::string::npos;
+        },
+        [&](const char* data, size_t size) { copy.append(data, size); },
+        [&]() {
+            events.push_back("copy:" + copy);
+            copy.clear();
+        }});
+    for (size_t i = 0; i < script.size(); i += chunk) {
+        splitter.feed(script.data() + i, std::min(chunk, script.size() - i));
+    }
+    splitter.finish();
+    return events;
+}
+
+static void checkStatementSplitter() {
+    const std::string script =
+        "SELECT 'a;b', \"c;\"\"d\" FROM t; -- comment; with ;\n"
+        "SELECT $$x;$y$$, $tag$ $$; $tag$, $1 /* outer /* inner; */ still; */ FROM u;\n"
+        "COPY t (a, b) FROM STDIN;\n"
+        "1\tone\n"
+        "2\t-- not a comment;\n"
+        "\\.\n"
+        "SELECT 'it''s' - -1 / 2;\n"
+        "SELECT 1";
+    std::vector<std::string> expected = splitEvents(script, script.size());
+    check(expected.size() == 6, "splitter reports 5 statements and one COPY, got " +
+                                    std::to_string(expected.size()) + " events");
+    if (expected.size() == 6) {
+        check(expected[1] == "statement: \nSELECT $$x;$y$$, $tag$ $$; $tag$, $1   FROM u",
+              "splitter keeps quoted ';' and drops comments");
+        check(expected[3] == "copy:1\tone\n2\t-- not a comment;\n", "splitter passes COPY data verbatim");
+        check(expected[5] == "statement:\nSELECT 1", "splitter flushes a final statement without ';'");
+    }
+    for (size_t chunk = 1; chunk < 60; chunk++) {
+        check(splitEvents(script, chunk) == expected,
+              "splitter gives the same statements with chunks of " + std::to_string(chunk) + " bytes");
+    }
+}
+
+static void checkParser(const QueryWorkload& workload) {
+    for (const auto& query : workload) {
+        try {
+            JoinGraph graph = SqlParser::parseQuery(query.sql).joinGraph();
+            check(graph.size() >= 2 && graph.isConnected(graph.allRelations()),
+                  "query " + query.queryId + " parses to a connected join graph");
+        } catch (const std::exception& e) {
+            check(false, "query " + query.queryId + " parses: " + e.what());
+        }
+    }
+}
+
+// Parenthesised values and nested predicates in filters
+static void checkParenthesisedFilters() {
+    const std::string sql =
+        "SELECT MIN(t.title) FROM title AS t, movie_keyword AS mk "
+        "WHERE t.id = mk.movie_id AND (t.production_year + 1) > 2000 AND (t.kind_id) IN (1, 2) "
+        "AND ((mk.keyword_id = 3) OR (mk.keyword_id * 2 BETWEEN 4 AND 8));";
+    try {
+        ParsedQuery query = SqlParser::parseQuery(sql);
+        check(query.joins.size() == 1 && query.filters.size() == 3 && query.trailer.empty(),
+              "parenthesised values parse as filter operands");
+        for (const auto& filter : query.filters) {
+            std::string_view text = query.nodes[filter.node].text;
+            if (text.substr(0, 2) == "(t") {
+                check(text == "(t.production_year + 1) > 2000" || text == "(t.kind_id) IN (1, 2)",
+                      "filter on a parenthesised value keeps its comparison, got " + std::string(text));
+            }
+        }
+    } catch (const std::exception& e) {
+        check(false, std::string("parenthesised values parse: ") + e.what());
+    }
+}
+
+static void checkFingerprint() {
+    auto fingerprint = [](const std::string& sql) { return QueryFingerprint::normalize(SqlParser::parseQuery(sql)); };
+    std::string base = fingerprint(
+        "SELECT MIN(t.title) FROM title AS t, movie_keyword AS mk "
+        "WHERE t.id = mk.movie_id AND t.production_year > 2000 AND mk.keyword_id IN (1, 2, 3);");
+    check(base == fingerprint("select min(x.title) from title as x, movie_keyword as y "
+                              "where x.id = y.movie_id and x.production_year > 1990 and y.keyword_id in (7);"),
+          "fingerprint ignores constants, IN list lengths, alias names and keyword case");
+    check(base != fingerprint("SELECT MIN(t.title) FROM title AS t, movie_info AS mk "
+                              "WHERE t.id = mk.movie_id AND t.production_year > 2000 AND mk.keyword_id IN (1);"),
+          "fingerprint tells different tables apart");
+    check(base != fingerprint("SELECT MIN(t.title) FROM title AS t, movie_keyword AS mk "
+                              "WHERE t.id = mk.movie_id AND t.production_year < 2000 AND mk.keyword_id IN (1);"),
+          "fingerprint tells different operators apart");
+}
+
+// Deterministic estimates: base rows per relation times a selectivity per join edge
+class SyntheticEstimator final : public CardinalityEstimator {
+private:
+    const JoinGraph& graph;
+
+protected:
+    double estimateSubset(uint64_t subset) const override {
+        double rows = 1;
+        for (int i = 0; i < graph.size(); i++) {
+            if (!(subset & JoinGraph::bit(i))) continue;
+            rows *= 1000.0 * (1 + i % 7);
+            for (int j = i + 1; j < graph.size(); j++) {
+                if ((subset & JoinGraph::bit(j)) && (graph.neighbors(i) & JoinGraph::bit(j))) {
+                    rows /= 100.0 * (1 + (i * 7 + j) % 13);
+                }
+            }
+        }
+        return rows;
+    }
+
+public:
+    explicit SyntheticEstimator(const JoinGraph& graph) : CardinalityEstimator(graph), graph(graph) {}
+};
+
+// Cheapest C_out over all bushy trees without cross products, by brute force over subset splits
+static double exhaustiveCost(const CardinalityEstimator& estimator) {
+    const JoinGraph& graph = estimator.joinGraph();
+    std::vector<double> best(graph.allRelations() + 1, std::numeric_limits<double>::infinity());
+    for (uint64_t subset = 1; subset <= graph.allRelations(); subset++) {
+        if (!graph.isConnected(subset)) continue;
+        if (__builtin_popcountll(subset) == 1) {
+            best[subset] = 0;
+            continue;
+        }
+        for (uint64_t left = (subset - 1) & subset; left; left = (left - 1) & subset) {
+            uint64_t right = subset ^ left;
+            if (left < right || !graph.isConnected(left) || !graph.isConnected(right)) continue;
+            best[subset] = std::min(best[subset], best[left] + best[right] + estimator.estimate(subset));
+        }
+    }
+    return best[graph.allRelations()];
+}
+
+static void checkDPccp(const QueryWorkload& workload) {
+    for (const auto& query : workload) {
+        JoinGraph graph = SqlParser::parseQuery(query.sql).joinGraph();
+        if (graph.size() < 2 || graph.size() > 10 || !graph.isConnected(graph.allRelations())) continue;
+        SyntheticEstimator estimator(graph);
+        JoinTree tree = DPccpEnumerator(estimator).run();
+        check(!tree.empty() && tree.nodes[tree.root].relations == graph.allRelations(),
+              "DPccp joins every relation of query " + query.queryId);
+        double expected = exhaustiveCost(estimator);
+        check(std::abs(tree.cost() - expected) <= 1e-9 * expected,
+              "DPccp finds the cheapest tree of query " + query.queryId);
+    }
+}
+
+static void checkSketchMerge() {
+    std::mt19937_64 gen(42);
+    std::vector<int32_t> keys(200000);
+    for (auto& key : keys) key = static_cast<int32_t>(std::pow(static_cast<double>(gen() % 100000) / 100000, 3) * 5000);
+    size_t half = keys.size() / 3;
+
+    FastAGMSketch whole;
+    FastAGMSketch first;
+    FastAGMSketch second;
+    whole.update(keys.data(), keys.size());
+    first.update(keys.data(), half);
+    second.update(keys.data() + half, keys.size() - half);
+    first.merge(second);
+    check(first.estimateJoinSize(first) == whole.estimateJoinSize(whole) && first.count() == whole.count(),
+          "merged AGM sketches of two shards equal the sketch of their union");
+
+    // With at most 32 distinct keys every key is tracked exactly, so merging loses nothing
+    std::vector<int32_t> few(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) few[i] = keys[i] % 32;
+    JoinKeySketch wholeKeys;
+    JoinKeySketch firstKeys;
+    JoinKeySketch secondKeys;
+    wholeKeys.update(few.data(), few.size());
+    firstKeys.update(few.data(), half);
+    secondKeys.update(few.data() + half, few.size() - half);
+    firstKeys.merge(secondKeys);
+    wholeKeys.finalize();
+    double exact = 0;
+    std::map<int32_t, double> counts;
+    for (int32_t key : few) counts[key]++;
+    for (const auto& [key, count] : counts) exact += count * count;
+    check(std::abs(firstKeys.estimateJoinSize(firstKeys) - exact) <= 1e-6 * exact &&
+              std::abs(wholeKeys.estimateJoinSize(wholeKeys) - exact) <= 1e-6 * exact,
+          "join-key sketches of few keys give the exact self-join size, merged or not");
+}
+
+int main(int argc, char* argv[]) {
+    QueryWorkload workload;
+    workload.addPath(argc > 1 ? argv[1] : "job");
+    check(!workload.empty(), "workload has queries");
+
+    checkStatementSplitter();
+    checkParser(workload);
+    checkParenthesisedFilters();
+    checkFingerprint();
+    checkDPccp(workload);
+    checkSketchMerge();
+
+    if (failures > 0) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed (" << workload.size() << " queries)" << std::endl;
+    return 0;
+}